@@ -0,0 +1,444 @@
+/* Copyright (c) 2015, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures the round trip latency of a cache line bouncing between every
+// pair of cpus.  One thread is pinned to each cpu of the pair and they take
+// turns incrementing a counter that sits alone on its cache line, so every
+// turn moves the line to the other cpu and back.  Pairs are grouped by how
+// the two cpus are related: smt siblings, sharing a last level cache, on the
+// same numa node, on the same socket, or on different sockets.
+//
+// Only the cpus the process is allowed to run on are paired, and pairs that
+// cannot be pinned anyway, for instance because a cpu went offline, are
+// reported and left out.
+//
+// usage: core_to_core_latency [--json] [--round-trips N] [--max-pairs N]
+
+#include <cpuaff/cpuaff.hpp>
+#include <cpuaff/impl/atomic.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <time.h>
+
+namespace
+{
+const char *relation_names[] = {"smt", "llc", "numa", "socket", "remote"};
+const int relation_count = 5;
+
+int get_relation(const cpuaff::cpu &a, const cpuaff::cpu &b)
+{
+    if (a.socket() == b.socket() && a.core() == b.core())
+    {
+        return 0;
+    }
+    else if (a.llc() >= 0 && a.llc() == b.llc())
+    {
+        return 1;
+    }
+    else if (a.numa() == b.numa())
+    {
+        return 2;
+    }
+    else if (a.socket() == b.socket())
+    {
+        return 3;
+    }
+
+    return 4;
+}
+
+uint64_t now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+// the counter the two threads bounce, alone on its cache line
+struct line
+{
+    char before[CPUAFF_CACHE_LINE_SIZE];
+    volatile uint64_t counter;
+    char after[CPUAFF_CACHE_LINE_SIZE];
+};
+
+struct responder
+{
+    const cpuaff::affinity_manager *manager;
+    cpuaff::cpu cpu;
+    line *shared;
+    uint64_t last;
+    bool pinned;
+};
+
+// answers every odd value with the next even value until it has answered
+// the last one
+void *respond(void *arg)
+{
+    responder *r = static_cast< responder * >(arg);
+
+    cpuaff::cpu_set cpus;
+    cpus.insert(r->cpu);
+    r->pinned = r->manager->set_affinity(cpus);
+
+    for (uint64_t expected = 1; expected < r->last; expected += 2)
+    {
+        while (cpuaff::impl::atomic::load(r->shared->counter) != expected)
+        {
+            cpuaff::impl::atomic::pause();
+        }
+
+        cpuaff::impl::atomic::store(r->shared->counter, expected + 1);
+    }
+
+    return NULL;
+}
+
+// measure the round trip latency between two cpus in nanoseconds, keeping
+// the best of a few trials so that a stray interrupt does not show up as
+// latency
+bool measure(double &latency,
+             cpuaff::affinity_manager &manager,
+             const cpuaff::cpu &a,
+             const cpuaff::cpu &b,
+             uint64_t round_trips)
+{
+    const uint64_t warmup = 1000;
+    const int trials = 3;
+
+    if (!manager.pin(a))
+    {
+        return false;
+    }
+
+    line shared;
+    shared.counter = 0;
+
+    responder r;
+    r.manager = &manager;
+    r.cpu = b;
+    r.shared = &shared;
+    r.last = 2 * (warmup + trials * round_trips);
+    r.pinned = false;
+
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, respond, &r) != 0)
+    {
+        return false;
+    }
+
+    uint64_t value = 0;
+    double best = 0;
+
+    for (int trial = -1; trial < trials; ++trial)
+    {
+        uint64_t count = (trial < 0) ? warmup : round_trips;
+        uint64_t start = now();
+
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            cpuaff::impl::atomic::store(shared.counter, ++value);
+            ++value;
+
+            while (cpuaff::impl::atomic::load(shared.counter) != value)
+            {
+                cpuaff::impl::atomic::pause();
+            }
+        }
+
+        double elapsed = double(now() - start) / double(count);
+
+        if (trial >= 0 && (trial == 0 || elapsed < best))
+        {
+            best = elapsed;
+        }
+    }
+
+    pthread_join(thread, NULL);
+    latency = best;
+
+    return r.pinned;
+}
+
+// a and b are positions in the list of cpus being paired, which is not the
+// affinity manager's list inside a restricted cpuset; only the manager's
+// indexes are printed
+struct result
+{
+    int32_t a;
+    int32_t b;
+    int relation;
+    double latency;
+};
+
+double percentile(std::vector< double > values, double p)
+{
+    std::sort(values.begin(), values.end());
+    return values[std::size_t(p * double(values.size() - 1) + 0.5)];
+}
+
+void print_csv(const std::vector< cpuaff::cpu > &cpus,
+               const std::vector< int32_t > &indexes,
+               const std::vector< result > &results)
+{
+    std::cout << "relation,cpu_a,cpu_b,native_a,native_b,round_trip_ns"
+              << std::endl;
+
+    for (int relation = 0; relation < relation_count; ++relation)
+    {
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const result &r = results[i];
+
+            if (r.relation == relation)
+            {
+                std::cout << relation_names[relation] << ","
+                          << indexes[r.a] << "," << indexes[r.b] << ","
+                          << cpus[r.a].id().get() << ","
+                          << cpus[r.b].id().get() << "," << std::fixed
+                          << std::setprecision(1) << r.latency << std::endl;
+            }
+        }
+    }
+}
+
+void print_json(const std::vector< cpuaff::cpu > &cpus,
+                const std::vector< int32_t > &indexes,
+                const std::vector< result > &results)
+{
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "{\n  \"cpus\": [";
+
+    for (std::size_t i = 0; i < cpus.size(); ++i)
+    {
+        std::cout << ((i) ? ",\n" : "\n") << "    {\"index\": " << indexes[i]
+                  << ", \"native\": " << cpus[i].id().get()
+                  << ", \"socket\": " << cpus[i].socket()
+                  << ", \"core\": " << cpus[i].core()
+                  << ", \"processing_unit\": " << cpus[i].processing_unit()
+                  << ", \"numa\": " << cpus[i].numa()
+                  << ", \"llc\": " << cpus[i].llc() << "}";
+    }
+
+    std::cout << "\n  ],\n  \"groups\": {";
+
+    for (int relation = 0; relation < relation_count; ++relation)
+    {
+        std::vector< double > latencies;
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            if (results[i].relation == relation)
+            {
+                latencies.push_back(results[i].latency);
+            }
+        }
+
+        std::cout << ((relation) ? ",\n" : "\n") << "    \""
+                  << relation_names[relation]
+                  << "\": {\"pairs\": " << latencies.size();
+
+        if (!latencies.empty())
+        {
+            std::cout << ", \"min\": " << percentile(latencies, 0)
+                      << ", \"median\": " << percentile(latencies, 0.5)
+                      << ", \"max\": " << percentile(latencies, 1);
+        }
+
+        std::cout << "}";
+    }
+
+    std::cout << "\n  },\n  \"pairs\": [";
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        std::cout << ((i) ? ",\n" : "\n")
+                  << "    {\"a\": " << indexes[results[i].a]
+                  << ", \"b\": " << indexes[results[i].b]
+                  << ", \"relation\": \""
+                  << relation_names[results[i].relation]
+                  << "\", \"round_trip_ns\": " << results[i].latency << "}";
+    }
+
+    std::cout << "\n  ]\n}" << std::endl;
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    uint64_t round_trips = 20000;
+    std::size_t max_pairs = 4096;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (strcmp(argv[i], "--round-trips") == 0 && i + 1 < argc)
+        {
+            round_trips = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--max-pairs") == 0 && i + 1 < argc)
+        {
+            max_pairs = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--json] [--round-trips N] [--max-pairs N]"
+                      << std::endl;
+            return -1;
+        }
+    }
+
+    cpuaff::affinity_manager manager;
+
+    if (!manager.has_cpus())
+    {
+        std::cerr << "cpuaff: unable to initialize affinity_manager."
+                  << std::endl;
+        return -1;
+    }
+
+    if (round_trips == 0)
+    {
+        round_trips = 1;
+    }
+
+    // only pair cpus this process may run on so that it works inside a
+    // restricted cpuset
+    cpuaff::cpu_set allowed;
+
+    if (!manager.get_affinity(allowed))
+    {
+        std::cerr << "cpuaff: unable to get the affinity of this process."
+                  << std::endl;
+        return -1;
+    }
+
+    std::vector< cpuaff::cpu > cpus(allowed.begin(), allowed.end());
+    std::vector< int32_t > indexes(cpus.size(), -1);
+
+    for (std::size_t i = 0; i < cpus.size(); ++i)
+    {
+        manager.get_index_from_cpu(indexes[i], cpus[i]);
+    }
+
+    // every pair, by relation
+    std::vector< std::vector< result > > pairs(relation_count);
+    std::size_t total = 0;
+
+    for (std::size_t a = 0; a < cpus.size(); ++a)
+    {
+        for (std::size_t b = a + 1; b < cpus.size(); ++b)
+        {
+            result r;
+            r.a = int32_t(a);
+            r.b = int32_t(b);
+            r.relation = get_relation(cpus[a], cpus[b]);
+            r.latency = 0;
+            pairs[r.relation].push_back(r);
+            ++total;
+        }
+    }
+
+    // on big machines measure an evenly spread sample of the pairs of each
+    // relation instead of all of them
+    std::size_t per_relation = std::max(max_pairs / relation_count,
+                                        std::size_t(1));
+    std::vector< result > results;
+
+    for (int relation = 0; relation < relation_count; ++relation)
+    {
+        std::vector< result > &group = pairs[relation];
+        std::size_t count = group.size();
+
+        if (total > max_pairs && count > per_relation)
+        {
+            count = per_relation;
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            results.push_back(group[i * group.size() / count]);
+        }
+    }
+
+    cpuaff::affinity_stack stack(manager);
+    stack.push_affinity();
+
+    std::vector< result > measured;
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        result &r = results[i];
+
+        if (measure(r.latency, manager, cpus[r.a], cpus[r.b], round_trips))
+        {
+            measured.push_back(r);
+        }
+        else
+        {
+            std::cerr << "cpuaff: skipping " << cpus[r.a] << " and "
+                      << cpus[r.b] << ", unable to pin to them." << std::endl;
+        }
+    }
+
+    stack.pop_affinity();
+    results.swap(measured);
+
+    if (results.size() < total)
+    {
+        std::cerr << "cpuaff: measured " << results.size() << " of " << total
+                  << " pairs." << std::endl;
+    }
+
+    if (json)
+    {
+        print_json(cpus, indexes, results);
+    }
+    else
+    {
+        print_csv(cpus, indexes, results);
+    }
+
+    return 0;
+}
@@ -0,0 +1,594 @@
+/* Copyright (c) 2015, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures memory latency and bandwidth between every numa node with cpus
+// and every numa node with memory.  For each memory node a buffer is bound
+// to the node with MPOL_BIND, so that it cannot silently be backed by another
+// node, then for each cpu node a thread pinned to one of its cpus
+// chases pointers through the buffer in a random order to measure latency,
+// and 1, 2, 4, ... threads pinned to distinct cores of the node stream
+// through it to measure read and write bandwidth.
+//
+// Next to each latency the kernel's numa distance and the latency relative
+// to the cpu node's local memory, scaled so that local is 10 like the
+// distances, are printed, so the two matrices can be compared directly.
+//
+// Only the cpus the process is allowed to run on are used, so that it can run
+// inside a restricted cpuset.  Numa nodes without any such cpus are skipped.
+//
+// usage: numa_memory [--json] [--size MiB] [--passes N] [--max-threads N]
+
+#include <cpuaff/cpuaff.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+
+namespace
+{
+const std::size_t line_size = 64;
+
+uint64_t now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+// read a sysfs node list such as "0-1,3"
+bool read_node_list(std::set< cpuaff::numa_type > &nodes,
+                    const std::string &path)
+{
+    std::ifstream in(path.c_str());
+    std::string list;
+
+    if (!std::getline(in, list))
+    {
+        return false;
+    }
+
+    std::istringstream ranges(list);
+    std::string range;
+
+    while (std::getline(ranges, range, ','))
+    {
+        int first = 0;
+        int last = 0;
+
+        if (sscanf(range.c_str(), "%d-%d", &first, &last) == 2)
+        {
+            for (int node = first; node <= last; ++node)
+            {
+                nodes.insert(node);
+            }
+        }
+        else if (sscanf(range.c_str(), "%d", &first) == 1)
+        {
+            nodes.insert(first);
+        }
+    }
+
+    return true;
+}
+
+// the distances from a node to every node, as the kernel reports them
+std::vector< int > read_distances(const cpuaff::numa_type &node)
+{
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/distance";
+
+    std::ifstream in(path.str().c_str());
+    std::vector< int > distances;
+    int distance;
+
+    while (in >> distance)
+    {
+        distances.push_back(distance);
+    }
+
+    return distances;
+}
+
+// link the cache lines of the buffer into a single cycle in a random order,
+// so that every load misses and the prefetchers cannot follow
+void build_chase(char *data, std::size_t length)
+{
+    std::size_t count = length / line_size;
+    std::vector< std::size_t > order(count);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        order[i] = i;
+    }
+
+    uint64_t state = (uint64_t(0x9e3779b9) << 32) | 0x7f4a7c15;
+
+    for (std::size_t i = count - 1; i > 0; --i)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        std::swap(order[i], order[state % (i + 1)]);
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        *reinterpret_cast< char ** >(data + order[i] * line_size) =
+            data + order[(i + 1) % count] * line_size;
+    }
+}
+
+// nanoseconds per dependent load
+double chase(char *data, std::size_t steps)
+{
+    char *p = data;
+
+    for (std::size_t i = 0; i < steps / 8; ++i)
+    {
+        p = *reinterpret_cast< char ** >(p);
+    }
+
+    uint64_t start = now();
+
+    for (std::size_t i = 0; i < steps; ++i)
+    {
+        p = *reinterpret_cast< char ** >(p);
+    }
+
+    uint64_t elapsed = now() - start;
+
+    // depend on where the chase ended so that it cannot be optimized away;
+    // the cycle never reaches NULL
+    return (p) ? double(elapsed) / double(steps) : 0;
+}
+
+struct streamer
+{
+    const cpuaff::affinity_manager *manager;
+    cpuaff::cpu cpu;
+    uint64_t *data;
+    std::size_t words;
+    int passes;
+    bool write;
+    pthread_barrier_t *barrier;
+    uint64_t elapsed;
+    uint64_t sum;
+    bool pinned;
+};
+
+void *stream(void *arg)
+{
+    streamer *s = static_cast< streamer * >(arg);
+
+    cpuaff::cpu_set cpus;
+    cpus.insert(s->cpu);
+    s->pinned = s->manager->set_affinity(cpus);
+
+    pthread_barrier_wait(s->barrier);
+    uint64_t start = now();
+    uint64_t sum = 0;
+
+    for (int pass = 0; pass < s->passes; ++pass)
+    {
+        if (s->write)
+        {
+            for (std::size_t i = 0; i < s->words; ++i)
+            {
+                s->data[i] = i;
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < s->words; ++i)
+            {
+                sum += s->data[i];
+            }
+        }
+    }
+
+    s->elapsed = now() - start;
+    s->sum = sum;
+
+    return NULL;
+}
+
+// GB/s moved by threads on the given cpus, each streaming its own slice of
+// the buffer
+bool bandwidth(double &gbps,
+               const cpuaff::affinity_manager &manager,
+               const std::vector< cpuaff::cpu > &cpus,
+               char *data,
+               std::size_t length,
+               int passes,
+               bool write)
+{
+    std::size_t words = length / sizeof(uint64_t) / cpus.size();
+    std::vector< streamer > streamers(cpus.size());
+    std::vector< pthread_t > threads(cpus.size());
+
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, unsigned(cpus.size()));
+
+    std::size_t started = 0;
+
+    for (; started < cpus.size(); ++started)
+    {
+        streamer &s = streamers[started];
+        s.manager = &manager;
+        s.cpu = cpus[started];
+        s.data = reinterpret_cast< uint64_t * >(data) + started * words;
+        s.words = words;
+        s.passes = passes;
+        s.write = write;
+        s.barrier = &barrier;
+        s.elapsed = 0;
+        s.pinned = false;
+
+        if (pthread_create(&threads[started], NULL, stream, &s) != 0)
+        {
+            // the barrier can never be reached
+            std::cerr << "cpuaff: unable to start a thread." << std::endl;
+            exit(-1);
+        }
+    }
+
+    uint64_t elapsed = 0;
+    bool pinned = true;
+
+    for (std::size_t i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        elapsed = std::max(elapsed, streamers[i].elapsed);
+        pinned = pinned && streamers[i].pinned;
+    }
+
+    pthread_barrier_destroy(&barrier);
+
+    double bytes = double(words * sizeof(uint64_t)) * double(cpus.size()) *
+                   double(passes);
+    gbps = bytes / double(std::max(elapsed, uint64_t(1)));
+
+    return pinned;
+}
+
+struct result
+{
+    cpuaff::numa_type cpu_node;
+    cpuaff::numa_type memory_node;
+    int distance;
+    double latency;
+    double relative_latency;
+    std::map< std::size_t, std::pair< double, double > > bandwidth;
+};
+}  // namespace
+#endif
+
+int main(int argc, char *argv[])
+{
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+    bool json = false;
+    std::size_t size = 256;
+    int passes = 4;
+    std::size_t max_threads = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            size = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc)
+        {
+            passes = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc)
+        {
+            max_threads = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--json] [--size MiB] [--passes N]"
+                         " [--max-threads N]"
+                      << std::endl;
+            return -1;
+        }
+    }
+
+    cpuaff::affinity_manager manager;
+
+    if (!manager.has_cpus())
+    {
+        std::cerr << "cpuaff: unable to initialize affinity_manager."
+                  << std::endl;
+        return -1;
+    }
+
+    size = std::max(size, std::size_t(1));
+    passes = std::max(passes, 1);
+
+    std::size_t length = size << 20;
+
+    // nodes with cpus come from the affinity manager, limited to the cpus
+    // this process may run on, and nodes with memory from sysfs, as some
+    // (for instance cxl memory) have no cpus
+    cpuaff::cpu_set allowed;
+
+    if (!manager.get_affinity(allowed))
+    {
+        std::cerr << "cpuaff: unable to get the affinity of this process."
+                  << std::endl;
+        return -1;
+    }
+
+    std::map< cpuaff::numa_type, cpuaff::cpu_set > node_cpus;
+    std::set< cpuaff::numa_type > cpu_nodes;
+    std::set< cpuaff::numa_type > memory_nodes;
+
+    for (cpuaff::cpu_set::iterator i = allowed.begin(); i != allowed.end();
+         ++i)
+    {
+        cpu_nodes.insert(i->numa());
+        node_cpus[i->numa()].insert(*i);
+    }
+
+    if (!read_node_list(memory_nodes,
+                        "/sys/devices/system/node/has_memory") ||
+        memory_nodes.empty())
+    {
+        memory_nodes = cpu_nodes;
+    }
+
+    std::vector< result > results;
+    std::map< cpuaff::numa_type, double > local_latency;
+
+    cpuaff::affinity_stack stack(manager);
+    stack.push_affinity();
+
+    cpuaff::traits::node_allocator_type allocator;
+    cpuaff::page_placement_manager placement;
+
+    std::set< cpuaff::numa_type >::iterator m = memory_nodes.begin();
+    std::set< cpuaff::numa_type >::iterator mend = memory_nodes.end();
+
+    for (; m != mend; ++m)
+    {
+        char *data =
+            static_cast< char * >(allocator.allocate(length, *m, true));
+
+        if (!data)
+        {
+            std::cerr << "cpuaff: unable to allocate " << size
+                      << " MiB on numa node " << *m << "." << std::endl;
+            return -1;
+        }
+
+        // back the chase with huge pages where possible so that it measures
+        // the memory rather than the page walks
+        madvise(data, length, MADV_HUGEPAGE);
+        build_chase(data, length);
+
+        // the binding should make this impossible, but a row measured on
+        // the wrong memory is worse than no row
+        std::size_t misplaced = 0;
+
+        if (placement.get_misplaced_pages(misplaced, data, length, *m) &&
+            misplaced)
+        {
+            std::cerr << "cpuaff: skipping numa node " << *m << ", "
+                      << misplaced << " pages of the buffer are not on it."
+                      << std::endl;
+            allocator.deallocate(data, length);
+            continue;
+        }
+
+        std::set< cpuaff::numa_type >::iterator c = cpu_nodes.begin();
+        std::set< cpuaff::numa_type >::iterator cend = cpu_nodes.end();
+
+        std::size_t first = results.size();
+
+        for (; c != cend; ++c)
+        {
+            const cpuaff::cpu_set &cpus = node_cpus[*c];
+
+            result r;
+            r.cpu_node = *c;
+            r.memory_node = *m;
+
+            std::vector< int > distances = read_distances(*c);
+            r.distance = (std::size_t(*m) < distances.size())
+                             ? distances[*m]
+                             : -1;
+
+            if (!manager.pin(*cpus.begin()))
+            {
+                std::cerr << "cpuaff: unable to pin to " << *cpus.begin()
+                          << "." << std::endl;
+                return -1;
+            }
+
+            r.latency = chase(data, std::min(length / line_size * 2,
+                                             std::size_t(1) << 24));
+
+            if (*c == *m)
+            {
+                local_latency[*c] = r.latency;
+            }
+
+            results.push_back(r);
+        }
+
+        // stream after every cpu node has chased, as writing destroys the
+        // chase
+        for (std::size_t i = first; i < results.size(); ++i)
+        {
+            result &r = results[i];
+            const cpuaff::cpu_set &cpus = node_cpus[r.cpu_node];
+
+            std::size_t limit = cpus.size();
+
+            if (max_threads && max_threads < limit)
+            {
+                limit = max_threads;
+            }
+
+            for (std::size_t threads = 1;; threads *= 2)
+            {
+                threads = std::min(threads, limit);
+
+                // spread the threads over cores before using smt siblings
+                std::vector< cpuaff::cpu > streaming;
+                cpuaff::round_robin_allocator spread(cpus);
+
+                for (std::size_t t = 0; t < threads; ++t)
+                {
+                    streaming.push_back(spread.allocate());
+                }
+
+                double read = 0;
+                double write = 0;
+
+                if (!bandwidth(read, manager, streaming, data, length, passes,
+                               false) ||
+                    !bandwidth(write, manager, streaming, data, length,
+                               passes, true))
+                {
+                    std::cerr << "cpuaff: unable to pin streaming threads "
+                                 "on numa node "
+                              << r.cpu_node << "." << std::endl;
+                    return -1;
+                }
+
+                r.bandwidth[threads] = std::make_pair(read, write);
+
+                if (threads == limit)
+                {
+                    break;
+                }
+            }
+        }
+
+        allocator.deallocate(data, length);
+    }
+
+    stack.pop_affinity();
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        std::map< cpuaff::numa_type, double >::iterator local =
+            local_latency.find(results[i].cpu_node);
+
+        results[i].relative_latency =
+            (local != local_latency.end() && local->second > 0)
+                ? 10 * results[i].latency / local->second
+                : 0;
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+
+    if (json)
+    {
+        std::cout << "{\n  \"size_mib\": " << size << ",\n  \"pairs\": [";
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const result &r = results[i];
+
+            std::cout << ((i) ? ",\n" : "\n") << "    {\"cpu_node\": "
+                      << r.cpu_node << ", \"memory_node\": " << r.memory_node
+                      << ", \"distance\": " << r.distance
+                      << ", \"latency_ns\": " << r.latency
+                      << ", \"relative_latency\": " << r.relative_latency
+                      << ", \"bandwidth\": [";
+
+            std::map< std::size_t, std::pair< double, double > >::
+                const_iterator j = r.bandwidth.begin();
+
+            for (; j != r.bandwidth.end(); ++j)
+            {
+                std::cout << ((j != r.bandwidth.begin()) ? ", " : "")
+                          << "{\"threads\": " << j->first
+                          << ", \"read_gbps\": " << j->second.first
+                          << ", \"write_gbps\": " << j->second.second << "}";
+            }
+
+            std::cout << "]}";
+        }
+
+        std::cout << "\n  ]\n}" << std::endl;
+    }
+    else
+    {
+        std::cout << "cpu_node,memory_node,distance,latency_ns,"
+                     "relative_latency,threads,read_gbps,write_gbps"
+                  << std::endl;
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const result &r = results[i];
+
+            std::map< std::size_t, std::pair< double, double > >::
+                const_iterator j = r.bandwidth.begin();
+
+            for (; j != r.bandwidth.end(); ++j)
+            {
+                std::cout << r.cpu_node << "," << r.memory_node << ","
+                          << r.distance << "," << r.latency << ","
+                          << r.relative_latency << "," << j->first << ","
+                          << j->second.first << "," << j->second.second
+                          << std::endl;
+            }
+        }
+    }
+
+    return 0;
+#else
+    std::cerr << "cpuaff: page placement is not supported on this platform."
+              << std::endl;
+    return -1;
+#endif
+}
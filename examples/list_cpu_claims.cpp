@@ -0,0 +1,104 @@
+/* Copyright (c) 2015, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cpuaff/cpuaff.hpp>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+int main(int argc, char *argv[])
+{
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+    bool reclaim = false;
+    std::string name = "/cpuaff.registry";
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--reclaim") == 0)
+        {
+            reclaim = true;
+        }
+        else
+        {
+            name = argv[i];
+        }
+    }
+
+    cpuaff::affinity_manager manager;
+
+    if (manager.has_cpus())
+    {
+        cpuaff::cpu_registry registry(manager, name);
+
+        if (!registry.is_open())
+        {
+            std::cerr << "cpuaff: unable to open registry " << name << "."
+                      << std::endl;
+            return -1;
+        }
+
+        if (reclaim)
+        {
+            std::cout << "reclaimed " << registry.reclaim() << " cpus"
+                      << std::endl;
+        }
+
+        std::map< cpuaff::cpu, cpuaff::process_id_type > claims;
+        registry.get_claims(claims);
+
+        // claims of processes that have exited count as unclaimed
+        cpuaff::cpu_set unclaimed;
+        registry.get_unclaimed_cpus(unclaimed);
+
+        std::map< cpuaff::cpu, cpuaff::process_id_type >::iterator i =
+            claims.begin();
+        std::map< cpuaff::cpu, cpuaff::process_id_type >::iterator iend =
+            claims.end();
+
+        for (; i != iend; ++i)
+        {
+            std::cout << i->first << " pid " << i->second
+                      << ((unclaimed.find(i->first) != unclaimed.end())
+                              ? " (exited)"
+                              : "")
+                      << std::endl;
+        }
+
+        return 0;
+    }
+
+    std::cerr << "cpuaff: unable to initialize affinity_manager." << std::endl;
+    return -1;
+#else
+    std::cerr << "cpuaff: the cpu registry is not supported on this platform."
+              << std::endl;
+    return -1;
+#endif
+}
@@ -0,0 +1,99 @@
+/* Copyright (c) 2015, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cpuaff/cpuaff.hpp>
+#include <iostream>
+
+int main(int argc, char *argv[])
+{
+#if defined(CPUAFF_PCI_SUPPORTED)
+    cpuaff::affinity_manager manager;
+    cpuaff::pci_device_manager pci_manager;
+
+    if (manager.has_cpus() && pci_manager.has_pci_devices())
+    {
+        cpuaff::irq_manager irq_manager(manager);
+
+        if (!irq_manager.has_irqs())
+        {
+            std::cerr << "cpuaff: unable to load irqs." << std::endl;
+            return -1;
+        }
+
+        cpuaff::pci_device_set devices;
+        pci_manager.get_pci_devices(devices);
+
+        cpuaff::pci_device_set::iterator i = devices.begin();
+        cpuaff::pci_device_set::iterator iend = devices.end();
+
+        for (; i != iend; ++i)
+        {
+            std::set< cpuaff::irq_type > irqs;
+
+            if (irq_manager.get_irqs_by_device(irqs, *i))
+            {
+                std::cout << (*i) << std::endl;
+
+                std::set< cpuaff::irq_type >::iterator j = irqs.begin();
+                std::set< cpuaff::irq_type >::iterator jend = irqs.end();
+
+                for (; j != jend; ++j)
+                {
+                    std::string description;
+                    cpuaff::cpu_set cpus;
+
+                    irq_manager.get_irq_description(description, *j);
+                    irq_manager.get_irq_affinity(cpus, *j);
+
+                    std::cout << "  irq " << (*j) << " (" << description
+                              << ")" << std::endl;
+
+                    cpuaff::cpu_set::iterator k = cpus.begin();
+                    cpuaff::cpu_set::iterator kend = cpus.end();
+
+                    for (; k != kend; ++k)
+                    {
+                        std::cout << "    " << (*k) << std::endl;
+                    }
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    std::cerr << "cpuaff: unable to initialize affinity_manager." << std::endl;
+    return -1;
+#else
+    std::cerr << "cpuaff: PCI mapping not supported on this platform."
+              << std::endl;
+    return -1;
+#endif
+}
@@ -40,7 +40,26 @@ int main(int argc, char *argv[])
     if (manager.has_cpus() && pci_manager.has_pci_devices())
     {
         cpuaff::pci_device_set devices;
-        pci_manager.get_pci_devices(devices);
+
+        if (argc > 1)
+        {
+            // only list the device behind the given interface or block device
+            cpuaff::pci_device device;
+
+            if (!pci_manager.get_pci_device_for_interface(device, argv[1]) &&
+                !pci_manager.get_pci_device_for_block_device(device, argv[1]))
+            {
+                std::cerr << "cpuaff: no pci device found for " << argv[1]
+                          << "." << std::endl;
+                return -1;
+            }
+
+            devices.insert(device);
+        }
+        else
+        {
+            pci_manager.get_pci_devices(devices);
+        }
 
         cpuaff::pci_name_resolver resolver("/usr/share/hwdata/pci.ids");
 
@@ -54,7 +73,7 @@ int main(int argc, char *argv[])
             std::cout << (*i) << " - " << des << std::endl;
 
             cpuaff::cpu_set cpus;
-            manager.get_cpus_by_numa(cpus, i->numa());
+            manager.get_cpus_near_device(cpus, *i);
 
             if (cpus.empty())
             {
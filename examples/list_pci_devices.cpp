@@ -49,8 +49,25 @@ int main(int argc, char *argv[])
         for (; i != iend; ++i)
         {
             cpuaff::pci_device_description des;
-            resolver.get_description(des, i->spec());
-            std::cout << (*i) << " - " << des << std::endl;
+            resolver.get_description(des, i->spec(), i->subsystem());
+            std::cout << (*i) << " - " << des;
+
+            if (i->max_link_width() > 0)
+            {
+                std::cout << " [link: " << i->current_link_speed() << " GT/s x"
+                          << i->current_link_width() << " of "
+                          << i->max_link_speed() << " GT/s x"
+                          << i->max_link_width();
+
+                if (i->is_link_degraded())
+                {
+                    std::cout << ", degraded";
+                }
+
+                std::cout << "]";
+            }
+
+            std::cout << std::endl;
         }
 
         return 0;
@@ -46,6 +46,8 @@ struct basic_traits
         typename LOADER_TRAITS::cpu_loader_vector_type cpu_loader_vector_type;
     typedef typename LOADER_TRAITS::get_affinity_type get_affinity_type;
     typedef typename LOADER_TRAITS::set_affinity_type set_affinity_type;
+    typedef typename LOADER_TRAITS::get_current_cpu_type get_current_cpu_type;
+    typedef typename LOADER_TRAITS::per_cpu_ops_type per_cpu_ops_type;
 
 #ifdef CPUAFF_PCI_SUPPORTED
     typedef typename LOADER_TRAITS::pci_address_type pci_address_type;
@@ -54,6 +56,30 @@ struct basic_traits
     typedef typename LOADER_TRAITS::pci_loader_type pci_loader_type;
     typedef
         typename LOADER_TRAITS::pci_loader_vector_type pci_loader_vector_type;
+    typedef typename LOADER_TRAITS::irq_reader_type irq_reader_type;
+    typedef typename LOADER_TRAITS::pci_address_resolver_type
+        pci_address_resolver_type;
+#endif
+
+#ifdef CPUAFF_PAGE_PLACEMENT_SUPPORTED
+    typedef typename LOADER_TRAITS::get_page_numa_type get_page_numa_type;
+    typedef typename LOADER_TRAITS::set_page_numa_type set_page_numa_type;
+    typedef typename LOADER_TRAITS::set_memory_policy_type
+        set_memory_policy_type;
+    typedef typename LOADER_TRAITS::node_allocator_type node_allocator_type;
+#endif
+
+#ifdef CPUAFF_CPU_REGISTRY_SUPPORTED
+    typedef typename LOADER_TRAITS::shared_cpu_table_type shared_cpu_table_type;
+#endif
+
+#ifdef CPUAFF_THREAD_REGISTRY_SUPPORTED
+    typedef typename LOADER_TRAITS::thread_control_type thread_control_type;
+    typedef typename LOADER_TRAITS::periodic_runner_type periodic_runner_type;
+#endif
+
+#ifdef CPUAFF_CPU_LOAD_SUPPORTED
+    typedef typename LOADER_TRAITS::cpu_times_reader_type cpu_times_reader_type;
 #endif
 
     typedef typename NATIVE_TRAITS::cpu_identifier_type native_cpu_type;
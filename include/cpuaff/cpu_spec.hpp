@@ -31,6 +31,7 @@
 #pragma once
 
 #include "fwd.hpp"
+#include <errno.h>
 #include <iostream>
 #include <sstream>
 #include <stdlib.h>
@@ -82,6 +83,50 @@ class cpu_spec
         return spec;
     }
 
+    /*!
+     * Parse a "socket,core,processing_unit" triple into a cpu_spec.  Unlike
+     * parse(const std::string &) this rejects anything that is not exactly
+     * three comma separated integers: whitespace, a leading '+', and values
+     * that do not fit in 32 bits are errors.
+     *
+     * \param spec [out] the parsed cpu_spec
+     * \param rhs [in] the string to parse
+     * \return true if the string is a valid triple, false otherwise
+     */
+    static inline bool parse(cpu_spec &spec, const std::string &rhs)
+    {
+        int32_t values[3];
+        const char *p = rhs.c_str();
+
+        for (int i = 0; i < 3; ++i)
+        {
+            // strtol would skip whitespace and accept a '+'
+            const char *digits = (*p == '-') ? p + 1 : p;
+
+            if (*digits < '0' || *digits > '9')
+            {
+                return false;
+            }
+
+            char *end;
+            errno = 0;
+            long value = strtol(p, &end, 10);
+
+            if (errno == ERANGE || value < -2147483647L - 1 ||
+                value > 2147483647L || (i < 2 && *end != ',') ||
+                (i == 2 && *end != '\0'))
+            {
+                return false;
+            }
+
+            values[i] = int32_t(value);
+            p = end + 1;
+        }
+
+        spec = cpu_spec(values[0], values[1], values[2]);
+        return true;
+    }
+
     /*!
      * Get the zero based socket identifier for this cpu_spec.
      *
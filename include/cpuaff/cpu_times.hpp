@@ -0,0 +1,126 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace cpuaff
+{
+/*!
+ * Time a cpu spent in each state, in clock ticks (USER_HZ on Linux), either
+ * since boot or between two samples.  Guest time is included in user time
+ * by the kernel and is not reported separately.
+ */
+struct cpu_times
+{
+    uint64_t user;
+    uint64_t nice;
+    uint64_t system;
+    uint64_t idle;
+    uint64_t iowait;
+    uint64_t irq;
+    uint64_t softirq;
+    uint64_t steal;
+
+    inline cpu_times()
+        : user(0)
+        , nice(0)
+        , system(0)
+        , idle(0)
+        , iowait(0)
+        , irq(0)
+        , softirq(0)
+        , steal(0)
+    {
+    }
+
+    /*!
+     * Get the time the cpu was not available to run new work.  Steal time
+     * counts as busy because the hypervisor took the cpu away.
+     */
+    inline uint64_t busy() const
+    {
+        return user + nice + system + irq + softirq + steal;
+    }
+
+    /*!
+     * Get the total time accounted for.
+     */
+    inline uint64_t total() const { return busy() + idle + iowait; }
+
+    /*!
+     * Get the fraction of the time the cpu was busy, between 0 and 1.
+     */
+    inline double utilization() const
+    {
+        uint64_t t = total();
+        return (t != 0) ? double(busy()) / double(t) : 0.0;
+    }
+
+    inline cpu_times &operator+=(const cpu_times &rhs)
+    {
+        user += rhs.user;
+        nice += rhs.nice;
+        system += rhs.system;
+        idle += rhs.idle;
+        iowait += rhs.iowait;
+        irq += rhs.irq;
+        softirq += rhs.softirq;
+        steal += rhs.steal;
+        return *this;
+    }
+
+    /*!
+     * The change from an earlier sample of the same cpu.  Counters that went
+     * backwards (iowait can, and a cpu that went offline restarts at zero)
+     * are taken as zero.
+     */
+    inline cpu_times operator-(const cpu_times &earlier) const
+    {
+        cpu_times delta;
+        delta.user = minus(user, earlier.user);
+        delta.nice = minus(nice, earlier.nice);
+        delta.system = minus(system, earlier.system);
+        delta.idle = minus(idle, earlier.idle);
+        delta.iowait = minus(iowait, earlier.iowait);
+        delta.irq = minus(irq, earlier.irq);
+        delta.softirq = minus(softirq, earlier.softirq);
+        delta.steal = minus(steal, earlier.steal);
+        return delta;
+    }
+
+   private:
+    static inline uint64_t minus(const uint64_t &lhs, const uint64_t &rhs)
+    {
+        return (lhs > rhs) ? lhs - rhs : 0;
+    }
+};
+}  // namespace cpuaff
@@ -33,15 +33,27 @@
 #include "config.hpp"
 
 #include "cpu_spec.hpp"
+#include "cpu_times.hpp"
 #include "impl/basic_affinity_manager.hpp"
 #include "impl/basic_affinity_stack.hpp"
 #include "impl/basic_cpu.hpp"
 #include "impl/basic_cpu_set.hpp"
+#include "impl/basic_cpu_set_parser.hpp"
+#include "impl/basic_lease_manager.hpp"
 #include "impl/basic_native_cpu_mapper.hpp"
+#include "impl/basic_per_cpu.hpp"
+#include "impl/basic_per_cpu_counter.hpp"
+#include "impl/basic_per_cpu_freelist.hpp"
+#include "impl/basic_placement_engine.hpp"
+#include "impl/basic_role_manager.hpp"
 #include "impl/basic_round_robin_allocator.hpp"
+#include "parse_error.hpp"
+#include "placement_policy.hpp"
+#include "sched_stats.hpp"
 
 #if defined(CPUAFF_PCI_SUPPORTED)
 
+#include "impl/basic_irq_manager.hpp"
 #include "impl/basic_pci_device.hpp"
 #include "impl/basic_pci_device_manager.hpp"
 #include "impl/basic_pci_device_set.hpp"
@@ -51,6 +63,33 @@
 
 #endif
 
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+
+#include "impl/basic_page_placement_manager.hpp"
+
+#endif
+
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+
+#include "impl/basic_cpu_registry.hpp"
+
+#endif
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+
+#include "impl/basic_cpu_load_sampler.hpp"
+
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+
+#include "impl/basic_drift_auditor.hpp"
+#include "impl/basic_rebalancer.hpp"
+#include "impl/basic_sched_sampler.hpp"
+#include "impl/basic_thread_registry.hpp"
+
+#endif
+
 /*!
  * Namespace for all cpuaff functionality
  */
@@ -109,6 +148,90 @@ typedef std::set< cpu_spec > cpu_spec_set;
  */
 typedef impl::basic_round_robin_allocator< traits > round_robin_allocator;
 
+/*!
+ * placement_engine orders a set of cpus according to a placement_policy
+ * (compact, scatter, numa_balanced, or spread_by a topology level) so that
+ * threads can be placed deterministically.
+ */
+typedef impl::basic_placement_engine< traits > placement_engine;
+
+/*!
+ * cpu_set_parser turns placement expressions such as "numa:0/core:2-7/pu:0",
+ * "0-3,8", or "{0:4}:2:8" into cpu sets resolved against an
+ * affinity_manager.
+ */
+typedef impl::basic_cpu_set_parser< traits > cpu_set_parser;
+
+/*!
+ * per_cpu holds one value of type T for every cpu, each on its own cache
+ * line and allocated on its cpu's numa node.  local() returns the value of
+ * the cpu the calling thread is running on, and the values can be combined
+ * across all cpus or by numa node, socket, or last level cache.
+ */
+template < typename T >
+class per_cpu : public impl::basic_per_cpu< traits, T >
+{
+   public:
+    inline per_cpu(const affinity_manager &affinity_manager,
+                   const T &initial = T())
+        : impl::basic_per_cpu< traits, T >(affinity_manager, initial)
+    {
+    }
+};
+
+/*!
+ * per_cpu_counter is a counter with one word per cpu.  Threads add to the
+ * word of the cpu they are running on, with restartable sequences where the
+ * platform supports them, so increments do not contend.
+ */
+typedef impl::basic_per_cpu_counter< traits > per_cpu_counter;
+
+/*!
+ * per_cpu_freelist_node is the base of the entries of a per_cpu_freelist.
+ */
+typedef impl::per_cpu_freelist_node per_cpu_freelist_node;
+
+/*!
+ * per_cpu_freelist is an intrusive stack per cpu.  Threads push to and pop
+ * from the stack of the cpu they are running on, with restartable sequences
+ * where the platform supports them.  T must derive from
+ * per_cpu_freelist_node.
+ */
+template < typename T >
+class per_cpu_freelist : public impl::basic_per_cpu_freelist< traits, T >
+{
+   public:
+    inline per_cpu_freelist(const affinity_manager &affinity_manager)
+        : impl::basic_per_cpu_freelist< traits, T >(affinity_manager)
+    {
+    }
+};
+
+/*!
+ * lease_manager hands out cpus for exclusive use so that independent
+ * subsystems never pin their threads to the same cpu.  Whatever is not leased
+ * remains available to shared pools.
+ */
+typedef impl::basic_lease_manager< traits > lease_manager;
+
+/*!
+ * A set of cpus leased from a lease_manager.  The cpus are returned when the
+ * lease is released or destroyed.
+ */
+typedef impl::basic_cpu_lease< traits > cpu_lease;
+
+/*!
+ * role_manager resolves named thread roles (cpus, exclusivity, smt usage, and
+ * memory policy) declared in a configuration file or the CPUAFF_PLACEMENT
+ * environment variable so that threads can call pin_role("md_feed").
+ */
+typedef impl::basic_role_manager< traits > role_manager;
+
+/*!
+ * A named thread role resolved by a role_manager.
+ */
+typedef impl::basic_role< traits > role;
+
 #if defined(CPUAFF_PCI_SUPPORTED)
 /*!
  * basic_pci_device_manager is a collection of all the pci devices on the
@@ -128,5 +251,88 @@ typedef impl::basic_pci_device< traits > pci_device;
  */
 typedef impl::basic_pci_device_set< traits > pci_device_set;
 
+/*!
+ * irq_manager is a collection of all the interrupts on the system.  It maps
+ * interrupts to pci devices and can steer a device's interrupts onto the cpus
+ * local to it.
+ */
+typedef impl::basic_irq_manager< traits > irq_manager;
+
+#endif
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+/*!
+ * page_placement_manager reports which numa nodes the pages of a buffer
+ * reside on and can migrate them to a numa node or spread them over a set of
+ * numa nodes.
+ */
+typedef impl::basic_page_placement_manager< traits > page_placement_manager;
+
+#endif
+
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+/*!
+ * cpu_registry lets cooperating processes on a machine claim cpus through a
+ * shared memory table so that they do not pin their threads on top of each
+ * other.  Claims of processes that have exited can be reclaimed.
+ */
+typedef impl::basic_cpu_registry< traits > cpu_registry;
+
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+/*!
+ * thread_registry names, pins, and tracks the threads of this process by
+ * role, and reports where each one is actually running compared to where it
+ * was meant to run.
+ */
+typedef impl::basic_thread_registry< traits > thread_registry;
+
+/*!
+ * A snapshot of a registered thread's intended cpus, actual cpus, and last
+ * cpu.
+ */
+typedef impl::basic_thread_placement< traits > thread_placement;
+
+/*!
+ * drift_auditor periodically checks the threads of a thread_registry and
+ * counts (and reports to a drift_listener) threads whose affinity was changed
+ * from outside of cpuaff or that ran outside of their intended cpus.
+ */
+typedef impl::basic_drift_auditor< traits > drift_auditor;
+
+/*!
+ * The interface for receiving drift_auditor events.
+ */
+typedef impl::basic_drift_listener< traits > drift_listener;
+
+/*!
+ * sched_sampler samples the scheduler counters (run time, run queue wait,
+ * context switches, and migrations) of the threads of a thread_registry and
+ * reports the deltas between samples by thread, cpu, and role.
+ */
+typedef impl::basic_sched_sampler< traits > sched_sampler;
+
+#endif
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+/*!
+ * cpu_load_sampler samples how busy every cpu is from /proc/stat, rolls the
+ * deltas up by core, socket, and numa node, and picks the least loaded cpu
+ * of a set.
+ */
+typedef impl::basic_cpu_load_sampler< traits > cpu_load_sampler;
+
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED) && \
+    defined(CPUAFF_CPU_LOAD_SUPPORTED)
+/*!
+ * rebalancer steers groups of floating threads of a thread_registry away
+ * from hot cpus, moving them between last level cache domains of a numa
+ * node when contention persists, with hysteresis so that they settle.
+ */
+typedef impl::basic_rebalancer< traits > rebalancer;
+
 #endif
 }
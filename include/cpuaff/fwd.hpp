@@ -36,6 +36,8 @@
 namespace cpuaff
 {
 class cpu_spec;
+class placement_policy;
+class parse_error;
 
 namespace impl
 {
@@ -53,12 +55,45 @@ class basic_affinity_stack;
 
 template < typename TRAITS >
 class basic_affinity_stack;
+
+template < typename TRAITS >
+class basic_placement_engine;
+
+template < typename TRAITS >
+class basic_cpu_lease;
+
+template < typename TRAITS >
+class basic_lease_manager;
+
+template < typename TRAITS >
+class basic_cpu_set_parser;
+
+template < typename TRAITS >
+class basic_role;
+
+template < typename TRAITS >
+class basic_role_manager;
+
+template < typename TRAITS, typename T >
+class basic_per_cpu;
+
+template < typename TRAITS >
+class basic_per_cpu_words;
+
+template < typename TRAITS >
+class basic_per_cpu_counter;
+
+template < typename TRAITS, typename T >
+class basic_per_cpu_freelist;
+
+struct per_cpu_freelist_node;
 }  // namespace impl
 
 typedef int32_t socket_type;
 typedef int32_t core_type;
 typedef int32_t processing_unit_type;
 typedef int32_t numa_type;
+typedef int32_t llc_type;
 
 #if defined(CPUAFF_PCI_SUPPORTED)
 
@@ -73,10 +108,76 @@ class basic_pci_device;
 
 template < typename TRAITS >
 class basic_pci_device_set;
+
+template < typename TRAITS >
+class basic_irq_manager;
 }  // namespace impl
 
 typedef int32_t pci_vendor_id_type;
 typedef int32_t pci_device_id_type;
+typedef int32_t pci_class_type;
+typedef double pci_link_speed_type;
+typedef int32_t pci_link_width_type;
+typedef int32_t irq_type;
+
+#endif
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+
+namespace impl
+{
+template < typename TRAITS >
+class basic_page_placement_manager;
+}  // namespace impl
+
+#endif
+
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+
+namespace impl
+{
+template < typename TRAITS >
+class basic_cpu_registry;
+}  // namespace impl
+
+typedef int32_t process_id_type;
+
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+
+namespace impl
+{
+template < typename TRAITS >
+class basic_thread_placement;
+
+template < typename TRAITS >
+class basic_thread_registry;
+
+template < typename TRAITS >
+class basic_drift_listener;
+
+template < typename TRAITS >
+class basic_drift_auditor;
+
+template < typename TRAITS >
+class basic_sched_sampler;
+}  // namespace impl
+
+typedef int32_t thread_id_type;
+
+#endif
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+
+namespace impl
+{
+template < typename TRAITS >
+class basic_cpu_load_sampler;
+
+template < typename TRAITS >
+class basic_rebalancer;
+}  // namespace impl
 
 #endif
 }  // namespace cpuaff
@@ -0,0 +1,187 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * Minimal atomic operations on plain integers and pointers.  cpuaff still
+ * builds as C++98, so these wrap the compiler builtins rather than
+ * std::atomic.  The __atomic builtins are used where available (gcc 4.7 and
+ * later, clang) and the older __sync builtins otherwise.
+ */
+namespace atomic
+{
+#if defined(__ATOMIC_SEQ_CST)
+
+template < typename T >
+inline T load(const volatile T &value)
+{
+    return __atomic_load_n(&value, __ATOMIC_ACQUIRE);
+}
+
+template < typename T >
+inline void store(volatile T &value, const T &desired)
+{
+    __atomic_store_n(&value, desired, __ATOMIC_RELEASE);
+}
+
+template < typename T >
+inline T fetch_add(volatile T &value, const T &delta)
+{
+    return __atomic_fetch_add(&value, delta, __ATOMIC_RELAXED);
+}
+
+template < typename T >
+inline bool compare_exchange(volatile T &value,
+                             const T &expected,
+                             const T &desired)
+{
+    T e = expected;
+    return __atomic_compare_exchange_n(&value, &e, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+#else
+
+template < typename T >
+inline T load(const volatile T &value)
+{
+    T retval = value;
+    __sync_synchronize();
+    return retval;
+}
+
+template < typename T >
+inline void store(volatile T &value, const T &desired)
+{
+    __sync_synchronize();
+    value = desired;
+}
+
+template < typename T >
+inline T fetch_add(volatile T &value, const T &delta)
+{
+    return __sync_fetch_and_add(&value, delta);
+}
+
+template < typename T >
+inline bool compare_exchange(volatile T &value,
+                             const T &expected,
+                             const T &desired)
+{
+    return __sync_bool_compare_and_swap(&value, expected, desired);
+}
+
+#endif
+
+/*!
+ * Compare and swap two adjacent pointer sized words as one, for instance a
+ * pointer and a generation counter that protects it from ABA.  The pair must
+ * be aligned to twice the size of a pointer.
+ *
+ * \return true if both words held the expected values and were replaced,
+ *         false otherwise.
+ */
+#if defined(__x86_64__)
+
+#define CPUAFF_ATOMIC_PAIR_SUPPORTED
+
+inline bool compare_exchange_pair(volatile intptr_t *pair,
+                                  intptr_t expected0,
+                                  intptr_t expected1,
+                                  intptr_t desired0,
+                                  intptr_t desired1)
+{
+    struct words
+    {
+        intptr_t value[2];
+    };
+
+    // cmpxchg16b is used directly because the builtins only inline it when
+    // building with -mcx16
+    unsigned char swapped;
+    __asm__ __volatile__("lock; cmpxchg16b %1\n\tsete %0"
+                         : "=q"(swapped),
+                           "+m"(*reinterpret_cast< volatile words * >(pair)),
+                           "+a"(expected0), "+d"(expected1)
+                         : "b"(desired0), "c"(desired1)
+                         : "memory", "cc");
+    return swapped != 0;
+}
+
+#elif (defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8) && \
+       !defined(__LP64__) && !defined(_WIN64))
+
+#define CPUAFF_ATOMIC_PAIR_SUPPORTED
+
+inline bool compare_exchange_pair(volatile intptr_t *pair,
+                                  intptr_t expected0,
+                                  intptr_t expected1,
+                                  intptr_t desired0,
+                                  intptr_t desired1)
+{
+    union words
+    {
+        intptr_t value[2];
+        uint64_t both;
+    };
+
+    words expected;
+    words desired;
+    expected.value[0] = expected0;
+    expected.value[1] = expected1;
+    desired.value[0] = desired0;
+    desired.value[1] = desired1;
+
+    return __sync_bool_compare_and_swap(
+        reinterpret_cast< volatile uint64_t * >(pair), expected.both,
+        desired.both);
+}
+
+#endif
+
+/*!
+ * Hint to the processor that the caller is spinning.
+ */
+inline void pause()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+}  // namespace atomic
+}  // namespace impl
+}  // namespace cpuaff
@@ -33,8 +33,14 @@
 #include "../config.hpp"
 #include "basic_cpu.hpp"
 #include "basic_cpu_set.hpp"
+#include <algorithm>
 #include <map>
 #include <set>
+#include <vector>
+
+#if defined(CPUAFF_PCI_SUPPORTED)
+#include "basic_pci_device.hpp"
+#endif
 
 namespace cpuaff
 {
@@ -57,6 +63,7 @@ class basic_affinity_manager
     typedef typename TRAITS::cpu_loader_vector_type cpu_loader_vector_type;
     typedef typename TRAITS::get_affinity_type get_affinity_type;
     typedef typename TRAITS::set_affinity_type set_affinity_type;
+    typedef typename TRAITS::get_current_cpu_type get_current_cpu_type;
     typedef typename TRAITS::native_cpu_type native_cpu_type;
     typedef typename TRAITS::native_cpu_wrapper_type native_cpu_wrapper_type;
     typedef typename TRAITS::native_get_affinity_type native_get_affinity_type;
@@ -64,6 +71,10 @@ class basic_affinity_manager
     typedef basic_cpu< TRAITS > cpu_type;
     typedef basic_cpu_set< TRAITS > cpu_set_type;
 
+#if defined(CPUAFF_PCI_SUPPORTED)
+    typedef basic_pci_device< TRAITS > pci_device_type;
+#endif
+
    public:
     /*!
      * Construct an uninitialized basic_affinity_manager.
@@ -162,6 +173,33 @@ class basic_affinity_manager
         return false;
     }
 
+    /*!
+     * Get the numeric index of a cpu.  This is the inverse of
+     * get_cpu_from_index().  Indexes follow the cpu topology, so every
+     * process on a machine agrees on them.
+     *
+     * \param i [out] the numeric index
+     * \param cpu [in] the cpu
+     * \return true if the cpu is found, false otherwise.
+     */
+    inline bool get_index_from_cpu(int32_t &i, const cpu_type &cpu) const
+    {
+        if (has_cpus())
+        {
+            typename std::vector< cpu_type >::const_iterator j =
+                std::lower_bound(cpu_by_index_.begin(), cpu_by_index_.end(),
+                                 cpu);
+
+            if (j != cpu_by_index_.end() && *j == cpu)
+            {
+                i = int32_t(j - cpu_by_index_.begin());
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     /*!
      * Get all the cpus.
      *
@@ -206,6 +244,31 @@ class basic_affinity_manager
         return !cpus.empty();
     }
 
+    /*!
+     * Get all the cpus that share a last level cache.
+     *
+     * \param cpus [out] the cpus sharing the given last level cache
+     * \param llc [in] the zero based last level cache identifier
+     * \return true if cpus are found, false otherwise
+     */
+    inline bool get_cpus_by_llc(cpu_set_type &cpus, const llc_type &llc) const
+    {
+        cpus.clear();
+
+        if (has_cpus())
+        {
+            typename std::map< llc_type, cpu_set_type >::const_iterator i =
+                cpus_by_llc_.find(llc);
+
+            if (i != cpus_by_llc_.end())
+            {
+                cpus = i->second;
+            }
+        }
+
+        return !cpus.empty();
+    }
+
     /*!
      * Get all the cpus for the given socket and core.
      *
@@ -317,6 +380,48 @@ class basic_affinity_manager
         return !cpus.empty();
     }
 
+#if defined(CPUAFF_PCI_SUPPORTED)
+    /*!
+     * Get the cpus local to the given pci device.  The device's local cpu
+     * list is used if the platform reports one, otherwise the cpus on the
+     * device's numa node are returned.
+     *
+     * \param cpus [out] the cpus local to the device
+     * \param device [in] the pci device
+     * \return true if cpus are found, false otherwise.
+     */
+    inline bool get_cpus_near_device(cpu_set_type &cpus,
+                                     const pci_device_type &device) const
+    {
+        cpus.clear();
+
+        if (has_cpus())
+        {
+            typename std::set< cpu_identifier_wrapper_type >::const_iterator i =
+                device.local_cpus().begin();
+            typename std::set< cpu_identifier_wrapper_type >::const_iterator
+                iend = device.local_cpus().end();
+
+            for (; i != iend; ++i)
+            {
+                cpu_type cpu;
+
+                if (get_cpu_from_id(cpu, *i))
+                {
+                    cpus.insert(cpu);
+                }
+            }
+
+            if (cpus.empty())
+            {
+                get_cpus_by_numa(cpus, device.numa());
+            }
+        }
+
+        return !cpus.empty();
+    }
+#endif
+
     /*!
      * Get the affinity of the calling thread
      *
@@ -348,6 +453,81 @@ class basic_affinity_manager
         return false;
     }
 
+    /*!
+     * Get the numeric index of the cpu the calling thread is running on.
+     * This does not allocate or take locks; the native id is mapped to the
+     * index through a flat table, so it is cheap enough to call on every
+     * access to per cpu data.  Unless the thread is pinned it may have moved
+     * by the time the index is used.
+     *
+     * \param i [out] the numeric index of the current cpu
+     * \return true if the current cpu could be determined, false otherwise.
+     */
+    inline bool get_current_cpu_index(int32_t &i) const
+    {
+        cpu_identifier_type id;
+        return get_current_cpu_type()(id) && get_index_from_id(i, id);
+    }
+
+    /*!
+     * Get the numeric index of the cpu with the given identifier.  Like
+     * get_current_cpu_index() this is a lookup in a flat table.
+     *
+     * \param i [out] the numeric index
+     * \param id [in] the cpu identifier
+     * \return true if the cpu is found, false otherwise.
+     */
+    inline bool get_index_from_id(int32_t &i,
+                                  const cpu_identifier_type &id) const
+    {
+        if (id >= 0 && std::size_t(id) < index_by_id_.size() &&
+            index_by_id_[id] >= 0)
+        {
+            i = index_by_id_[id];
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the cpu the calling thread is running on, as opposed to the cpus
+     * it is allowed to run on, which get_affinity() reports.
+     *
+     * \param cpu [out] the current cpu
+     * \return true if the current cpu could be determined, false otherwise.
+     */
+    inline bool get_current_cpu(cpu_type &cpu) const
+    {
+        int32_t i;
+
+        if (get_current_cpu_index(i))
+        {
+            cpu = cpu_by_index_[i];
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the cpu the calling thread is running on.
+     *
+     * \return the current cpu, or a default constructed cpu if it could not
+     * be determined.
+     */
+    inline cpu_type current_cpu() const
+    {
+        int32_t i;
+
+        if (get_current_cpu_index(i))
+        {
+            return cpu_by_index_[i];
+        }
+
+        return cpu_type();
+    }
+
     /*!
      * Set the affinity of the calling thread.
      *
@@ -402,11 +582,17 @@ class basic_affinity_manager
 
         for (; i != iend; ++i)
         {
-            cpu_type cpu(i->spec, i->id, i->numa);
+            cpu_type cpu(i->spec, i->id, i->numa, i->llc);
             cpus_.insert(cpu);
             cpu_by_id_[i->id] = cpu;
             cpu_by_spec_[i->spec] = cpu;
             cpus_by_numa_[i->numa].insert(cpu);
+
+            if (i->llc >= 0)
+            {
+                cpus_by_llc_[i->llc].insert(cpu);
+            }
+
             cpus_by_socket_[i->spec.socket()].insert(cpu);
             cpus_by_core_[i->spec.core()].insert(cpu);
             cpus_by_socket_and_core_[std::make_pair(i->spec.socket(),
@@ -421,6 +607,15 @@ class basic_affinity_manager
         for (; j != jend; ++j)
         {
             cpu_by_index_.push_back(*j);
+
+            std::size_t id = std::size_t(j->id().get());
+
+            if (id >= index_by_id_.size())
+            {
+                index_by_id_.resize(id + 1, -1);
+            }
+
+            index_by_id_[id] = int32_t(cpu_by_index_.size() - 1);
         }
 
         return retval;
@@ -430,9 +625,11 @@ class basic_affinity_manager
     cpu_set_type cpus_;
     std::vector< cpu_type > cpu_by_index_;
     std::map< cpu_identifier_wrapper_type, cpu_type > cpu_by_id_;
+    std::vector< int32_t > index_by_id_;
 
     std::map< cpu_spec, cpu_type > cpu_by_spec_;
     std::map< numa_type, cpu_set_type > cpus_by_numa_;
+    std::map< llc_type, cpu_set_type > cpus_by_llc_;
     std::map< socket_type, cpu_set_type > cpus_by_socket_;
     std::map< core_type, cpu_set_type > cpus_by_core_;
     std::map< std::pair< socket_type, core_type >, cpu_set_type >
@@ -56,19 +56,23 @@ class basic_cpu
     /*!
      * Constructs a basic_cpu with invalid values for all member variables
      */
-    inline basic_cpu() {}
+    inline basic_cpu() : llc_(-1) {}
 
     /*!
-     * Constructs a basic_cpu with the given cpu_spec, id, and numa.
+     * Constructs a basic_cpu with the given cpu_spec, id, numa, and last
+     * level cache.
      *
      * \param spec the cpu_spec (socket, core, processing unit) for this cpu
      * \param id the native identifier for this cpu
      * \param the numa node identifier for this cpu
+     * \param llc the last level cache identifier for this cpu, or -1 if it
+     *        is not known
      */
     inline basic_cpu(const cpu_spec &spec,
                      const cpu_identifier_wrapper_type &id,
-                     const numa_type &numa)
-        : spec_(spec), id_(id), numa_(numa)
+                     const numa_type &numa,
+                     const llc_type &llc = -1)
+        : spec_(spec), id_(id), numa_(numa), llc_(llc)
     {
     }
 
@@ -80,6 +84,14 @@ class basic_cpu
      */
     const inline numa_type &numa() const { return numa_; }
 
+    /*!
+     * Get the zero based identifier of the last level cache this cpu shares
+     * with its neighbours, or -1 if it is not known.
+     *
+     * \return the zero based last level cache identifier for this cpu
+     */
+    const inline llc_type &llc() const { return llc_; }
+
     /*!
      * Get the zero based socket identifier for this cpu.
      *
@@ -159,6 +171,7 @@ class basic_cpu
     cpu_spec spec_;
     cpu_identifier_wrapper_type id_;
     numa_type numa_;
+    llc_type llc_;
 };
 }  // namespace impl
 }  // namespace cpuaff
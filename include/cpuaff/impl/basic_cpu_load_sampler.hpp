@@ -0,0 +1,333 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+
+#include "../config.hpp"
+#include "../cpu_times.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_cpu_load_sampler samples how busy every cpu is and reports the
+ * change in cpu times between the last two samples for each cpu and rolled
+ * up by core, socket, and numa node.  It can then pick the least loaded cpu
+ * of a set, for instance of a numa node, instead of rotating blindly.
+ *
+ * Samples are kept in arrays indexed by the affinity manager's cpu index, so
+ * sampling does not allocate once the first sample has been taken.
+ */
+template < typename TRAITS >
+class basic_cpu_load_sampler
+{
+   public:
+    typedef typename TRAITS::cpu_times_reader_type cpu_times_reader_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+
+   public:
+    /*!
+     * Construct a basic_cpu_load_sampler.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     * \param proc_root where procfs is mounted
+     */
+    inline basic_cpu_load_sampler(const affinity_manager_type &affinity_manager,
+                                  const std::string &proc_root = "/proc")
+        : affinity_manager_(affinity_manager), reader_(proc_root), samples_(0)
+    {
+        cpu_set_type cpus;
+        affinity_manager_.get_cpus(cpus);
+        previous_.resize(cpus.size());
+        deltas_.resize(cpus.size());
+        seen_.resize(cpus.size(), 0);
+        delta_at_.resize(cpus.size(), 0);
+    }
+
+    /*!
+     * Sample every cpu and replace the deltas with the change since the
+     * previous sample.  The first sample only records a baseline.
+     *
+     * \return true if the cpu times could be read, false otherwise.
+     */
+    inline bool sample()
+    {
+        if (!reader_.read(raw_))
+        {
+            return false;
+        }
+
+        ++samples_;
+
+        typename raw_vector_type::const_iterator i = raw_.begin();
+        typename raw_vector_type::const_iterator iend = raw_.end();
+
+        for (; i != iend; ++i)
+        {
+            cpu_type cpu;
+            int32_t index;
+
+            if (affinity_manager_.get_cpu_from_id(cpu, i->first) &&
+                affinity_manager_.get_index_from_cpu(index, cpu))
+            {
+                // a cpu that missed a sample (it was offline) starts over
+                // with a new baseline
+                if (seen_[index] != 0 && seen_[index] == samples_ - 1)
+                {
+                    deltas_[index] = i->second - previous_[index];
+                    delta_at_[index] = samples_;
+                }
+
+                previous_[index] = i->second;
+                seen_[index] = samples_;
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * Get the change in a cpu's times between the last two samples.
+     *
+     * \param times [out] the change
+     * \param cpu [in] the cpu
+     * \return true if the cpu has a delta, false otherwise.
+     */
+    inline bool get_delta(cpu_times &times, const cpu_type &cpu) const
+    {
+        int32_t index;
+
+        if (affinity_manager_.get_index_from_cpu(index, cpu) &&
+            has_delta(index))
+        {
+            times = deltas_[index];
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the change in times between the last two samples for every cpu.
+     *
+     * \param deltas [out] the changes by cpu
+     * \return true if any cpu has a delta, false otherwise.
+     */
+    inline bool get_deltas(std::map< cpu_type, cpu_times > &deltas) const
+    {
+        deltas.clear();
+
+        for (std::size_t i = 0; i < delta_at_.size(); ++i)
+        {
+            cpu_type cpu;
+
+            if (has_delta(int32_t(i)) &&
+                affinity_manager_.get_cpu_from_index(cpu, int32_t(i)))
+            {
+                deltas[cpu] = deltas_[i];
+            }
+        }
+
+        return !deltas.empty();
+    }
+
+    /*!
+     * Get the change in times between the last two samples summed by numa
+     * node.
+     *
+     * \param deltas [out] the changes by numa node
+     * \return true if any cpu has a delta, false otherwise.
+     */
+    inline bool get_deltas_by_numa(
+        std::map< numa_type, cpu_times > &deltas) const
+    {
+        deltas.clear();
+
+        for (std::size_t i = 0; i < delta_at_.size(); ++i)
+        {
+            cpu_type cpu;
+
+            if (has_delta(int32_t(i)) &&
+                affinity_manager_.get_cpu_from_index(cpu, int32_t(i)))
+            {
+                deltas[cpu.numa()] += deltas_[i];
+            }
+        }
+
+        return !deltas.empty();
+    }
+
+    /*!
+     * Get the change in times between the last two samples summed by socket.
+     *
+     * \param deltas [out] the changes by socket
+     * \return true if any cpu has a delta, false otherwise.
+     */
+    inline bool get_deltas_by_socket(
+        std::map< socket_type, cpu_times > &deltas) const
+    {
+        deltas.clear();
+
+        for (std::size_t i = 0; i < delta_at_.size(); ++i)
+        {
+            cpu_type cpu;
+
+            if (has_delta(int32_t(i)) &&
+                affinity_manager_.get_cpu_from_index(cpu, int32_t(i)))
+            {
+                deltas[cpu.socket()] += deltas_[i];
+            }
+        }
+
+        return !deltas.empty();
+    }
+
+    /*!
+     * Get the change in times between the last two samples summed by core.
+     * Cores are keyed by socket and core since core identifiers are zero
+     * based per socket.
+     *
+     * \param deltas [out] the changes by socket and core
+     * \return true if any cpu has a delta, false otherwise.
+     */
+    inline bool get_deltas_by_core(
+        std::map< std::pair< socket_type, core_type >, cpu_times > &deltas)
+        const
+    {
+        deltas.clear();
+
+        for (std::size_t i = 0; i < delta_at_.size(); ++i)
+        {
+            cpu_type cpu;
+
+            if (has_delta(int32_t(i)) &&
+                affinity_manager_.get_cpu_from_index(cpu, int32_t(i)))
+            {
+                deltas[std::make_pair(cpu.socket(), cpu.core())] +=
+                    deltas_[i];
+            }
+        }
+
+        return !deltas.empty();
+    }
+
+    /*!
+     * Get the cpu of a set that was least busy between the last two samples.
+     * Ties go to the cpu with the lowest index.
+     *
+     * \param cpu [out] the least loaded cpu
+     * \param cpus [in] the cpus to choose from
+     * \return true if any of the cpus has a delta, false otherwise.
+     */
+    inline bool get_least_loaded_cpu(cpu_type &cpu,
+                                     const cpu_set_type &cpus) const
+    {
+        bool found = false;
+        double lowest = 0.0;
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            int32_t index;
+
+            if (affinity_manager_.get_index_from_cpu(index, *i) &&
+                has_delta(index))
+            {
+                double utilization = deltas_[index].utilization();
+
+                if (!found || utilization < lowest)
+                {
+                    cpu = *i;
+                    lowest = utilization;
+                    found = true;
+                }
+            }
+        }
+
+        return found;
+    }
+
+    /*!
+     * Get the cpu of a numa node that was least busy between the last two
+     * samples.
+     *
+     * \param cpu [out] the least loaded cpu
+     * \param numa [in] the numa node
+     * \return true if any cpu of the node has a delta, false otherwise.
+     */
+    inline bool get_least_loaded_cpu_by_numa(cpu_type &cpu,
+                                             const numa_type &numa) const
+    {
+        cpu_set_type cpus;
+        return affinity_manager_.get_cpus_by_numa(cpus, numa) &&
+               get_least_loaded_cpu(cpu, cpus);
+    }
+
+   private:
+    basic_cpu_load_sampler(const basic_cpu_load_sampler &);
+    basic_cpu_load_sampler &operator=(const basic_cpu_load_sampler &);
+
+    typedef typename cpu_times_reader_type::cpu_times_vector_type
+        raw_vector_type;
+
+    inline bool has_delta(const int32_t &index) const
+    {
+        return samples_ != 0 && delta_at_[index] == samples_;
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    cpu_times_reader_type reader_;
+    raw_vector_type raw_;
+    std::vector< cpu_times > previous_;
+    std::vector< cpu_times > deltas_;
+    std::vector< uint64_t > seen_;
+    std::vector< uint64_t > delta_at_;
+    uint64_t samples_;
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
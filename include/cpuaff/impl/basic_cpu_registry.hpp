@@ -0,0 +1,326 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+
+#include "../config.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include <map>
+#include <string>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_cpu_registry lets cooperating processes on one machine claim cpus so
+ * that they do not pin their threads on top of each other.  Claims live in a
+ * shared memory table keyed by the affinity manager's cpu index and are
+ * taken and given back atomically.  A claim belongs to the process that made
+ * it and outlives the registry object; it is dropped when it is released or
+ * when the owning process exits and another process reclaims it.  Owners
+ * are recorded by pid, so a claim whose owner exited is kept while its pid
+ * is in use by another process.
+ */
+template < typename TRAITS >
+class basic_cpu_registry
+{
+   public:
+    typedef typename TRAITS::shared_cpu_table_type shared_cpu_table_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+
+   public:
+    /*!
+     * Construct a basic_cpu_registry and open (creating if needed) the shared
+     * registry with the given name.  Every process that wants to cooperate
+     * must use the same name.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     * \param name the name of the shared memory object
+     * \param mode the permissions of the shared memory object if it is
+     *        created; the default only lets processes of the same user
+     *        cooperate
+     */
+    inline basic_cpu_registry(const affinity_manager_type &affinity_manager,
+                              const std::string &name = "/cpuaff.registry",
+                              const int mode = 0600)
+        : affinity_manager_(affinity_manager), name_(name)
+    {
+        cpu_set_type cpus;
+        affinity_manager_.get_cpus(cpus);
+        table_.open(name_, cpus.size(), mode);
+    }
+
+    /*!
+     * Check if the shared registry was opened.
+     *
+     * \return true if the registry is usable, false otherwise.
+     */
+    inline bool is_open() const { return table_.is_open(); }
+
+    /*!
+     * Get the name of the shared registry.
+     *
+     * \return the name of the shared memory object
+     */
+    inline const std::string &name() const { return name_; }
+
+    /*!
+     * Claim a cpu for this process.  Claiming a cpu this process already
+     * holds succeeds.
+     *
+     * \param cpu [in] the cpu
+     * \return true if this process now holds the cpu, false if another live
+     *         process does.
+     */
+    inline bool claim(const cpu_type &cpu)
+    {
+        int32_t index;
+
+        return affinity_manager_.get_index_from_cpu(index, cpu) &&
+               table_.claim(index, shared_cpu_table_type::current_pid());
+    }
+
+    /*!
+     * Claim a set of cpus for this process.  Either every cpu is claimed or,
+     * if any is held by another live process, none are.
+     *
+     * \param cpus [in] the cpus
+     * \return true if this process now holds every cpu, false otherwise.
+     */
+    inline bool claim(const cpu_set_type &cpus)
+    {
+        cpu_set_type claimed;
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            // cpus this process already held are left alone on failure
+            process_id_type owner = 0;
+            bool was_ours = get_owner(owner, *i) &&
+                            owner == shared_cpu_table_type::current_pid();
+
+            if (!claim(*i))
+            {
+                release(claimed);
+                return false;
+            }
+
+            if (!was_ours)
+            {
+                claimed.insert(*i);
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    /*!
+     * Release a cpu held by this process.
+     *
+     * \param cpu [in] the cpu
+     * \return true if the cpu was held by this process, false otherwise.
+     */
+    inline bool release(const cpu_type &cpu)
+    {
+        int32_t index;
+
+        return affinity_manager_.get_index_from_cpu(index, cpu) &&
+               table_.release(index, shared_cpu_table_type::current_pid());
+    }
+
+    /*!
+     * Release a set of cpus held by this process.
+     *
+     * \param cpus [in] the cpus
+     * \return true if every cpu was held by this process, false otherwise.
+     */
+    inline bool release(const cpu_set_type &cpus)
+    {
+        bool retval = true;
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            retval = release(*i) && retval;
+        }
+
+        return retval;
+    }
+
+    /*!
+     * Release every cpu held by this process.
+     */
+    inline void release_all()
+    {
+        cpu_set_type cpus;
+        get_cpus_by_owner(cpus, shared_cpu_table_type::current_pid());
+        release(cpus);
+    }
+
+    /*!
+     * Get the process holding a cpu.
+     *
+     * \param pid [out] the process id of the owner
+     * \param cpu [in] the cpu
+     * \return true if the cpu is claimed, false otherwise.
+     */
+    inline bool get_owner(process_id_type &pid, const cpu_type &cpu) const
+    {
+        int32_t index;
+
+        if (affinity_manager_.get_index_from_cpu(index, cpu))
+        {
+            pid = table_.owner(index);
+            return pid != 0;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get every claimed cpu and the process holding it.  Claims held by
+     * processes that have exited are included until they are reclaimed.
+     *
+     * \param claims [out] the owner of each claimed cpu
+     * \return true if any cpus are claimed, false otherwise.
+     */
+    inline bool get_claims(std::map< cpu_type, process_id_type > &claims) const
+    {
+        claims.clear();
+
+        for (std::size_t i = 0; i < table_.size(); ++i)
+        {
+            cpu_type cpu;
+            process_id_type pid = table_.owner(i);
+
+            if (pid != 0 && affinity_manager_.get_cpu_from_index(cpu, i))
+            {
+                claims[cpu] = pid;
+            }
+        }
+
+        return !claims.empty();
+    }
+
+    /*!
+     * Get the cpus claimed by the given process.
+     *
+     * \param cpus [out] the claimed cpus
+     * \param pid [in] the process id
+     * \return true if the process holds any cpus, false otherwise.
+     */
+    inline bool get_cpus_by_owner(cpu_set_type &cpus,
+                                  const process_id_type &pid) const
+    {
+        cpus.clear();
+
+        for (std::size_t i = 0; i < table_.size(); ++i)
+        {
+            cpu_type cpu;
+
+            if (table_.owner(i) == pid &&
+                affinity_manager_.get_cpu_from_index(cpu, i))
+            {
+                cpus.insert(cpu);
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    /*!
+     * Get the cpus no live process has claimed.
+     *
+     * \param cpus [out] the unclaimed cpus
+     * \return true if any cpus are unclaimed, false otherwise.
+     */
+    inline bool get_unclaimed_cpus(cpu_set_type &cpus) const
+    {
+        cpus.clear();
+
+        for (std::size_t i = 0; i < table_.size(); ++i)
+        {
+            cpu_type cpu;
+            process_id_type pid = table_.owner(i);
+
+            if ((pid == 0 || !shared_cpu_table_type::is_alive(pid)) &&
+                affinity_manager_.get_cpu_from_index(cpu, i))
+            {
+                cpus.insert(cpu);
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    /*!
+     * Drop every claim held by a process that has exited.
+     *
+     * \return the number of claims dropped
+     */
+    inline std::size_t reclaim() { return table_.reclaim(); }
+
+    /*!
+     * Remove the shared registry with the given name.  Processes that have it
+     * open keep using their copy, so this is only safe once every
+     * cooperating process has stopped.
+     *
+     * \param name the name of the shared memory object
+     * \return true if the registry was removed, false otherwise.
+     */
+    static inline bool remove(const std::string &name = "/cpuaff.registry")
+    {
+        return shared_cpu_table_type::unlink(name);
+    }
+
+   private:
+    basic_cpu_registry(const basic_cpu_registry &);
+    basic_cpu_registry &operator=(const basic_cpu_registry &);
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    std::string name_;
+    shared_cpu_table_type table_;
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
@@ -0,0 +1,967 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "../parse_error.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_cpu_set_parser turns placement expressions into cpu sets resolved
+ * against an affinity manager.  An expression is made of:
+ *
+ * - selectors such as "numa:0/core:2-7/pu:0".  Each step narrows the cpus
+ *   selected so far.  socket and numa match by id, core matches the Nth core
+ *   of each socket among the cpus selected so far, pu matches the Nth
+ *   processing unit of a core, and cpu matches the native cpu number.  Values
+ *   are "*", a number, a range "a-b", or a comma separated list of those.
+ * - native cpu lists such as "0-3,8,10-11" as printed by the linux kernel.
+ * - OpenMP style intervals such as "{0:4}" or "{0:4:2}:2:8".
+ * - "*" for every cpu.
+ * - the set operators "|" (union), "&" (intersection), and "-" (difference)
+ *   with "&" binding tighter, and parentheses.
+ *
+ * Selectors and lists that name cpus this machine does not have simply match
+ * nothing, so one expression can describe placements on machines of
+ * different shapes.  Ranges of native cpu numbers are cut off at the largest
+ * cpu number the affinity manager knows, and interval lengths and place
+ * counts larger than the number of cpus it knows are rejected, so a mistyped
+ * number cannot make the parser loop for billions of steps.  Syntax errors
+ * are reported with the column they were found at.
+ */
+template < typename TRAITS >
+class basic_cpu_set_parser
+{
+   public:
+    typedef typename TRAITS::cpu_identifier_type cpu_identifier_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+
+   public:
+    /*!
+     * Constructs a basic_cpu_set_parser that resolves expressions against the
+     * given affinity manager.
+     *
+     * \param affinity_manager the affinity manager
+     */
+    inline basic_cpu_set_parser(const affinity_manager_type &affinity_manager)
+        : affinity_manager_(affinity_manager)
+    {
+        affinity_manager_.get_cpus(cpus_);
+        set_limits();
+    }
+
+    /*!
+     * Constructs a basic_cpu_set_parser that resolves expressions against the
+     * given cpus only, for instance the cpus a process is allowed to run on.
+     * Native cpu numbers are looked up through the affinity manager.
+     *
+     * \param affinity_manager the affinity manager
+     * \param cpus the cpus expressions may select
+     */
+    inline basic_cpu_set_parser(const affinity_manager_type &affinity_manager,
+                                const cpu_set_type &cpus)
+        : affinity_manager_(affinity_manager), cpus_(cpus)
+    {
+        set_limits();
+    }
+
+    /*!
+     * Parse an expression into a set of cpus.
+     *
+     * \param cpus [out] the cpus the expression selects
+     * \param text [in] the expression
+     * \return true if the expression is valid, false otherwise.
+     */
+    inline bool parse(cpu_set_type &cpus, const std::string &text) const
+    {
+        parse_error error;
+        return parse(cpus, text, error);
+    }
+
+    /*!
+     * Parse an expression into a set of cpus.
+     *
+     * \param cpus [out] the cpus the expression selects
+     * \param text [in] the expression
+     * \param error [out] what went wrong if the expression is invalid
+     * \return true if the expression is valid, false otherwise.
+     */
+    inline bool parse(cpu_set_type &cpus,
+                      const std::string &text,
+                      parse_error &error) const
+    {
+        cursor c(text);
+        cpu_set_type result;
+
+        cpus.clear();
+
+        if (parse_expression(result, c) && parse_end(c))
+        {
+            cpus.swap(result);
+            return true;
+        }
+
+        error = c.error;
+        return false;
+    }
+
+    /*!
+     * Parse an OMP_PLACES style list into an ordered list of places.  The
+     * list is either an abstract name ("threads", "cores", "sockets", or
+     * "numa_domains", optionally followed by a count in parentheses) or a
+     * comma separated list of intervals such as "{0:4}:4:4,{16,17}".  Places
+     * that contain no cpus of this machine are left out.
+     *
+     * \param places [out] the places
+     * \param text [in] the place list
+     * \return true if the list is valid, false otherwise.
+     */
+    inline bool parse_places(std::vector< cpu_set_type > &places,
+                             const std::string &text) const
+    {
+        parse_error error;
+        return parse_places(places, text, error);
+    }
+
+    /*!
+     * Parse an OMP_PLACES style list into an ordered list of places.
+     *
+     * \param places [out] the places
+     * \param text [in] the place list
+     * \param error [out] what went wrong if the list is invalid
+     * \return true if the list is valid, false otherwise.
+     */
+    inline bool parse_places(std::vector< cpu_set_type > &places,
+                             const std::string &text,
+                             parse_error &error) const
+    {
+        cursor c(text);
+        std::vector< cpu_set_type > result;
+
+        places.clear();
+        c.skip_space();
+
+        bool ok = (is_alpha(*c.p)) ? parse_abstract_places(result, c)
+                                   : parse_interval_places(result, c);
+
+        if (ok && parse_end(c))
+        {
+            places.swap(result);
+            return true;
+        }
+
+        error = c.error;
+        return false;
+    }
+
+   private:
+    typedef std::vector< std::pair< int64_t, int64_t > > range_vector_type;
+    typedef std::pair< int32_t, std::pair< int32_t, int32_t > > unit_key_type;
+
+    struct cursor
+    {
+        inline cursor(const std::string &text)
+            : begin(text.c_str()), p(begin), failed(false)
+        {
+        }
+
+        inline void skip_space()
+        {
+            while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            {
+                ++p;
+            }
+        }
+
+        inline bool fail(const std::string &message)
+        {
+            return fail(p, message);
+        }
+
+        inline bool fail(const char *at, const std::string &message)
+        {
+            if (!failed)
+            {
+                error = parse_error(std::size_t(at - begin) + 1, message);
+                failed = true;
+            }
+
+            return false;
+        }
+
+        inline bool unexpected()
+        {
+            if (*p == '\0')
+            {
+                return fail("unexpected end of input");
+            }
+
+            return fail(std::string("unexpected '") + *p + "'");
+        }
+
+        const char *begin;
+        const char *p;
+        parse_error error;
+        bool failed;
+    };
+
+    inline void set_limits()
+    {
+        cpu_set_type cpus;
+        affinity_manager_.get_cpus(cpus);
+
+        max_id_ = -1;
+        cpu_count_ = int64_t(cpus.size());
+
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            max_id_ = std::max(max_id_, int64_t(i->id().get()));
+        }
+    }
+
+    // reject a count of cpus the affinity manager cannot have
+    inline bool check_count(int64_t n,
+                            const char *what,
+                            const char *at,
+                            cursor &c) const
+    {
+        if (n > cpu_count_)
+        {
+            return c.fail(at, std::string(what) + " " + number_string(n) +
+                                  " exceeds the " + number_string(cpu_count_) +
+                                  " cpus of this machine");
+        }
+
+        return true;
+    }
+
+    static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+    static inline bool is_alpha(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    static inline std::string number_string(int64_t n)
+    {
+        std::ostringstream buf;
+        buf << n;
+        return buf.str();
+    }
+
+    inline bool parse_end(cursor &c) const
+    {
+        c.skip_space();
+        return (*c.p == '\0') ? true : c.unexpected();
+    }
+
+    // expression := intersection (('|' | '-') intersection)*
+    inline bool parse_expression(cpu_set_type &cpus, cursor &c) const
+    {
+        if (!parse_intersection(cpus, c))
+        {
+            return false;
+        }
+
+        for (;;)
+        {
+            c.skip_space();
+            char op = *c.p;
+
+            if (op != '|' && op != '-')
+            {
+                return true;
+            }
+
+            ++c.p;
+            cpu_set_type rhs;
+
+            if (!parse_intersection(rhs, c))
+            {
+                return false;
+            }
+
+            if (op == '|')
+            {
+                cpus.insert(rhs.begin(), rhs.end());
+            }
+            else
+            {
+                typename cpu_set_type::const_iterator i = rhs.begin();
+                typename cpu_set_type::const_iterator iend = rhs.end();
+
+                for (; i != iend; ++i)
+                {
+                    cpus.erase(*i);
+                }
+            }
+        }
+    }
+
+    // intersection := term ('&' term)*
+    inline bool parse_intersection(cpu_set_type &cpus, cursor &c) const
+    {
+        if (!parse_term(cpus, c))
+        {
+            return false;
+        }
+
+        for (;;)
+        {
+            c.skip_space();
+
+            if (*c.p != '&')
+            {
+                return true;
+            }
+
+            ++c.p;
+            cpu_set_type rhs;
+
+            if (!parse_term(rhs, c))
+            {
+                return false;
+            }
+
+            cpu_set_type both;
+            typename cpu_set_type::const_iterator i = cpus.begin();
+            typename cpu_set_type::const_iterator iend = cpus.end();
+
+            for (; i != iend; ++i)
+            {
+                if (rhs.find(*i) != rhs.end())
+                {
+                    both.insert(*i);
+                }
+            }
+
+            cpus.swap(both);
+        }
+    }
+
+    // term := '(' expression ')' | '*' | native-list | interval | selector
+    inline bool parse_term(cpu_set_type &cpus, cursor &c) const
+    {
+        c.skip_space();
+        cpus.clear();
+
+        if (*c.p == '(')
+        {
+            ++c.p;
+
+            if (!parse_expression(cpus, c))
+            {
+                return false;
+            }
+
+            c.skip_space();
+
+            if (*c.p != ')')
+            {
+                return c.fail("expected ')'");
+            }
+
+            ++c.p;
+            return true;
+        }
+        else if (*c.p == '*')
+        {
+            ++c.p;
+            cpus = cpus_;
+            return true;
+        }
+        else if (*c.p == '{')
+        {
+            std::vector< cpu_set_type > places;
+
+            if (!parse_interval_group(places, c))
+            {
+                return false;
+            }
+
+            for (std::size_t i = 0; i < places.size(); ++i)
+            {
+                cpus.insert(places[i].begin(), places[i].end());
+            }
+
+            return true;
+        }
+        else if (is_digit(*c.p))
+        {
+            return parse_native_list(cpus, c);
+        }
+        else if (is_alpha(*c.p))
+        {
+            return parse_selector(cpus, c);
+        }
+
+        return (*c.p == '\0') ? c.fail("expected a cpu set") : c.unexpected();
+    }
+
+    inline bool parse_number(int64_t &n, cursor &c) const
+    {
+        if (!is_digit(*c.p))
+        {
+            return c.fail("expected a number");
+        }
+
+        const char *start = c.p;
+        n = 0;
+
+        for (; is_digit(*c.p); ++c.p)
+        {
+            n = n * 10 + (*c.p - '0');
+
+            if (n > 0x7fffffff)
+            {
+                return c.fail(start, "number is too large");
+            }
+        }
+
+        return true;
+    }
+
+    inline bool parse_signed_number(int64_t &n, cursor &c) const
+    {
+        bool negative = (*c.p == '-');
+
+        if (negative)
+        {
+            ++c.p;
+        }
+
+        if (!parse_number(n, c))
+        {
+            return false;
+        }
+
+        n = (negative) ? -n : n;
+        return true;
+    }
+
+    // range := number ('-' number)?
+    inline bool parse_range(std::pair< int64_t, int64_t > &range,
+                            cursor &c) const
+    {
+        if (!parse_number(range.first, c))
+        {
+            return false;
+        }
+
+        range.second = range.first;
+
+        if (*c.p == '-' && is_digit(c.p[1]))
+        {
+            ++c.p;
+            const char *start = c.p;
+
+            if (!parse_number(range.second, c))
+            {
+                return false;
+            }
+
+            if (range.second < range.first)
+            {
+                return c.fail(start, "range end " +
+                                         number_string(range.second) +
+                                         " is before its start " +
+                                         number_string(range.first));
+            }
+        }
+
+        return true;
+    }
+
+    // range-list := range (',' range)*
+    inline bool parse_range_list(range_vector_type &ranges, cursor &c) const
+    {
+        ranges.clear();
+
+        for (;;)
+        {
+            std::pair< int64_t, int64_t > range;
+
+            if (!parse_range(range, c))
+            {
+                return false;
+            }
+
+            ranges.push_back(range);
+
+            if (*c.p != ',' || !is_digit(c.p[1]))
+            {
+                return true;
+            }
+
+            ++c.p;
+        }
+    }
+
+    static inline bool contains(const range_vector_type &ranges, int64_t n)
+    {
+        for (std::size_t i = 0; i < ranges.size(); ++i)
+        {
+            if (n >= ranges[i].first && n <= ranges[i].second)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline void add_native(cpu_set_type &cpus, int64_t id) const
+    {
+        cpu_type cpu;
+
+        if (id >= 0 &&
+            affinity_manager_.get_cpu_from_id(cpu, cpu_identifier_type(id)) &&
+            cpus_.find(cpu) != cpus_.end())
+        {
+            cpus.insert(cpu);
+        }
+    }
+
+    inline bool parse_native_list(cpu_set_type &cpus, cursor &c) const
+    {
+        range_vector_type ranges;
+
+        if (!parse_range_list(ranges, c))
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < ranges.size(); ++i)
+        {
+            int64_t last = std::min(ranges[i].second, max_id_);
+
+            for (int64_t id = ranges[i].first; id <= last; ++id)
+            {
+                add_native(cpus, id);
+            }
+        }
+
+        return true;
+    }
+
+    // selector := level ':' values ('/' level ':' values)*
+    inline bool parse_selector(cpu_set_type &cpus, cursor &c) const
+    {
+        cpus = cpus_;
+
+        for (;;)
+        {
+            const char *start = c.p;
+
+            while (is_alpha(*c.p))
+            {
+                ++c.p;
+            }
+
+            std::string level(start, c.p);
+
+            if (level != "socket" && level != "numa" && level != "core" &&
+                level != "pu" && level != "cpu")
+            {
+                return c.fail(start, "unknown level '" + level +
+                                         "' (expected socket, numa, core, "
+                                         "pu, or cpu)");
+            }
+
+            if (*c.p != ':')
+            {
+                return c.fail("expected ':' after '" + level + "'");
+            }
+
+            ++c.p;
+
+            if (*c.p == '*')
+            {
+                ++c.p;
+            }
+            else
+            {
+                range_vector_type ranges;
+
+                if (!parse_range_list(ranges, c))
+                {
+                    return false;
+                }
+
+                filter(cpus, level, ranges);
+            }
+
+            if (*c.p != '/')
+            {
+                return true;
+            }
+
+            ++c.p;
+
+            if (!is_alpha(*c.p))
+            {
+                return c.fail("expected a level after '/'");
+            }
+        }
+    }
+
+    inline void filter(cpu_set_type &cpus,
+                       const std::string &level,
+                       const range_vector_type &ranges) const
+    {
+        // cores are numbered within each socket among the cpus selected so
+        // far since core ids are often sparse
+        std::map< socket_type, std::map< core_type, int64_t > > ordinals;
+
+        if (level == "core")
+        {
+            typename cpu_set_type::const_iterator i = cpus.begin();
+            typename cpu_set_type::const_iterator iend = cpus.end();
+
+            for (; i != iend; ++i)
+            {
+                std::map< core_type, int64_t > &cores = ordinals[i->socket()];
+
+                if (cores.find(i->core()) == cores.end())
+                {
+                    int64_t ordinal = int64_t(cores.size());
+                    cores[i->core()] = ordinal;
+                }
+            }
+        }
+
+        cpu_set_type selected;
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            int64_t value;
+
+            if (level == "socket")
+            {
+                value = i->socket();
+            }
+            else if (level == "numa")
+            {
+                value = i->numa();
+            }
+            else if (level == "core")
+            {
+                value = ordinals[i->socket()][i->core()];
+            }
+            else if (level == "pu")
+            {
+                value = i->processing_unit();
+            }
+            else
+            {
+                value = int64_t(i->id().get());
+            }
+
+            if (contains(ranges, value))
+            {
+                selected.insert(*i);
+            }
+        }
+
+        cpus.swap(selected);
+    }
+
+    // interval := number (':' length (':' stride)?)?
+    inline bool parse_interval(std::vector< int64_t > &ids, cursor &c) const
+    {
+        int64_t lower;
+        int64_t length = 1;
+        int64_t stride = 1;
+
+        if (!parse_number(lower, c))
+        {
+            return false;
+        }
+
+        if (*c.p == ':')
+        {
+            ++c.p;
+            const char *start = c.p;
+
+            if (!parse_number(length, c))
+            {
+                return false;
+            }
+
+            if (length == 0)
+            {
+                return c.fail(start, "interval length must be positive");
+            }
+
+            if (!check_count(length, "interval length", start, c))
+            {
+                return false;
+            }
+
+            if (*c.p == ':')
+            {
+                ++c.p;
+
+                if (!parse_signed_number(stride, c))
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (int64_t i = 0; i < length; ++i)
+        {
+            ids.push_back(lower + i * stride);
+        }
+
+        return true;
+    }
+
+    // interval-group := '{' interval (',' interval)* '}' (':' count (':'
+    //                   stride)?)?
+    inline bool parse_interval_group(std::vector< cpu_set_type > &places,
+                                     cursor &c) const
+    {
+        std::vector< int64_t > ids;
+
+        ++c.p;
+
+        for (;;)
+        {
+            c.skip_space();
+
+            if (!parse_interval(ids, c))
+            {
+                return false;
+            }
+
+            c.skip_space();
+
+            if (*c.p == '}')
+            {
+                ++c.p;
+                break;
+            }
+            else if (*c.p != ',')
+            {
+                return c.fail("expected ',' or '}'");
+            }
+
+            ++c.p;
+        }
+
+        int64_t count = 1;
+        int64_t stride = 1;
+
+        if (*c.p == ':')
+        {
+            ++c.p;
+            const char *start = c.p;
+
+            if (!parse_number(count, c))
+            {
+                return false;
+            }
+
+            if (count == 0)
+            {
+                return c.fail(start, "place count must be positive");
+            }
+
+            if (!check_count(count, "place count", start, c))
+            {
+                return false;
+            }
+
+            if (*c.p == ':')
+            {
+                ++c.p;
+
+                if (!parse_signed_number(stride, c))
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (int64_t n = 0; n < count; ++n)
+        {
+            cpu_set_type place;
+
+            for (std::size_t i = 0; i < ids.size(); ++i)
+            {
+                add_native(place, ids[i] + n * stride);
+            }
+
+            if (!place.empty())
+            {
+                places.push_back(place);
+            }
+        }
+
+        return true;
+    }
+
+    inline bool parse_interval_places(std::vector< cpu_set_type > &places,
+                                      cursor &c) const
+    {
+        for (;;)
+        {
+            c.skip_space();
+
+            if (*c.p != '{')
+            {
+                return c.fail("expected '{'");
+            }
+
+            if (!parse_interval_group(places, c))
+            {
+                return false;
+            }
+
+            c.skip_space();
+
+            if (*c.p != ',')
+            {
+                return true;
+            }
+
+            ++c.p;
+        }
+    }
+
+    inline bool parse_abstract_places(std::vector< cpu_set_type > &places,
+                                      cursor &c) const
+    {
+        const char *start = c.p;
+
+        while (is_alpha(*c.p))
+        {
+            ++c.p;
+        }
+
+        std::string name(start, c.p);
+
+        if (name != "threads" && name != "cores" && name != "sockets" &&
+            name != "numa_domains")
+        {
+            return c.fail(start, "unknown place name '" + name +
+                                     "' (expected threads, cores, sockets, "
+                                     "or numa_domains)");
+        }
+
+        std::map< unit_key_type, cpu_set_type > units;
+        typename cpu_set_type::const_iterator i = cpus_.begin();
+        typename cpu_set_type::const_iterator iend = cpus_.end();
+
+        for (; i != iend; ++i)
+        {
+            unit_key_type key(i->socket(), std::make_pair(0, 0));
+
+            if (name == "threads")
+            {
+                key.second = std::make_pair(i->core(), i->processing_unit());
+            }
+            else if (name == "cores")
+            {
+                key.second.first = i->core();
+            }
+            else if (name == "numa_domains")
+            {
+                key.first = i->numa();
+            }
+
+            units[key].insert(*i);
+        }
+
+        int64_t count = int64_t(units.size());
+        c.skip_space();
+
+        if (*c.p == '(')
+        {
+            ++c.p;
+            c.skip_space();
+
+            if (!parse_number(count, c))
+            {
+                return false;
+            }
+
+            c.skip_space();
+
+            if (*c.p != ')')
+            {
+                return c.fail("expected ')'");
+            }
+
+            ++c.p;
+        }
+
+        typename std::map< unit_key_type, cpu_set_type >::const_iterator j =
+            units.begin();
+        typename std::map< unit_key_type, cpu_set_type >::const_iterator jend =
+            units.end();
+
+        for (; j != jend && int64_t(places.size()) < count; ++j)
+        {
+            places.push_back(j->second);
+        }
+
+        return true;
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    cpu_set_type cpus_;
+    int64_t max_id_;
+    int64_t cpu_count_;
+};
+}  // namespace impl
+}  // namespace cpuaff
@@ -0,0 +1,485 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+
+#include "../config.hpp"
+#include "atomic.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_thread_registry.hpp"
+#include "mutex.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_drift_listener receives the events of a basic_drift_auditor.  Each
+ * event is raised once, when a thread starts drifting, rather than on every
+ * scan that sees it drifting.  The default implementations do nothing.
+ * Events are delivered on the thread that runs the scan, after the scan
+ * has released the auditor's state.  A listener may call drifting() and the
+ * counters but must not call scan() or set_listener().
+ */
+template < typename TRAITS >
+class basic_drift_listener
+{
+   public:
+    typedef basic_cpu< TRAITS > cpu_type;
+
+   public:
+    virtual ~basic_drift_listener() {}
+
+    /*!
+     * A thread's affinity mask no longer matches the cpus it registered
+     * with, for instance because taskset or a container cpu manager changed
+     * it.
+     *
+     * \param tid the kernel thread id
+     * \param name the role name the thread registered with
+     */
+    virtual void mask_changed(const thread_id_type &tid,
+                              const std::string &name)
+    {
+    }
+
+    /*!
+     * A thread last ran on a cpu outside of the cpus it registered with.
+     *
+     * \param tid the kernel thread id
+     * \param name the role name the thread registered with
+     * \param cpu the cpu the thread ran on
+     */
+    virtual void foreign_cpu(const thread_id_type &tid,
+                             const std::string &name,
+                             const cpu_type &cpu)
+    {
+    }
+
+    /*!
+     * A thread that was drifting is back on its intended cpus.
+     *
+     * \param tid the kernel thread id
+     * \param name the role name the thread registered with
+     */
+    virtual void restored(const thread_id_type &tid, const std::string &name)
+    {
+    }
+};
+
+/*!
+ * basic_drift_auditor periodically checks the threads of a
+ * basic_thread_registry against the cpus they registered with.  It counts,
+ * and reports to an optional listener, threads whose affinity mask was
+ * changed from outside of cpuaff and threads that ran on a cpu outside of
+ * their intended set.
+ *
+ * A scan costs one sched_getaffinity call and one read of
+ * /proc/self/task/<tid>/stat per registered thread.  The registrations are
+ * copied only when the registry changes, so scans do not allocate in steady
+ * state.  The system calls and /proc reads are made without holding the lock
+ * that drifting() waits on.
+ */
+template < typename TRAITS >
+class basic_drift_auditor
+{
+   public:
+    typedef typename TRAITS::thread_control_type thread_control_type;
+    typedef typename TRAITS::periodic_runner_type periodic_runner_type;
+    typedef typename TRAITS::cpu_identifier_wrapper_type
+        cpu_identifier_wrapper_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+    typedef basic_thread_registry< TRAITS > thread_registry_type;
+    typedef basic_thread_placement< TRAITS > thread_placement_type;
+    typedef basic_drift_listener< TRAITS > listener_type;
+
+   public:
+    /*!
+     * Construct a basic_drift_auditor for the threads of a registry.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     * \param registry the thread registry to audit
+     */
+    inline basic_drift_auditor(const affinity_manager_type &affinity_manager,
+                               const thread_registry_type &registry)
+        : affinity_manager_(affinity_manager)
+        , registry_(registry)
+        , listener_(NULL)
+        , generation_(~uint64_t(0))
+        , scans_(0)
+        , mask_changes_(0)
+        , foreign_cpu_runs_(0)
+    {
+        cpu_set_type cpus;
+        affinity_manager_.get_cpus(cpus);
+        actual_.reserve(cpus.size());
+    }
+
+    inline ~basic_drift_auditor() { stop(); }
+
+    /*!
+     * Set the listener that receives drift events.  The listener is not
+     * owned and must outlive the auditor or be replaced with NULL.  This
+     * waits for a scan in progress, so once it returns the old listener
+     * receives no more events.
+     *
+     * \param listener [in] the listener, or NULL for none
+     */
+    inline void set_listener(listener_type *listener)
+    {
+        mutex_guard guard(scan_lock_);
+        listener_ = listener;
+    }
+
+    /*!
+     * Start scanning on a background thread.
+     *
+     * \param interval_ms [in] the time between scans in milliseconds
+     * \return true if the background thread was started, false if it was
+     *         already running or could not be created.
+     */
+    inline bool start(const uint64_t &interval_ms = 1000)
+    {
+        return runner_.start(&basic_drift_auditor::tick, this,
+                             interval_ms * uint64_t(1000000));
+    }
+
+    /*!
+     * Stop the background thread, waiting for a scan in progress.
+     */
+    inline void stop() { runner_.stop(); }
+
+    /*!
+     * Check if the background thread is running.
+     *
+     * \return true if scanning in the background, false otherwise
+     */
+    inline bool running() const { return runner_.running(); }
+
+    /*!
+     * Check every registered thread once.  This is what the background
+     * thread calls; it may also be called directly.
+     */
+    inline void scan()
+    {
+        // scans are serialized by scan_lock_; lock_ only guards the drift
+        // state that drifting() reads
+        mutex_guard scan_guard(scan_lock_);
+        thread_control_type control;
+
+        if (registry_.generation() != generation_)
+        {
+            refresh();
+        }
+
+        typename std::vector< entry >::iterator i = entries_.begin();
+        typename std::vector< entry >::iterator iend = entries_.end();
+
+        for (; i != iend; ++i)
+        {
+            i->alive = control.get_affinity(actual_, i->tid);
+
+            if (!i->alive)
+            {
+                // the thread has exited
+                continue;
+            }
+
+            i->now_mask_changed = !same(actual_, i->intended);
+            i->now_foreign =
+                control.get_last_cpu(i->last, i->tid) &&
+                !std::binary_search(i->intended.begin(), i->intended.end(),
+                                    i->last);
+        }
+
+        events_.clear();
+
+        {
+            mutex_guard guard(lock_);
+
+            for (std::size_t j = 0; j < entries_.size(); ++j)
+            {
+                entry &e = entries_[j];
+
+                if (!e.alive)
+                {
+                    continue;
+                }
+
+                if (e.now_mask_changed && !e.mask_changed)
+                {
+                    atomic::fetch_add(mask_changes_, uint64_t(1));
+                    events_.push_back(event(event::MASK_CHANGED, j));
+                }
+
+                if (e.now_foreign && !e.foreign)
+                {
+                    atomic::fetch_add(foreign_cpu_runs_, uint64_t(1));
+                    events_.push_back(event(event::FOREIGN_CPU, j));
+                }
+
+                if ((e.mask_changed || e.foreign) && !e.now_mask_changed &&
+                    !e.now_foreign)
+                {
+                    events_.push_back(event(event::RESTORED, j));
+                }
+
+                e.mask_changed = e.now_mask_changed;
+                e.foreign = e.now_foreign;
+            }
+        }
+
+        if (listener_)
+        {
+            deliver();
+        }
+
+        atomic::fetch_add(scans_, uint64_t(1));
+    }
+
+    /*!
+     * Get the number of scans completed.
+     *
+     * \return the number of scans
+     */
+    inline uint64_t scans() const { return atomic::load(scans_); }
+
+    /*!
+     * Get the number of times a thread's affinity mask was found changed.
+     *
+     * \return the number of mask changes
+     */
+    inline uint64_t mask_changes() const
+    {
+        return atomic::load(mask_changes_);
+    }
+
+    /*!
+     * Get the number of times a thread was found to have run outside of its
+     * intended cpus.
+     *
+     * \return the number of foreign cpu runs
+     */
+    inline uint64_t foreign_cpu_runs() const
+    {
+        return atomic::load(foreign_cpu_runs_);
+    }
+
+    /*!
+     * Get the number of registered threads that were drifting at the last
+     * scan.
+     *
+     * \return the number of drifting threads
+     */
+    inline int drifting() const
+    {
+        mutex_guard guard(lock_);
+        int count = 0;
+
+        for (std::size_t i = 0; i < entries_.size(); ++i)
+        {
+            count += (entries_[i].mask_changed || entries_[i].foreign) ? 1 : 0;
+        }
+
+        return count;
+    }
+
+   private:
+    basic_drift_auditor(const basic_drift_auditor &);
+    basic_drift_auditor &operator=(const basic_drift_auditor &);
+
+    struct entry
+    {
+        thread_id_type tid;
+        std::string name;
+        std::vector< cpu_identifier_wrapper_type > intended;
+        bool mask_changed;
+        bool foreign;
+
+        // the observations of the scan in progress
+        cpu_identifier_wrapper_type last;
+        bool alive;
+        bool now_mask_changed;
+        bool now_foreign;
+    };
+
+    struct event
+    {
+        enum kind_type
+        {
+            MASK_CHANGED,
+            FOREIGN_CPU,
+            RESTORED
+        };
+
+        inline event(kind_type k, std::size_t i) : kind(k), index(i)
+        {
+        }
+
+        kind_type kind;
+        std::size_t index;
+    };
+
+    /*!
+     * Deliver the events collected by the last scan to the listener.
+     */
+    inline void deliver()
+    {
+        for (std::size_t i = 0; i < events_.size(); ++i)
+        {
+            const entry &e = entries_[events_[i].index];
+            cpu_type cpu;
+
+            switch (events_[i].kind)
+            {
+                case event::MASK_CHANGED:
+                    listener_->mask_changed(e.tid, e.name);
+                    break;
+
+                case event::FOREIGN_CPU:
+                    if (affinity_manager_.get_cpu_from_id(cpu, e.last))
+                    {
+                        listener_->foreign_cpu(e.tid, e.name, cpu);
+                    }
+                    break;
+
+                case event::RESTORED:
+                    listener_->restored(e.tid, e.name);
+                    break;
+            }
+        }
+    }
+
+    static inline void tick(void *self)
+    {
+        static_cast< basic_drift_auditor * >(self)->scan();
+    }
+
+    static inline bool same(
+        const std::vector< cpu_identifier_wrapper_type > &lhs,
+        const std::vector< cpu_identifier_wrapper_type > &rhs)
+    {
+        if (lhs.size() != rhs.size())
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < lhs.size(); ++i)
+        {
+            if (lhs[i] < rhs[i] || rhs[i] < lhs[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * Copy the registrations, keeping the drift state of threads that kept
+     * the same intended cpus.
+     */
+    inline void refresh()
+    {
+        std::vector< thread_placement_type > registrations;
+        std::vector< entry > entries;
+
+        generation_ = registry_.generation();
+        registry_.get_registrations(registrations);
+        entries.resize(registrations.size());
+
+        for (std::size_t i = 0; i < registrations.size(); ++i)
+        {
+            entry &e = entries[i];
+            e.tid = registrations[i].thread();
+            e.name = registrations[i].name();
+            e.mask_changed = false;
+            e.foreign = false;
+            e.alive = false;
+            e.now_mask_changed = false;
+            e.now_foreign = false;
+
+            typename cpu_set_type::const_iterator j =
+                registrations[i].intended().begin();
+            typename cpu_set_type::const_iterator jend =
+                registrations[i].intended().end();
+
+            for (; j != jend; ++j)
+            {
+                e.intended.push_back(j->id());
+            }
+
+            std::sort(e.intended.begin(), e.intended.end());
+
+            for (std::size_t k = 0; k < entries_.size(); ++k)
+            {
+                if (entries_[k].tid == e.tid &&
+                    same(entries_[k].intended, e.intended))
+                {
+                    e.mask_changed = entries_[k].mask_changed;
+                    e.foreign = entries_[k].foreign;
+                }
+            }
+        }
+
+        mutex_guard guard(lock_);
+        entries_.swap(entries);
+        events_.reserve(2 * entries_.size());
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    const thread_registry_type &registry_;
+    listener_type *listener_;
+    std::vector< entry > entries_;
+    std::vector< cpu_identifier_wrapper_type > actual_;
+    std::vector< event > events_;
+    uint64_t generation_;
+    volatile uint64_t scans_;
+    volatile uint64_t mask_changes_;
+    volatile uint64_t foreign_cpu_runs_;
+    mutable mutex lock_;
+    mutex scan_lock_;
+    periodic_runner_type runner_;
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
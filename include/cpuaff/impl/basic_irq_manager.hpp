@@ -0,0 +1,327 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_PCI_SUPPORTED)
+
+#include "../config.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include "basic_pci_device.hpp"
+#include <map>
+#include <set>
+#include <string>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_irq_manager is a collection of all the interrupts on the system.  It
+ * maps interrupts to the pci devices that raise them and gets and sets the
+ * cpus that service them.
+ */
+template < typename TRAITS >
+class basic_irq_manager
+{
+   public:
+    typedef typename TRAITS::cpu_identifier_wrapper_type
+        cpu_identifier_wrapper_type;
+    typedef typename TRAITS::irq_reader_type irq_reader_type;
+
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+    typedef basic_pci_device< TRAITS > pci_device_type;
+
+   public:
+    /*!
+     * Construct a basic_irq_manager for the given affinity_manager.  The proc
+     * and sys roots can be changed so that the interrupt layout can be read
+     * from (and written to) somewhere other than the running system.
+     *
+     * \param affinity_manager the affinity_manager used to map cpus
+     * \param proc_root the mount point of procfs
+     * \param sys_root the mount point of sysfs
+     */
+    inline basic_irq_manager(const affinity_manager_type &affinity_manager,
+                             const std::string &proc_root = "/proc",
+                             const std::string &sys_root = "/sys")
+        : affinity_manager_(affinity_manager)
+        , reader_(proc_root, sys_root)
+        , loaded_irqs_(false)
+    {
+        initialize();
+    }
+
+    /*!
+     * Check if this basic_irq_manager has been successfully initialized.
+     *
+     * \return true if irq initialization succeeded, false otherwise.
+     */
+    inline bool has_irqs() const { return loaded_irqs_; }
+
+    /*!
+     * Get all the numbered irqs.
+     *
+     * \param irqs [out] the set of irqs
+     * \return true if irqs are found, false otherwise.
+     */
+    inline bool get_irqs(std::set< irq_type > &irqs) const
+    {
+        irqs.clear();
+
+        typename std::map< irq_type, std::string >::const_iterator i =
+            description_by_irq_.begin();
+        typename std::map< irq_type, std::string >::const_iterator iend =
+            description_by_irq_.end();
+
+        for (; i != iend; ++i)
+        {
+            irqs.insert(i->first);
+        }
+
+        return !irqs.empty();
+    }
+
+    /*!
+     * Get the description (chip, hardware irq, and handlers) of an irq.
+     *
+     * \param description [out] the description of the irq
+     * \param irq [in] the irq
+     * \return true if the irq is found, false otherwise.
+     */
+    inline bool get_irq_description(std::string &description,
+                                    const irq_type &irq) const
+    {
+        typename std::map< irq_type, std::string >::const_iterator i =
+            description_by_irq_.find(irq);
+
+        if (i != description_by_irq_.end())
+        {
+            description = i->second;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the number of times an irq had fired on all cpus when this
+     * basic_irq_manager was initialized.
+     *
+     * \param count [out] the number of interrupts
+     * \param irq [in] the irq
+     * \return true if the irq is found, false otherwise.
+     */
+    inline bool get_irq_count(uint64_t &count, const irq_type &irq) const
+    {
+        typename std::map< irq_type, uint64_t >::const_iterator i =
+            count_by_irq_.find(irq);
+
+        if (i != count_by_irq_.end())
+        {
+            count = i->second;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the irqs raised by the given pci device.
+     *
+     * \param irqs [out] the set of irqs
+     * \param device [in] the pci device
+     * \return true if irqs are found, false otherwise.
+     */
+    inline bool get_irqs_by_device(std::set< irq_type > &irqs,
+                                   const pci_device_type &device) const
+    {
+        std::set< int32_t > ids;
+        irqs.clear();
+
+        if (reader_.read_device_irqs(ids, device.address().get()))
+        {
+            irqs.insert(ids.begin(), ids.end());
+        }
+
+        return !irqs.empty();
+    }
+
+    /*!
+     * Get the cpus that may service the given irq.
+     *
+     * \param cpus [out] the set of cpus
+     * \param irq [in] the irq
+     * \return true if the affinity could be determined, false otherwise.
+     */
+    inline bool get_irq_affinity(cpu_set_type &cpus, const irq_type &irq) const
+    {
+        std::set< int32_t > ids;
+        cpus.clear();
+
+        if (reader_.read_affinity(ids, irq))
+        {
+            std::set< int32_t >::const_iterator i = ids.begin();
+            std::set< int32_t >::const_iterator iend = ids.end();
+
+            for (; i != iend; ++i)
+            {
+                cpu_type cpu;
+
+                if (affinity_manager_.get_cpu_from_id(
+                        cpu, cpu_identifier_wrapper_type(*i)))
+                {
+                    cpus.insert(cpu);
+                }
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    /*!
+     * Set the cpus that may service the given irq.
+     *
+     * \param irq [in] the irq
+     * \param cpus [in] the set of cpus
+     * \return true if the affinity could be set, false otherwise.
+     */
+    inline bool set_irq_affinity(const irq_type &irq,
+                                 const cpu_set_type &cpus) const
+    {
+        std::set< int32_t > ids;
+
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            ids.insert(int32_t(i->id().get()));
+        }
+
+        return reader_.write_affinity(irq, ids);
+    }
+
+    /*!
+     * Steer all the irqs of the given pci device onto the cpus local to the
+     * device, excluding the given cpus (typically the cpus that application
+     * threads are pinned to).  If no cpus can be found near the device, all
+     * cpus are considered local.
+     *
+     * \param device the pci device
+     * \param excluded the cpus that should not service the irqs
+     * \return true if every irq of the device was steered, false otherwise.
+     */
+    inline bool steer_device_irqs(const pci_device_type &device,
+                                  const cpu_set_type &excluded) const
+    {
+        cpu_set_type local;
+
+        if (!affinity_manager_.get_cpus_near_device(local, device))
+        {
+            affinity_manager_.get_cpus(local);
+        }
+
+        cpu_set_type housekeeping;
+
+        typename cpu_set_type::const_iterator i = local.begin();
+        typename cpu_set_type::const_iterator iend = local.end();
+
+        for (; i != iend; ++i)
+        {
+            if (excluded.find(*i) == excluded.end())
+            {
+                housekeeping.insert(*i);
+            }
+        }
+
+        std::set< irq_type > irqs;
+
+        if (housekeeping.empty() || !get_irqs_by_device(irqs, device))
+        {
+            return false;
+        }
+
+        bool retval = true;
+
+        std::set< irq_type >::const_iterator j = irqs.begin();
+        std::set< irq_type >::const_iterator jend = irqs.end();
+
+        for (; j != jend; ++j)
+        {
+            retval = set_irq_affinity(*j, housekeeping) && retval;
+        }
+
+        return retval;
+    }
+
+   private:
+    /*!
+     * Initialize a basic_irq_manager.  This reads the numbered irqs.
+     *
+     * \return true if initialization is successful, false otherwise.
+     */
+    inline bool initialize()
+    {
+        loaded_irqs_ = reader_.load();
+
+        typename std::vector<
+            typename irq_reader_type::raw_irq_info >::const_iterator i =
+            reader_.irqs().begin();
+        typename std::vector<
+            typename irq_reader_type::raw_irq_info >::const_iterator iend =
+            reader_.irqs().end();
+
+        for (; i != iend; ++i)
+        {
+            description_by_irq_[i->irq] = i->description;
+            count_by_irq_[i->irq] = i->count;
+        }
+
+        return loaded_irqs_;
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    irq_reader_type reader_;
+    std::map< irq_type, std::string > description_by_irq_;
+    std::map< irq_type, uint64_t > count_by_irq_;
+    bool loaded_irqs_;
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
@@ -0,0 +1,412 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "../placement_policy.hpp"
+#include "mutex.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include "basic_placement_engine.hpp"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+template < typename TRAITS >
+class basic_lease_manager;
+
+/*!
+ * basic_cpu_lease holds a set of cpus leased exclusively from a
+ * basic_lease_manager.  The cpus are returned to the manager when the lease
+ * is released or destroyed.  A lease cannot be copied; it can be moved in
+ * C++11 and later or swapped.
+ */
+template < typename TRAITS >
+class basic_cpu_lease
+{
+   public:
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+    typedef basic_lease_manager< TRAITS > lease_manager_type;
+
+    friend class basic_lease_manager< TRAITS >;
+
+   public:
+    /*!
+     * Constructs an empty lease.
+     */
+    inline basic_cpu_lease() : manager_(NULL) {}
+
+    /*!
+     * Releases the leased cpus.
+     */
+    inline ~basic_cpu_lease() { release(); }
+
+#if __cplusplus >= 201103L
+    inline basic_cpu_lease(basic_cpu_lease &&rhs) : manager_(NULL)
+    {
+        swap(rhs);
+    }
+
+    inline basic_cpu_lease &operator=(basic_cpu_lease &&rhs)
+    {
+        if (this != &rhs)
+        {
+            release();
+            swap(rhs);
+        }
+
+        return *this;
+    }
+#endif
+
+    /*!
+     * Check if this lease holds cpus.
+     *
+     * \return true if cpus are leased, false otherwise
+     */
+    inline bool valid() const { return manager_ != NULL; }
+
+    /*!
+     * Get the leased cpus.
+     *
+     * \return the leased cpus
+     */
+    inline const cpu_set_type &cpus() const { return cpus_; }
+
+    /*!
+     * Get the name of the owner the cpus are leased to.
+     *
+     * \return the owner
+     */
+    inline const std::string &owner() const { return owner_; }
+
+    /*!
+     * Return the leased cpus to the manager.  This does nothing if the lease
+     * is empty.
+     */
+    inline void release()
+    {
+        if (manager_)
+        {
+            manager_->release(cpus_);
+            manager_ = NULL;
+            cpus_.clear();
+            owner_.clear();
+        }
+    }
+
+    /*!
+     * Exchange the contents of two leases.
+     *
+     * \param rhs the lease to swap with
+     */
+    inline void swap(basic_cpu_lease &rhs)
+    {
+        std::swap(manager_, rhs.manager_);
+        cpus_.swap(rhs.cpus_);
+        owner_.swap(rhs.owner_);
+    }
+
+   private:
+    basic_cpu_lease(const basic_cpu_lease &);
+    basic_cpu_lease &operator=(const basic_cpu_lease &);
+
+   private:
+    lease_manager_type *manager_;
+    cpu_set_type cpus_;
+    std::string owner_;
+};
+
+/*!
+ * basic_lease_manager hands out cpus for exclusive use.  Each cpu is leased
+ * to at most one owner at a time; whatever is not leased remains available
+ * to shared pools.  The manager is safe to use from multiple threads and
+ * must outlive every lease it hands out.
+ */
+template < typename TRAITS >
+class basic_lease_manager
+{
+   public:
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+    typedef basic_cpu_lease< TRAITS > lease_type;
+    typedef basic_placement_engine< TRAITS > placement_engine_type;
+
+    friend class basic_cpu_lease< TRAITS >;
+
+   public:
+    /*!
+     * Constructs a basic_lease_manager over every cpu known to the affinity
+     * manager.
+     *
+     * \param affinity_manager the affinity manager
+     */
+    inline basic_lease_manager(const affinity_manager_type &affinity_manager)
+    {
+        affinity_manager.get_cpus(cpus_);
+    }
+
+    /*!
+     * Constructs a basic_lease_manager over the given cpus.
+     *
+     * \param cpus the cpus that may be leased
+     */
+    inline basic_lease_manager(const cpu_set_type &cpus) : cpus_(cpus) {}
+
+    /*!
+     * Lease count cpus to the given owner.  Any cpus already held by the
+     * lease are released first.
+     *
+     * \param lease [out] the lease
+     * \param count [in] the number of cpus
+     * \param owner [in] the name of the owner
+     * \param policy [in] the order in which free cpus are chosen
+     * \return true if count cpus were leased, false otherwise.
+     */
+    inline bool acquire(
+        lease_type &lease,
+        std::size_t count,
+        const std::string &owner,
+        const placement_policy &policy = placement_policy::compact())
+    {
+        return acquire(lease, count, owner, cpus_, policy);
+    }
+
+    /*!
+     * Lease count cpus from the given set to the given owner, for instance
+     * only cpus near a particular device.  Any cpus already held by the lease
+     * are released first.
+     *
+     * \param lease [out] the lease
+     * \param count [in] the number of cpus
+     * \param owner [in] the name of the owner
+     * \param allowed [in] the cpus the lease may be taken from
+     * \param policy [in] the order in which free cpus are chosen
+     * \return true if count cpus were leased, false otherwise.
+     */
+    inline bool acquire(
+        lease_type &lease,
+        std::size_t count,
+        const std::string &owner,
+        const cpu_set_type &allowed,
+        const placement_policy &policy = placement_policy::compact())
+    {
+        lease.release();
+
+        if (count == 0)
+        {
+            return false;
+        }
+
+        mutex_guard guard(lock_);
+
+        cpu_set_type available;
+        typename cpu_set_type::const_iterator i = allowed.begin();
+        typename cpu_set_type::const_iterator iend = allowed.end();
+
+        for (; i != iend; ++i)
+        {
+            if (cpus_.find(*i) != cpus_.end() &&
+                owner_by_cpu_.find(*i) == owner_by_cpu_.end())
+            {
+                available.insert(*i);
+            }
+        }
+
+        std::vector< cpu_type > chosen;
+
+        if (!placement_engine_type(available).place(chosen, policy, count))
+        {
+            return false;
+        }
+
+        typename std::vector< cpu_type >::const_iterator j = chosen.begin();
+        typename std::vector< cpu_type >::const_iterator jend = chosen.end();
+
+        for (; j != jend; ++j)
+        {
+            owner_by_cpu_[*j] = owner;
+            lease.cpus_.insert(*j);
+        }
+
+        lease.manager_ = this;
+        lease.owner_ = owner;
+        return true;
+    }
+
+    /*!
+     * Get the owner a cpu is leased to.
+     *
+     * \param owner [out] the owner
+     * \param cpu [in] the cpu
+     * \return true if the cpu is leased, false otherwise.
+     */
+    inline bool get_owner(std::string &owner, const cpu_type &cpu) const
+    {
+        mutex_guard guard(lock_);
+
+        typename std::map< cpu_type, std::string >::const_iterator i =
+            owner_by_cpu_.find(cpu);
+
+        if (i != owner_by_cpu_.end())
+        {
+            owner = i->second;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get every leased cpu and its owner.
+     *
+     * \param owners [out] the owner of each leased cpu
+     * \return true if any cpus are leased, false otherwise.
+     */
+    inline bool get_owners(std::map< cpu_type, std::string > &owners) const
+    {
+        mutex_guard guard(lock_);
+        owners = owner_by_cpu_;
+        return !owners.empty();
+    }
+
+    /*!
+     * Get the cpus leased to the given owner.
+     *
+     * \param cpus [out] the leased cpus
+     * \param owner [in] the owner
+     * \return true if the owner holds cpus, false otherwise.
+     */
+    inline bool get_cpus_by_owner(cpu_set_type &cpus,
+                                  const std::string &owner) const
+    {
+        cpus.clear();
+
+        mutex_guard guard(lock_);
+
+        typename std::map< cpu_type, std::string >::const_iterator i =
+            owner_by_cpu_.begin();
+        typename std::map< cpu_type, std::string >::const_iterator iend =
+            owner_by_cpu_.end();
+
+        for (; i != iend; ++i)
+        {
+            if (i->second == owner)
+            {
+                cpus.insert(i->first);
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    /*!
+     * Get the cpus that are leased.
+     *
+     * \param cpus [out] the leased cpus
+     * \return true if any cpus are leased, false otherwise.
+     */
+    inline bool get_leased_cpus(cpu_set_type &cpus) const
+    {
+        cpus.clear();
+
+        mutex_guard guard(lock_);
+
+        typename std::map< cpu_type, std::string >::const_iterator i =
+            owner_by_cpu_.begin();
+        typename std::map< cpu_type, std::string >::const_iterator iend =
+            owner_by_cpu_.end();
+
+        for (; i != iend; ++i)
+        {
+            cpus.insert(i->first);
+        }
+
+        return !cpus.empty();
+    }
+
+    /*!
+     * Get the cpus that are not leased, for use by shared pools.
+     *
+     * \param cpus [out] the cpus that are not leased
+     * \return true if any cpus are free, false otherwise.
+     */
+    inline bool get_shared_cpus(cpu_set_type &cpus) const
+    {
+        cpus.clear();
+
+        mutex_guard guard(lock_);
+
+        typename cpu_set_type::const_iterator i = cpus_.begin();
+        typename cpu_set_type::const_iterator iend = cpus_.end();
+
+        for (; i != iend; ++i)
+        {
+            if (owner_by_cpu_.find(*i) == owner_by_cpu_.end())
+            {
+                cpus.insert(*i);
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+   private:
+    basic_lease_manager(const basic_lease_manager &);
+    basic_lease_manager &operator=(const basic_lease_manager &);
+
+    inline void release(const cpu_set_type &cpus)
+    {
+        mutex_guard guard(lock_);
+
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            owner_by_cpu_.erase(*i);
+        }
+    }
+
+   private:
+    cpu_set_type cpus_;
+    std::map< cpu_type, std::string > owner_by_cpu_;
+    mutable mutex lock_;
+};
+}  // namespace impl
+}  // namespace cpuaff
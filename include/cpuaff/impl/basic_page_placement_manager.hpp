@@ -0,0 +1,173 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+
+#include "../config.hpp"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_page_placement_manager reports and changes the numa placement of the
+ * pages backing a buffer.  It can be used to verify that a thread's memory is
+ * local to the cpus it has been pinned to and to migrate it if it is not.
+ */
+template < typename TRAITS >
+class basic_page_placement_manager
+{
+   public:
+    typedef typename TRAITS::get_page_numa_type get_page_numa_type;
+    typedef typename TRAITS::set_page_numa_type set_page_numa_type;
+
+   public:
+    /*!
+     * Construct a basic_page_placement_manager.
+     */
+    inline basic_page_placement_manager() {}
+
+    /*!
+     * Get the number of pages of the given buffer that reside on each numa
+     * node.  Pages that have not been faulted in yet (or whose location
+     * cannot be determined) are counted under numa node -1.
+     *
+     * \param pages [out] the number of pages keyed by numa node
+     * \param buffer [in] the start of the buffer
+     * \param length [in] the length of the buffer in bytes
+     * \return true if the placement could be determined, false otherwise.
+     */
+    inline bool get_page_placement(std::map< numa_type, std::size_t > &pages,
+                                   const void *buffer,
+                                   std::size_t length) const
+    {
+        pages.clear();
+        std::vector< numa_type > numas;
+
+        if (get_page_numa_type()(numas, buffer, length))
+        {
+            std::vector< numa_type >::const_iterator i = numas.begin();
+            std::vector< numa_type >::const_iterator iend = numas.end();
+
+            for (; i != iend; ++i)
+            {
+                ++pages[*i];
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the number of pages of the given buffer that do not reside on the
+     * given numa node.  Pages that have not been faulted in yet are not
+     * counted.
+     *
+     * \param misplaced [out] the number of pages not on the numa node
+     * \param buffer [in] the start of the buffer
+     * \param length [in] the length of the buffer in bytes
+     * \param numa [in] the numa node the buffer is expected to be on
+     * \return true if the placement could be determined, false otherwise.
+     */
+    inline bool get_misplaced_pages(std::size_t &misplaced,
+                                    const void *buffer,
+                                    std::size_t length,
+                                    const numa_type &numa) const
+    {
+        misplaced = 0;
+        std::map< numa_type, std::size_t > pages;
+
+        if (get_page_placement(pages, buffer, length))
+        {
+            std::map< numa_type, std::size_t >::const_iterator i =
+                pages.begin();
+            std::map< numa_type, std::size_t >::const_iterator iend =
+                pages.end();
+
+            for (; i != iend; ++i)
+            {
+                if (i->first != numa && i->first != -1)
+                {
+                    misplaced += i->second;
+                }
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Migrate the pages of the given buffer to the given numa node.
+     *
+     * \param buffer the start of the buffer
+     * \param length the length of the buffer in bytes
+     * \param numa the numa node to move the pages to
+     * \return true if every resident page was moved, false otherwise.
+     */
+    inline bool move_to_numa(const void *buffer,
+                             std::size_t length,
+                             const numa_type &numa) const
+    {
+        std::vector< numa_type > numas(1, numa);
+        return set_page_numa_type()(buffer, length, numas);
+    }
+
+    /*!
+     * Spread the pages of the given buffer over the given numa nodes.  Pages
+     * are assigned to the nodes in a round-robin fashion.
+     *
+     * \param buffer the start of the buffer
+     * \param length the length of the buffer in bytes
+     * \param numas the numa nodes to spread the pages over
+     * \return true if every resident page was moved, false otherwise.
+     */
+    inline bool spread_over_numa(const void *buffer,
+                                 std::size_t length,
+                                 const std::set< numa_type > &numas) const
+    {
+        std::vector< numa_type > targets(numas.begin(), numas.end());
+        return set_page_numa_type()(buffer, length, targets);
+    }
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
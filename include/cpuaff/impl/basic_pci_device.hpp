@@ -35,6 +35,8 @@
 #include "../pci_device_spec.hpp"
 #include <iomanip>
 #include <iostream>
+#include <set>
+#include <string>
 
 namespace cpuaff
 {
@@ -51,12 +53,25 @@ class basic_pci_device
    public:
     typedef typename TRAITS::pci_address_type pci_address_type;
     typedef typename TRAITS::pci_address_wrapper_type pci_address_wrapper_type;
+    typedef typename TRAITS::cpu_identifier_wrapper_type
+        cpu_identifier_wrapper_type;
 
    public:
     /*!
      * Constructs a basic_pci_device with invalid values for all members.
      */
-    inline basic_pci_device() : numa_(-1) {}
+    inline basic_pci_device()
+        : numa_(-1)
+        , has_parent_(false)
+        , is_virtual_function_(false)
+        , virtual_function_index_(-1)
+        , device_class_(-1)
+        , current_link_speed_(0)
+        , current_link_width_(0)
+        , max_link_speed_(0)
+        , max_link_width_(0)
+    {
+    }
 
     /*!
      * Constructs a basic_pci_device with the given values for spec, address,
@@ -69,7 +84,17 @@ class basic_pci_device
     inline basic_pci_device(const pci_device_spec &s,
                             const pci_address_wrapper_type &a,
                             const numa_type &n)
-        : spec_(s), address_(a), numa_(n)
+        : spec_(s)
+        , address_(a)
+        , numa_(n)
+        , has_parent_(false)
+        , is_virtual_function_(false)
+        , virtual_function_index_(-1)
+        , device_class_(-1)
+        , current_link_speed_(0)
+        , current_link_width_(0)
+        , max_link_speed_(0)
+        , max_link_width_(0)
     {
     }
 
@@ -108,6 +133,248 @@ class basic_pci_device
      */
     inline const numa_type &numa() const { return numa_; }
 
+    /*!
+     * Set the numa node.
+     *
+     * \param n the numa node
+     */
+    inline void numa(const numa_type &n) { numa_ = n; }
+
+    /*!
+     * Get the native identifiers of the cpus local to this device.  This may
+     * be empty if the platform does not report device locality.
+     *
+     * \return the native identifiers of the local cpus
+     */
+    inline const std::set< cpu_identifier_wrapper_type > &local_cpus() const
+    {
+        return local_cpus_;
+    }
+
+    /*!
+     * Set the native identifiers of the cpus local to this device.
+     *
+     * \param cpus the native identifiers of the local cpus
+     */
+    inline void local_cpus(const std::set< cpu_identifier_wrapper_type > &cpus)
+    {
+        local_cpus_ = cpus;
+    }
+
+    /*!
+     * Check if this device sits behind a bridge.  Devices attached directly
+     * to a root complex (root ports and integrated endpoints) have no parent.
+     *
+     * \return true if the device has a parent bridge, false otherwise
+     */
+    inline bool has_parent() const { return has_parent_; }
+
+    /*!
+     * Get the address of the bridge this device sits behind.  This is only
+     * meaningful if has_parent() returns true.
+     *
+     * \return the address of the parent bridge
+     */
+    inline const pci_address_wrapper_type &parent() const { return parent_; }
+
+    /*!
+     * Set the address of the bridge this device sits behind.
+     *
+     * \param p the address of the parent bridge
+     */
+    inline void parent(const pci_address_wrapper_type &p)
+    {
+        parent_ = p;
+        has_parent_ = true;
+    }
+
+    /*!
+     * Get the name of the root complex (pci host bridge) this device belongs
+     * to, for instance "pci0000:00".  This may be empty if the platform does
+     * not report it.
+     *
+     * \return the root complex name
+     */
+    inline const std::string &root_complex() const { return root_complex_; }
+
+    /*!
+     * Set the name of the root complex this device belongs to.
+     *
+     * \param rc the root complex name
+     */
+    inline void root_complex(const std::string &rc) { root_complex_ = rc; }
+
+    /*!
+     * Check if this device is an sr-iov virtual function.
+     *
+     * \return true if the device is a virtual function, false otherwise
+     */
+    inline bool is_virtual_function() const { return is_virtual_function_; }
+
+    /*!
+     * Get the address of the physical function this virtual function belongs
+     * to.  This is only meaningful if is_virtual_function() returns true.
+     *
+     * \return the address of the physical function
+     */
+    inline const pci_address_wrapper_type &physical_function() const
+    {
+        return physical_function_;
+    }
+
+    /*!
+     * Get the index of this virtual function on its physical function (the N
+     * in virtfnN).  This is -1 if it is unknown or the device is not a
+     * virtual function.
+     *
+     * \return the virtual function index
+     */
+    inline const int32_t &virtual_function_index() const
+    {
+        return virtual_function_index_;
+    }
+
+    /*!
+     * Mark this device as a virtual function of the given physical function.
+     *
+     * \param pf the address of the physical function
+     * \param index the virtual function index or -1 if unknown
+     */
+    inline void physical_function(const pci_address_wrapper_type &pf,
+                                  const int32_t &index = -1)
+    {
+        physical_function_ = pf;
+        is_virtual_function_ = true;
+        virtual_function_index_ = index;
+    }
+
+    /*!
+     * Get the 24 bit pci class code (base class, subclass, programming
+     * interface).  This is -1 if the platform does not report it.
+     *
+     * \return the pci class code
+     */
+    inline const pci_class_type &device_class() const { return device_class_; }
+
+    /*!
+     * Set the pci class code.
+     *
+     * \param c the pci class code
+     */
+    inline void device_class(const pci_class_type &c) { device_class_ = c; }
+
+    /*!
+     * Get the pci subsystem vendor and device ids.  Both are zero if the
+     * platform does not report them.
+     *
+     * \return the pci subsystem spec
+     */
+    inline const pci_device_spec &subsystem() const { return subsystem_; }
+
+    /*!
+     * Set the pci subsystem vendor and device ids.
+     *
+     * \param s the pci subsystem spec
+     */
+    inline void subsystem(const pci_device_spec &s) { subsystem_ = s; }
+
+    /*!
+     * Get the pci subsystem vendor id.
+     *
+     * \return the pci subsystem vendor id
+     */
+    inline const pci_vendor_id_type &subsystem_vendor() const
+    {
+        return subsystem_.vendor();
+    }
+
+    /*!
+     * Get the pci subsystem device id.
+     *
+     * \return the pci subsystem device id
+     */
+    inline const pci_device_id_type &subsystem_device() const
+    {
+        return subsystem_.device();
+    }
+
+    /*!
+     * Get the negotiated link speed in GT/s.  This is 0 if unknown.
+     *
+     * \return the current link speed
+     */
+    inline const pci_link_speed_type &current_link_speed() const
+    {
+        return current_link_speed_;
+    }
+
+    /*!
+     * Get the negotiated link width in lanes.  This is 0 if unknown.
+     *
+     * \return the current link width
+     */
+    inline const pci_link_width_type &current_link_width() const
+    {
+        return current_link_width_;
+    }
+
+    /*!
+     * Get the maximum link speed the device supports in GT/s.  This is 0 if
+     * unknown.
+     *
+     * \return the maximum link speed
+     */
+    inline const pci_link_speed_type &max_link_speed() const
+    {
+        return max_link_speed_;
+    }
+
+    /*!
+     * Get the maximum link width the device supports in lanes.  This is 0 if
+     * unknown.
+     *
+     * \return the maximum link width
+     */
+    inline const pci_link_width_type &max_link_width() const
+    {
+        return max_link_width_;
+    }
+
+    /*!
+     * Set the current and maximum link speed and width.
+     *
+     * \param current_speed the negotiated link speed in GT/s
+     * \param current_width the negotiated link width in lanes
+     * \param max_speed the maximum link speed in GT/s
+     * \param max_width the maximum link width in lanes
+     */
+    inline void link(const pci_link_speed_type &current_speed,
+                     const pci_link_width_type &current_width,
+                     const pci_link_speed_type &max_speed,
+                     const pci_link_width_type &max_width)
+    {
+        current_link_speed_ = current_speed;
+        current_link_width_ = current_width;
+        max_link_speed_ = max_speed;
+        max_link_width_ = max_width;
+    }
+
+    /*!
+     * Check if the link trained below its capability, i.e. the device is
+     * running at a lower speed or with fewer lanes than it supports.  A
+     * device in a slot narrower or slower than itself reports this too.
+     *
+     * \return true if the link is degraded, false if it is not or the link
+     *         state is unknown
+     */
+    inline bool is_link_degraded() const
+    {
+        return (current_link_speed_ > 0 && max_link_speed_ > 0 &&
+                current_link_speed_ < max_link_speed_) ||
+               (current_link_width_ > 0 && max_link_width_ > 0 &&
+                current_link_width_ < max_link_width_);
+    }
+
     /*!
      * Less than operator to allow basic_pci_device to be a key in an stl
      * maps/sets.
@@ -125,6 +392,19 @@ class basic_pci_device
     pci_device_spec spec_;
     pci_address_wrapper_type address_;
     numa_type numa_;
+    std::set< cpu_identifier_wrapper_type > local_cpus_;
+    pci_address_wrapper_type parent_;
+    bool has_parent_;
+    std::string root_complex_;
+    pci_address_wrapper_type physical_function_;
+    bool is_virtual_function_;
+    int32_t virtual_function_index_;
+    pci_class_type device_class_;
+    pci_device_spec subsystem_;
+    pci_link_speed_type current_link_speed_;
+    pci_link_width_type current_link_width_;
+    pci_link_speed_type max_link_speed_;
+    pci_link_width_type max_link_width_;
 };
 }  // namespace impl
 }  // namespace cpuaff
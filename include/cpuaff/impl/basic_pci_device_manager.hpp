@@ -35,8 +35,11 @@
 #include "../config.hpp"
 #include "basic_pci_device.hpp"
 #include "basic_pci_device_set.hpp"
+#include <algorithm>
 #include <map>
 #include <set>
+#include <string>
+#include <vector>
 
 namespace cpuaff
 {
@@ -54,6 +57,8 @@ class basic_pci_device_manager
     typedef typename TRAITS::pci_address_wrapper_type pci_address_wrapper_type;
     typedef typename TRAITS::pci_loader_type pci_loader_type;
     typedef typename TRAITS::pci_loader_vector_type pci_loader_vector_type;
+    typedef typename TRAITS::pci_address_resolver_type
+        pci_address_resolver_type;
 
     typedef basic_pci_device< TRAITS > pci_device_type;
     typedef basic_pci_device_set< TRAITS > pci_device_set_type;
@@ -98,24 +103,17 @@ class basic_pci_device_manager
      * \return true if the device is found, false otherwise.
      */
     inline bool get_pci_device_for_address(
-        pci_device_type &device, const pci_address_wrapper_type &address)
+        pci_device_type &device, const pci_address_wrapper_type &address) const
     {
-        bool retval = false;
+        const pci_device_type *d = find_device(address);
 
-        if (has_pci_devices())
+        if (d)
         {
-            typename std::map< pci_address_wrapper_type,
-                               pci_device_type >::iterator i =
-                pci_device_by_address_.find(address);
-
-            if (i != pci_device_by_address_.end())
-            {
-                device = i->second;
-                retval = true;
-            }
+            device = *d;
+            return true;
         }
 
-        return retval;
+        return false;
     }
 
     /*!
@@ -125,13 +123,43 @@ class basic_pci_device_manager
      * \param address [in] the address
      * \return true if the device is found, false otherwise.
      */
-    inline bool get_pci_device_for_address(pci_device_type &device,
-                                           const pci_address_type &address)
+    inline bool get_pci_device_for_address(
+        pci_device_type &device, const pci_address_type &address) const
     {
         return get_pci_device_for_address(device,
                                           pci_address_wrapper_type(address));
     }
 
+    /*!
+     * Get the pci device behind the given network interface (for instance
+     * "eth2").
+     *
+     * \param device [out] the pci device
+     * \param interface [in] the network interface name
+     * \return true if the device is found, false otherwise.
+     */
+    inline bool get_pci_device_for_interface(
+        pci_device_type &device, const std::string &interface) const
+    {
+        return get_pci_device_for_class_device(device, "net", interface);
+    }
+
+    /*!
+     * Get the pci device behind the given block device, partition, or nvme
+     * controller (for instance "sda", "nvme1n1p2", or "nvme0").
+     *
+     * \param device [out] the pci device
+     * \param block_device [in] the block device name
+     * \return true if the device is found, false otherwise.
+     */
+    inline bool get_pci_device_for_block_device(
+        pci_device_type &device, const std::string &block_device) const
+    {
+        return get_pci_device_for_class_device(device, "block",
+                                               block_device) ||
+               get_pci_device_for_class_device(device, "nvme", block_device);
+    }
+
     /*!
      * Get the pci devices with the given pci_device_spec
      *
@@ -211,7 +239,428 @@ class basic_pci_device_manager
         return !devices.empty();
     }
 
+    /*!
+     * Get the pci devices with the given pci class code.  The mask selects
+     * which bytes of the 24 bit class code are compared, so 0x020000 with a
+     * mask of 0xff0000 finds every network controller while 0x010802 with the
+     * default mask finds only nvme controllers.
+     *
+     * \param devices [out] the set of pci devices
+     * \param device_class [in] the pci class code
+     * \param mask [in] the bits of the class code to compare
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_pci_devices_by_class(pci_device_set_type &devices,
+                                         const pci_class_type &device_class,
+                                         const pci_class_type &mask = 0xffffff)
+    {
+        devices.clear();
+
+        if (has_pci_devices())
+        {
+            typename std::map< pci_class_type,
+                               pci_device_set_type >::const_iterator i =
+                pci_devices_by_class_.begin();
+            typename std::map< pci_class_type,
+                               pci_device_set_type >::const_iterator iend =
+                pci_devices_by_class_.end();
+
+            for (; i != iend; ++i)
+            {
+                if ((i->first & mask) == (device_class & mask))
+                {
+                    devices.insert(i->second.begin(), i->second.end());
+                }
+            }
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the bridge the given device sits behind.
+     *
+     * \param parent [out] the parent bridge
+     * \param device [in] the pci device
+     * \return true if the device has a known parent, false otherwise.
+     */
+    inline bool get_pci_parent(pci_device_type &parent,
+                               const pci_device_type &device) const
+    {
+        const pci_device_type *p = find_parent(device);
+
+        if (p)
+        {
+            parent = *p;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the devices directly behind the given bridge.
+     *
+     * \param devices [out] the set of pci devices
+     * \param device [in] the bridge
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_pci_children(pci_device_set_type &devices,
+                                 const pci_device_type &device) const
+    {
+        devices.clear();
+
+        if (has_pci_devices())
+        {
+            const pci_device_set_type *children =
+                find_group(pci_children_by_address_, device.address());
+
+            if (children)
+            {
+                devices = *children;
+            }
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get every device below the given bridge, at any depth.  The bridge
+     * itself is not included.
+     *
+     * \param devices [out] the set of pci devices
+     * \param device [in] the bridge
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_pci_devices_below(pci_device_set_type &devices,
+                                      const pci_device_type &device) const
+    {
+        devices.clear();
+
+        if (has_pci_devices())
+        {
+            add_pci_devices_below(devices, device.address());
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the chain of bridges between the given device and its root
+     * complex.  The chain is ordered from the immediate parent up to the root
+     * port.
+     *
+     * \param devices [out] the upstream bridges
+     * \param device [in] the pci device
+     * \return true if the device has at least one upstream bridge, false
+     *         otherwise.
+     */
+    inline bool get_pci_upstream_devices(
+        std::vector< pci_device_type > &devices,
+        const pci_device_type &device) const
+    {
+        devices.clear();
+
+        const pci_device_type *p = find_parent(device);
+
+        while (p)
+        {
+            devices.push_back(*p);
+            p = find_parent(*p);
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the root port the given device sits behind.  A device attached
+     * directly to the root complex is its own root port.
+     *
+     * \param port [out] the root port
+     * \param device [in] the pci device
+     * \return true if the root port is found, false otherwise.
+     */
+    inline bool get_pci_root_port(pci_device_type &port,
+                                  const pci_device_type &device) const
+    {
+        const pci_device_type *p = find_device(device.address());
+
+        if (p)
+        {
+            for (const pci_device_type *q = find_parent(*p); q;
+                 q = find_parent(*q))
+            {
+                p = q;
+            }
+
+            port = *p;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the other devices behind the same root port as the given device.
+     *
+     * \param devices [out] the set of pci devices
+     * \param device [in] the pci device
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_pci_devices_sharing_root_port(
+        pci_device_set_type &devices, const pci_device_type &device) const
+    {
+        pci_device_type port;
+        devices.clear();
+
+        if (get_pci_root_port(port, device))
+        {
+            add_pci_devices_below(devices, port.address());
+            devices.erase(device);
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the other devices behind the same pcie switch as the given device.
+     * A switch shows up as an upstream port with one downstream port per
+     * slot, so the device's parent is a downstream port and the switch is its
+     * grandparent.  Devices plugged straight into a root port share no switch.
+     *
+     * \param devices [out] the set of pci devices
+     * \param device [in] the pci device
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_pci_devices_sharing_switch(
+        pci_device_set_type &devices, const pci_device_type &device) const
+    {
+        devices.clear();
+
+        const pci_device_type *downstream = find_parent(device);
+        const pci_device_type *upstream =
+            (downstream) ? find_parent(*downstream) : NULL;
+
+        if (upstream)
+        {
+            add_pci_devices_below(devices, upstream->address());
+            devices.erase(device);
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the devices that belong to the given root complex (for instance
+     * "pci0000:00").
+     *
+     * \param devices [out] the set of pci devices
+     * \param root_complex [in] the root complex name
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_pci_devices_by_root_complex(
+        pci_device_set_type &devices, const std::string &root_complex) const
+    {
+        devices.clear();
+
+        if (has_pci_devices())
+        {
+            typename std::map< std::string,
+                               pci_device_set_type >::const_iterator i =
+                pci_devices_by_root_complex_.find(root_complex);
+
+            if (i != pci_devices_by_root_complex_.end())
+            {
+                devices = i->second;
+            }
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the other devices that belong to the same root complex as the
+     * given device.
+     *
+     * \param devices [out] the set of pci devices
+     * \param device [in] the pci device
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_pci_devices_sharing_root_complex(
+        pci_device_set_type &devices, const pci_device_type &device) const
+    {
+        get_pci_devices_by_root_complex(devices, device.root_complex());
+        devices.erase(device);
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the sr-iov virtual functions of the given physical function.
+     *
+     * \param devices [out] the set of virtual functions
+     * \param device [in] the physical function
+     * \return true if devices are found, false otherwise.
+     */
+    inline bool get_virtual_functions(pci_device_set_type &devices,
+                                      const pci_device_type &device) const
+    {
+        devices.clear();
+
+        if (has_pci_devices())
+        {
+            const pci_device_set_type *functions = find_group(
+                pci_virtual_functions_by_address_, device.address());
+
+            if (functions)
+            {
+                devices = *functions;
+            }
+        }
+
+        return !devices.empty();
+    }
+
+    /*!
+     * Get the sr-iov physical function the given virtual function belongs
+     * to.
+     *
+     * \param pf [out] the physical function
+     * \param device [in] the virtual function
+     * \return true if the physical function is found, false otherwise.
+     */
+    inline bool get_physical_function(pci_device_type &pf,
+                                      const pci_device_type &device) const
+    {
+        const pci_device_type *p =
+            (device.is_virtual_function())
+                ? find_device(device.physical_function())
+                : NULL;
+
+        if (p)
+        {
+            pf = *p;
+            return true;
+        }
+
+        return false;
+    }
+
    private:
+    // devices grouped by the address of their bridge or physical function
+    typedef std::pair< pci_address_wrapper_type, pci_device_set_type >
+        address_group_type;
+    typedef std::vector< address_group_type > address_group_vector_type;
+
+    struct address_less
+    {
+        inline bool operator()(const pci_device_type &device,
+                               const pci_address_wrapper_type &address) const
+        {
+            return device.address() < address;
+        }
+
+        inline bool operator()(const address_group_type &group,
+                               const pci_address_wrapper_type &address) const
+        {
+            return group.first < address;
+        }
+    };
+
+    static inline const pci_device_set_type *find_group(
+        const address_group_vector_type &groups,
+        const pci_address_wrapper_type &address)
+    {
+        typename address_group_vector_type::const_iterator i =
+            std::lower_bound(groups.begin(), groups.end(), address,
+                             address_less());
+
+        return (i != groups.end() && i->first == address) ? &i->second
+                                                           : NULL;
+    }
+
+    inline const pci_device_type *find_device(
+        const pci_address_wrapper_type &address) const
+    {
+        typename std::vector< pci_device_type >::const_iterator i =
+            std::lower_bound(pci_devices_by_address_.begin(),
+                             pci_devices_by_address_.end(), address,
+                             address_less());
+
+        return (i != pci_devices_by_address_.end() && i->address() == address)
+                   ? &(*i)
+                   : NULL;
+    }
+
+    inline pci_device_type *find_device(
+        const pci_address_wrapper_type &address)
+    {
+        return const_cast< pci_device_type * >(
+            static_cast< const basic_pci_device_manager * >(this)->find_device(
+                address));
+    }
+
+    inline const pci_device_type *find_parent(
+        const pci_device_type &device) const
+    {
+        return (device.has_parent()) ? find_device(device.parent()) : NULL;
+    }
+
+    inline void add_pci_devices_below(
+        pci_device_set_type &devices,
+        const pci_address_wrapper_type &address) const
+    {
+        const pci_device_set_type *children =
+            find_group(pci_children_by_address_, address);
+
+        if (children)
+        {
+            typename pci_device_set_type::const_iterator j = children->begin();
+            typename pci_device_set_type::const_iterator jend =
+                children->end();
+
+            for (; j != jend; ++j)
+            {
+                devices.insert(*j);
+                add_pci_devices_below(devices, j->address());
+            }
+        }
+    }
+
+    /*!
+     * Get the pci device closest to the given class device.
+     *
+     * \param device [out] the pci device
+     * \param device_class [in] the class of the device (net, block, etc.)
+     * \param name [in] the name of the device
+     * \return true if the device is found, false otherwise.
+     */
+    inline bool get_pci_device_for_class_device(
+        pci_device_type &device,
+        const std::string &device_class,
+        const std::string &name) const
+    {
+        std::vector< pci_address_type > addresses;
+
+        if (has_pci_devices() &&
+            pci_address_resolver_type()(addresses, device_class, name))
+        {
+            typename std::vector< pci_address_type >::const_iterator i =
+                addresses.begin();
+            typename std::vector< pci_address_type >::const_iterator iend =
+                addresses.end();
+
+            for (; i != iend; ++i)
+            {
+                if (get_pci_device_for_address(device, *i))
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
     /*!
      * Initialize a basic_pci_device_manager.  This reads the hardware layout
      * and creates the pci mappings.
@@ -232,13 +681,110 @@ class basic_pci_device_manager
         for (; k != kend; ++k)
         {
             pci_device_type device(k->spec, k->address, k->numa);
-            pci_device_by_address_[k->address] = device;
+            device.local_cpus(k->local_cpus);
+            device.device_class(k->device_class);
+            device.subsystem(k->subsystem);
+            device.link(k->current_link_speed, k->current_link_width,
+                        k->max_link_speed, k->max_link_width);
+            device.root_complex(k->root_complex);
+
+            if (!k->parent.empty())
+            {
+                device.parent(k->parent);
+            }
+
+            if (!k->physical_function.empty())
+            {
+                device.physical_function(k->physical_function);
+            }
+
+            pci_devices_by_address_.push_back(device);
+        }
+
+        std::sort(pci_devices_by_address_.begin(),
+                  pci_devices_by_address_.end());
+
+        // number the virtual functions from their physical function's
+        // virtfnN links
+        for (k = devices.begin(); k != kend; ++k)
+        {
+            for (std::size_t i = 0; i < k->virtual_functions.size(); ++i)
+            {
+                pci_device_type *vf =
+                    find_device(pci_address_wrapper_type(
+                        k->virtual_functions[i]));
+
+                if (vf)
+                {
+                    vf->physical_function(pci_address_wrapper_type(k->address),
+                                          int32_t(i));
+                }
+            }
+        }
+
+        std::map< pci_address_wrapper_type, pci_device_set_type > children;
+        std::map< pci_address_wrapper_type, pci_device_set_type > functions;
+
+        typename std::vector< pci_device_type >::iterator j =
+            pci_devices_by_address_.begin();
+        typename std::vector< pci_device_type >::iterator jend =
+            pci_devices_by_address_.end();
+
+        for (; j != jend; ++j)
+        {
+            pci_device_type &device = *j;
+
+            if (device.is_virtual_function())
+            {
+                // virtual functions often report no locality of their own but
+                // sit on the same silicon as their physical function
+                const pci_device_type *pf =
+                    find_device(device.physical_function());
+
+                if (pf)
+                {
+                    if (device.numa() < 0)
+                    {
+                        device.numa(pf->numa());
+                    }
+
+                    if (device.local_cpus().empty())
+                    {
+                        device.local_cpus(pf->local_cpus());
+                    }
+                }
+
+                functions[device.physical_function()].insert(device);
+            }
+
+            if (device.has_parent())
+            {
+                children[device.parent()].insert(device);
+            }
+
+            if (!device.root_complex().empty())
+            {
+                pci_devices_by_root_complex_[device.root_complex()].insert(
+                    device);
+            }
+
             pci_devices_.insert(device);
-            pci_devices_by_numa_[k->numa].insert(device);
-            pci_devices_by_spec_[k->spec].insert(device);
-            pci_devices_by_vendor_[k->spec.vendor()].insert(device);
+            pci_devices_by_numa_[device.numa()].insert(device);
+            pci_devices_by_spec_[device.spec()].insert(device);
+            pci_devices_by_vendor_[device.vendor()].insert(device);
+
+            if (device.device_class() >= 0)
+            {
+                pci_devices_by_class_[device.device_class()].insert(device);
+            }
         }
 
+        // the groups are only looked up by address once built, so keep them
+        // in sorted vectors like the devices themselves
+        pci_children_by_address_.assign(children.begin(), children.end());
+        pci_virtual_functions_by_address_.assign(functions.begin(),
+                                                 functions.end());
+
         return retval;
     }
 
@@ -246,9 +792,12 @@ class basic_pci_device_manager
     pci_device_set_type pci_devices_;
     std::map< numa_type, pci_device_set_type > pci_devices_by_numa_;
     std::map< pci_device_spec, pci_device_set_type > pci_devices_by_spec_;
-    std::map< pci_address_wrapper_type, pci_device_type >
-        pci_device_by_address_;
+    std::vector< pci_device_type > pci_devices_by_address_;
     std::map< pci_vendor_id_type, pci_device_set_type > pci_devices_by_vendor_;
+    std::map< pci_class_type, pci_device_set_type > pci_devices_by_class_;
+    address_group_vector_type pci_children_by_address_;
+    std::map< std::string, pci_device_set_type > pci_devices_by_root_complex_;
+    address_group_vector_type pci_virtual_functions_by_address_;
     bool loaded_pci_;
 };
 }  // namespace impl
@@ -0,0 +1,436 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <new>
+#include <stdint.h>
+#include <vector>
+
+#if !defined(CPUAFF_CACHE_LINE_SIZE)
+#define CPUAFF_CACHE_LINE_SIZE 64
+#endif
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_per_cpu holds one value of type T for every cpu of an affinity
+ * manager.  Each value starts on its own cache line so that threads on
+ * different cpus never share a line, and the values of the cpus of a numa
+ * node are allocated together on that node (where the platform supports
+ * page placement).  local() finds the value of the cpu the calling thread is
+ * running on without allocating or taking locks.
+ *
+ * Nothing synchronizes access to the values.  A thread that is not pinned
+ * can migrate between looking up its value and using it, and the reductions
+ * read values that other threads may be writing, so values that are updated
+ * from several threads should be updated with atomic operations.
+ */
+template < typename TRAITS, typename T >
+class basic_per_cpu
+{
+   public:
+    typedef T value_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+    typedef typename TRAITS::node_allocator_type node_allocator_type;
+#endif
+
+   public:
+    /*!
+     * Construct a basic_per_cpu with a copy of initial for every cpu.  If the
+     * affinity manager has no cpus a single value is created, which local()
+     * then always returns and which belongs to no numa node, socket or last
+     * level cache.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     * \param initial the value every cpu starts with
+     */
+    inline basic_per_cpu(const affinity_manager_type &affinity_manager,
+                         const T &initial = T())
+        : affinity_manager_(affinity_manager),
+          stride_(((sizeof(T) + CPUAFF_CACHE_LINE_SIZE - 1) /
+                   CPUAFF_CACHE_LINE_SIZE) *
+                  CPUAFF_CACHE_LINE_SIZE)
+    {
+        cpu_set_type cpus;
+        affinity_manager_.get_cpus(cpus);
+        cpus_.assign(cpus.begin(), cpus.end());
+
+        std::map< numa_type, std::vector< std::size_t > > indexes_by_numa;
+
+        for (std::size_t i = 0; i < cpus_.size(); ++i)
+        {
+            indexes_by_numa[cpus_[i].numa()].push_back(i);
+        }
+
+        if (cpus_.empty())
+        {
+            indexes_by_numa[numa_type(-1)].push_back(0);
+        }
+
+        values_.resize(std::max(cpus_.size(), std::size_t(1)), NULL);
+
+        typename std::map< numa_type, std::vector< std::size_t > >::iterator
+            i = indexes_by_numa.begin();
+        typename std::map< numa_type, std::vector< std::size_t > >::iterator
+            iend = indexes_by_numa.end();
+
+        // reserve up front so that push_back cannot throw once a block has
+        // been allocated
+        blocks_.reserve(indexes_by_numa.size());
+
+        try
+        {
+            for (; i != iend; ++i)
+            {
+                block b = allocate(i->second.size() * stride_, i->first);
+                blocks_.push_back(b);
+
+                for (std::size_t j = 0; j < i->second.size(); ++j)
+                {
+                    values_[i->second[j]] =
+                        new (b.values + j * stride_) T(initial);
+                }
+            }
+        }
+        catch (...)
+        {
+            // the destructor will not run, so release what was built so far
+            release();
+            throw;
+        }
+    }
+
+    inline ~basic_per_cpu() { release(); }
+
+    /*!
+     * Get the number of values, which is the number of cpus.
+     */
+    inline std::size_t size() const { return values_.size(); }
+
+    /*!
+     * Get the value of the cpu the calling thread is running on.  If the
+     * current cpu cannot be determined the value of the cpu with index 0 is
+     * returned.
+     */
+    inline T &local() { return *values_[current_index()]; }
+
+    /*!
+     * Get the value of the cpu the calling thread is running on.
+     */
+    inline const T &local() const { return *values_[current_index()]; }
+
+    /*!
+     * Get the value of the cpu with the given affinity manager index.
+     */
+    inline T &operator[](const int32_t index) { return *values_[index]; }
+
+    /*!
+     * Get the value of the cpu with the given affinity manager index.
+     */
+    inline const T &operator[](const int32_t index) const
+    {
+        return *values_[index];
+    }
+
+    /*!
+     * Get the value of a cpu.
+     *
+     * \param value [out] the value of the cpu
+     * \param cpu [in] the cpu
+     * \return true if the cpu is managed by the affinity manager, false
+     * otherwise.
+     */
+    inline bool get(T *&value, const cpu_type &cpu)
+    {
+        int32_t index;
+
+        if (affinity_manager_.get_index_from_cpu(index, cpu))
+        {
+            value = values_[index];
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Combine the values of every cpu.
+     *
+     * \param op a functor taking the result so far and a value and returning
+     * the new result
+     * \param initial the result to start from
+     * \return the combined value.
+     */
+    template < typename OP >
+    inline T reduce(OP op, const T &initial) const
+    {
+        T result = initial;
+
+        for (std::size_t i = 0; i < values_.size(); ++i)
+        {
+            result = op(result, *values_[i]);
+        }
+
+        return result;
+    }
+
+    /*!
+     * Combine the values of a set of cpus.  cpus that are not managed by the
+     * affinity manager are ignored.
+     *
+     * \param cpus the cpus to combine
+     * \param op a functor taking the result so far and a value and returning
+     * the new result
+     * \param initial the result to start from
+     * \return the combined value.
+     */
+    template < typename OP >
+    inline T reduce(const cpu_set_type &cpus, OP op, const T &initial) const
+    {
+        T result = initial;
+
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            int32_t index;
+
+            if (affinity_manager_.get_index_from_cpu(index, *i))
+            {
+                result = op(result, *values_[index]);
+            }
+        }
+
+        return result;
+    }
+
+    /*!
+     * Combine the values of the cpus of each numa node.
+     *
+     * \param results [out] the combined values keyed by numa node
+     * \param op [in] a functor taking the result so far and a value and
+     * returning the new result
+     * \param initial [in] the result each node starts from
+     */
+    template < typename OP >
+    inline void reduce_by_numa(std::map< numa_type, T > &results,
+                               OP op,
+                               const T &initial) const
+    {
+        reduce_by(results, &cpu_type::numa, op, initial);
+    }
+
+    /*!
+     * Combine the values of the cpus of each socket.
+     *
+     * \param results [out] the combined values keyed by socket
+     * \param op [in] a functor taking the result so far and a value and
+     * returning the new result
+     * \param initial [in] the result each socket starts from
+     */
+    template < typename OP >
+    inline void reduce_by_socket(std::map< socket_type, T > &results,
+                                 OP op,
+                                 const T &initial) const
+    {
+        reduce_by(results, &cpu_type::socket, op, initial);
+    }
+
+    /*!
+     * Combine the values of the cpus sharing each last level cache.  cpus
+     * whose last level cache is unknown are left out.
+     *
+     * \param results [out] the combined values keyed by last level cache
+     * \param op [in] a functor taking the result so far and a value and
+     * returning the new result
+     * \param initial [in] the result each cache starts from
+     */
+    template < typename OP >
+    inline void reduce_by_llc(std::map< llc_type, T > &results,
+                              OP op,
+                              const T &initial) const
+    {
+        reduce_by(results, &cpu_type::llc, op, initial);
+        results.erase(llc_type(-1));
+    }
+
+    /*!
+     * Add up the values of every cpu.
+     */
+    inline T sum() const { return reduce(std::plus< T >(), T()); }
+
+    /*!
+     * Add up the values of the cpus of each numa node.
+     */
+    inline void sum_by_numa(std::map< numa_type, T > &results) const
+    {
+        reduce_by_numa(results, std::plus< T >(), T());
+    }
+
+    /*!
+     * Add up the values of the cpus of each socket.
+     */
+    inline void sum_by_socket(std::map< socket_type, T > &results) const
+    {
+        reduce_by_socket(results, std::plus< T >(), T());
+    }
+
+    /*!
+     * Add up the values of the cpus sharing each last level cache.
+     */
+    inline void sum_by_llc(std::map< llc_type, T > &results) const
+    {
+        reduce_by_llc(results, std::plus< T >(), T());
+    }
+
+   private:
+    basic_per_cpu(const basic_per_cpu &);
+    basic_per_cpu &operator=(const basic_per_cpu &);
+
+    struct block
+    {
+        void *buffer;
+        std::size_t length;
+        char *values;
+    };
+
+    inline void release()
+    {
+        for (std::size_t i = 0; i < values_.size(); ++i)
+        {
+            if (values_[i])
+            {
+                values_[i]->~T();
+            }
+        }
+
+        for (std::size_t i = 0; i < blocks_.size(); ++i)
+        {
+            deallocate(blocks_[i]);
+        }
+    }
+
+    inline std::size_t current_index() const
+    {
+        int32_t index;
+
+        if (affinity_manager_.get_current_cpu_index(index) &&
+            std::size_t(index) < values_.size())
+        {
+            return std::size_t(index);
+        }
+
+        return 0;
+    }
+
+    template < typename KEY, typename OP >
+    inline void reduce_by(std::map< KEY, T > &results,
+                          const KEY &(cpu_type::*key)() const,
+                          OP op,
+                          const T &initial) const
+    {
+        results.clear();
+
+        for (std::size_t i = 0; i < cpus_.size(); ++i)
+        {
+            const KEY &k = (cpus_[i].*key)();
+            typename std::map< KEY, T >::iterator j = results.find(k);
+
+            if (j == results.end())
+            {
+                j = results.insert(std::make_pair(k, initial)).first;
+            }
+
+            j->second = op(j->second, *values_[i]);
+        }
+    }
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+    inline block allocate(std::size_t length, const numa_type &numa)
+    {
+        block b;
+        b.length = length;
+        b.buffer = node_allocator_type().allocate(length, numa);
+
+        if (!b.buffer)
+        {
+            throw std::bad_alloc();
+        }
+
+        // the allocation is page aligned
+        b.values = static_cast< char * >(b.buffer);
+        return b;
+    }
+
+    inline void deallocate(const block &b)
+    {
+        node_allocator_type().deallocate(b.buffer, b.length);
+    }
+#else
+    inline block allocate(std::size_t length, const numa_type &)
+    {
+        block b;
+        b.length = length + CPUAFF_CACHE_LINE_SIZE;
+        b.buffer = ::operator new(b.length);
+
+        uintptr_t aligned = (uintptr_t(b.buffer) + CPUAFF_CACHE_LINE_SIZE - 1) &
+                            ~uintptr_t(CPUAFF_CACHE_LINE_SIZE - 1);
+        b.values = reinterpret_cast< char * >(aligned);
+        return b;
+    }
+
+    inline void deallocate(const block &b) { ::operator delete(b.buffer); }
+#endif
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    std::size_t stride_;
+    std::vector< cpu_type > cpus_;
+    std::vector< T * > values_;
+    std::vector< block > blocks_;
+};
+}  // namespace impl
+}  // namespace cpuaff
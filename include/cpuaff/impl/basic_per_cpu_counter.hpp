@@ -0,0 +1,189 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "atomic.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_per_cpu_words.hpp"
+#include <cstddef>
+#include <stdint.h>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_per_cpu_counter is a counter split into one word per cpu.  A thread
+ * updates the word of the cpu it is running on, with a restartable sequence
+ * that commits with a plain add where the platform supports them and with an
+ * atomic add otherwise, so updates from different cpus never contend.
+ * Reading the total sums the words of every cpu.
+ */
+template < typename TRAITS >
+class basic_per_cpu_counter
+{
+   public:
+    typedef intptr_t value_type;
+    typedef typename TRAITS::cpu_identifier_type cpu_identifier_type;
+    typedef typename TRAITS::per_cpu_ops_type per_cpu_ops_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_per_cpu_words< TRAITS > words_type;
+    typedef typename words_type::word word_type;
+
+   public:
+    /*!
+     * Construct a basic_per_cpu_counter with every cpu at zero.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     */
+    inline basic_per_cpu_counter(const affinity_manager_type &affinity_manager)
+        : words_(affinity_manager)
+    {
+    }
+
+    /*!
+     * Check whether the counter is updated with restartable sequences.
+     */
+    inline bool uses_rseq() const { return words_.uses_rseq(); }
+
+    /*!
+     * Get the number of cpus.
+     */
+    inline std::size_t size() const { return words_.size(); }
+
+    /*!
+     * Add to the value of the current cpu.
+     *
+     * \param delta the amount to add
+     */
+    inline void add(const value_type &delta)
+    {
+        for (;;)
+        {
+            word_type *w;
+            cpu_identifier_type id;
+
+            if (!words_.locate(w, id))
+            {
+                atomic::fetch_add(w->value, delta);
+                return;
+            }
+
+            if (per_cpu_ops_type().add(&w->value, delta, id) == 0)
+            {
+                return;
+            }
+        }
+    }
+
+    /*!
+     * Add one to the value of the current cpu.
+     */
+    inline void increment() { add(1); }
+
+    /*!
+     * Replace the value of the current cpu if it is what the caller expects.
+     * The current cpu can change between reading the value with local() and
+     * calling compare_and_store(), in which case the values will generally
+     * not match.
+     *
+     * \param expected the value the current cpu must have
+     * \param desired the value to replace it with
+     * \return true if the value was replaced, false otherwise.
+     */
+    inline bool compare_and_store(const value_type &expected,
+                                  const value_type &desired)
+    {
+        for (;;)
+        {
+            word_type *w;
+            cpu_identifier_type id;
+
+            if (!words_.locate(w, id))
+            {
+                return atomic::compare_exchange(w->value, expected, desired);
+            }
+
+            int result = per_cpu_ops_type().compare_and_store(
+                &w->value, expected, desired, id);
+
+            if (result >= 0)
+            {
+                return result == 0;
+            }
+        }
+    }
+
+    /*!
+     * Get the value of the current cpu.
+     */
+    inline value_type local()
+    {
+        word_type *w;
+        cpu_identifier_type id;
+        words_.locate(w, id);
+
+        return atomic::load(w->value);
+    }
+
+    /*!
+     * Get the value of the cpu with the given affinity manager index.
+     */
+    inline value_type get(const int32_t index) const
+    {
+        return atomic::load(words_[index].value);
+    }
+
+    /*!
+     * Get the total over every cpu.
+     */
+    inline value_type sum() const
+    {
+        value_type total = atomic::load(words_.overflow().value);
+
+        for (std::size_t i = 0; i < words_.size(); ++i)
+        {
+            total += atomic::load(words_[int32_t(i)].value);
+        }
+
+        return total;
+    }
+
+   private:
+    basic_per_cpu_counter(const basic_per_cpu_counter &);
+    basic_per_cpu_counter &operator=(const basic_per_cpu_counter &);
+
+   private:
+    words_type words_;
+};
+}  // namespace impl
+}  // namespace cpuaff
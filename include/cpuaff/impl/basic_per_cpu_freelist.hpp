@@ -0,0 +1,246 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "atomic.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_per_cpu_words.hpp"
+#include <cstddef>
+#include <stdint.h>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * The link basic_per_cpu_freelist threads its entries with.  Types kept in a
+ * basic_per_cpu_freelist derive from it.
+ */
+struct per_cpu_freelist_node
+{
+    inline per_cpu_freelist_node() : next(NULL) {}
+
+    per_cpu_freelist_node *next;
+};
+
+/*!
+ * basic_per_cpu_freelist is an intrusive stack per cpu, for instance of
+ * free objects.  push() and pop() work on the stack of the cpu the calling
+ * thread is running on, with restartable sequences that commit with a plain
+ * store where the platform supports them and with atomic operations
+ * otherwise.  pop() does not take entries from the stacks of other cpus; a
+ * caller that finds its stack empty should fall back to its own allocator.
+ *
+ * T must derive from per_cpu_freelist_node.  The freelist does not own its
+ * entries.  A pop that races with another may read the link of an entry the
+ * other has just taken, so entries must stay mapped, for instance in a pool,
+ * for as long as the freelist is in use.
+ */
+template < typename TRAITS, typename T >
+class basic_per_cpu_freelist
+{
+   public:
+    typedef T value_type;
+    typedef typename TRAITS::cpu_identifier_type cpu_identifier_type;
+    typedef typename TRAITS::per_cpu_ops_type per_cpu_ops_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_per_cpu_words< TRAITS > words_type;
+    typedef typename words_type::word word_type;
+
+   public:
+    /*!
+     * Construct a basic_per_cpu_freelist with every stack empty.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     */
+    inline basic_per_cpu_freelist(
+        const affinity_manager_type &affinity_manager)
+        : words_(affinity_manager)
+    {
+    }
+
+    /*!
+     * Check whether the stacks are updated with restartable sequences.
+     */
+    inline bool uses_rseq() const { return words_.uses_rseq(); }
+
+    /*!
+     * Get the number of cpus.
+     */
+    inline std::size_t size() const { return words_.size(); }
+
+    /*!
+     * Push an entry onto the stack of the current cpu.
+     *
+     * \param entry the entry
+     */
+    inline void push(T *entry)
+    {
+        per_cpu_freelist_node *node = entry;
+
+        for (;;)
+        {
+            word_type *w;
+            cpu_identifier_type id;
+            bool rseq = words_.locate(w, id);
+
+            intptr_t head = atomic::load(w->value);
+            node->next = reinterpret_cast< per_cpu_freelist_node * >(head);
+
+            if (rseq)
+            {
+                if (per_cpu_ops_type().compare_and_store(
+                        &w->value, head, intptr_t(node), id) == 0)
+                {
+                    return;
+                }
+            }
+            else if (atomic::compare_exchange(w->value, head, intptr_t(node)))
+            {
+                return;
+            }
+        }
+    }
+
+    /*!
+     * Pop an entry from the stack of the current cpu.
+     *
+     * \return the entry, or NULL if the stack is empty.
+     */
+    inline T *pop()
+    {
+        for (;;)
+        {
+            word_type *w;
+            cpu_identifier_type id;
+
+            if (!words_.locate(w, id))
+            {
+                T *entry = pop_atomic(*w);
+
+                if (entry || w == &words_.overflow())
+                {
+                    return entry;
+                }
+
+                return pop_atomic(words_.overflow());
+            }
+
+            intptr_t popped;
+            int result = per_cpu_ops_type().pop(&w->value, popped, id);
+
+            if (result == 0)
+            {
+                return static_cast< T * >(
+                    reinterpret_cast< per_cpu_freelist_node * >(popped));
+            }
+            else if (result > 0)
+            {
+                return pop_atomic(words_.overflow());
+            }
+        }
+    }
+
+    /*!
+     * Check whether the stack of the cpu with the given affinity manager
+     * index is empty.
+     */
+    inline bool empty(const int32_t index) const
+    {
+        return atomic::load(words_[index].value) == 0;
+    }
+
+   private:
+    basic_per_cpu_freelist(const basic_per_cpu_freelist &);
+    basic_per_cpu_freelist &operator=(const basic_per_cpu_freelist &);
+
+#if defined(CPUAFF_ATOMIC_PAIR_SUPPORTED)
+    // every pop bumps the generation of the word and swaps it together with
+    // the head, so a pop fails if the head was popped and pushed back under
+    // it (ABA); pushes only need the compare and swap of the head
+    inline T *pop_atomic(word_type &w)
+    {
+        for (;;)
+        {
+            intptr_t generation = atomic::load(w.generation);
+            intptr_t head = atomic::load(w.value);
+
+            if (head == 0)
+            {
+                return NULL;
+            }
+
+            per_cpu_freelist_node *node =
+                reinterpret_cast< per_cpu_freelist_node * >(head);
+
+            intptr_t next = intptr_t(node->next);
+            intptr_t bumped = intptr_t(uintptr_t(generation) + 1);
+
+            if (atomic::compare_exchange_pair(&w.value, head, generation, next,
+                                              bumped))
+            {
+                return static_cast< T * >(node);
+            }
+        }
+    }
+#else
+    // pops are serialized so that an entry cannot be popped and pushed back
+    // under a concurrent pop (ABA); pushes only need the compare and swap
+    inline T *pop_atomic(word_type &w)
+    {
+        mutex_guard guard(w.lock);
+
+        for (;;)
+        {
+            intptr_t head = atomic::load(w.value);
+
+            if (head == 0)
+            {
+                return NULL;
+            }
+
+            per_cpu_freelist_node *node =
+                reinterpret_cast< per_cpu_freelist_node * >(head);
+
+            if (atomic::compare_exchange(w.value, head, intptr_t(node->next)))
+            {
+                return static_cast< T * >(node);
+            }
+        }
+    }
+#endif
+
+   private:
+    words_type words_;
+};
+}  // namespace impl
+}  // namespace cpuaff
@@ -0,0 +1,169 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "atomic.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_per_cpu.hpp"
+#include "mutex.hpp"
+#include <cstddef>
+#include <stdint.h>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_per_cpu_words is the storage shared by basic_per_cpu_counter and
+ * basic_per_cpu_freelist: one padded, node local word per cpu and an
+ * overflow word for threads whose cpu the affinity manager does not know.
+ *
+ * Where the calling thread can use restartable sequences when the words are
+ * created, the word of each cpu is only ever updated from that cpu, with
+ * restartable sequences, and the overflow word is updated with atomic
+ * operations.  Elsewhere every word is updated with atomic operations, and
+ * threads update the word of the cpu they are running on to keep the words
+ * local.
+ */
+template < typename TRAITS >
+class basic_per_cpu_words
+{
+   public:
+    typedef typename TRAITS::cpu_identifier_type cpu_identifier_type;
+    typedef typename TRAITS::per_cpu_ops_type per_cpu_ops_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+
+#if defined(CPUAFF_ATOMIC_PAIR_SUPPORTED)
+    struct word
+    {
+        inline word(const intptr_t &v = 0) : value(v), generation(0) {}
+        inline word(const word &rhs) : value(rhs.value), generation(0) {}
+
+        volatile intptr_t value;
+
+        // counts pops from the word when it is updated atomically; swapped
+        // together with value so that a pop cannot succeed against a head
+        // that was popped and pushed back in the meantime (ABA)
+        volatile intptr_t generation;
+    } __attribute__((aligned(2 * sizeof(intptr_t))));
+#else
+    struct word
+    {
+        inline word(const intptr_t &v = 0) : value(v) {}
+        inline word(const word &rhs) : value(rhs.value) {}
+
+        volatile intptr_t value;
+
+        // serializes pops from the word when it is updated atomically and
+        // the platform has no double width compare and swap
+        mutex lock;
+    };
+#endif
+
+   public:
+    inline basic_per_cpu_words(const affinity_manager_type &affinity_manager,
+                               const intptr_t &initial = 0)
+        : affinity_manager_(affinity_manager),
+          words_(affinity_manager, word(initial)),
+          rseq_(per_cpu_ops_type().available()),
+          overflow_(initial)
+    {
+    }
+
+    /*!
+     * Check whether the words are updated with restartable sequences.
+     */
+    inline bool uses_rseq() const { return rseq_; }
+
+    /*!
+     * Get the number of per cpu words, not counting the overflow word.
+     */
+    inline std::size_t size() const { return words_.size(); }
+
+    inline word &operator[](const int32_t index) { return words_[index]; }
+
+    inline const word &operator[](const int32_t index) const
+    {
+        return words_[index];
+    }
+
+    inline word &overflow() { return overflow_; }
+    inline const word &overflow() const { return overflow_; }
+
+    /*!
+     * Find the word the calling thread should update.
+     *
+     * \param w [out] the word
+     * \param id [out] the cpu the thread must be running on to update the
+     * word with a restartable sequence
+     * \return true if the word must be updated with a restartable sequence,
+     * false if it must be updated atomically.
+     */
+    inline bool locate(word *&w, cpu_identifier_type &id)
+    {
+        int32_t index;
+
+        if (rseq_)
+        {
+            if (per_cpu_ops_type().current_cpu(id) &&
+                affinity_manager_.get_index_from_id(index, id))
+            {
+                w = &words_[index];
+                return true;
+            }
+        }
+        else if (affinity_manager_.get_current_cpu_index(index))
+        {
+            w = &words_[index];
+            return false;
+        }
+
+        w = &overflow_;
+        return false;
+    }
+
+   private:
+    basic_per_cpu_words(const basic_per_cpu_words &);
+    basic_per_cpu_words &operator=(const basic_per_cpu_words &);
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    basic_per_cpu< TRAITS, word > words_;
+    bool rseq_;
+
+    // keep the overflow word off the lines of the members around it
+    char before_[CPUAFF_CACHE_LINE_SIZE];
+    word overflow_;
+    char after_[CPUAFF_CACHE_LINE_SIZE];
+};
+}  // namespace impl
+}  // namespace cpuaff
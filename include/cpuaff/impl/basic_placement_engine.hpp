@@ -0,0 +1,311 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "../placement_policy.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_placement_engine orders a set of cpus according to a
+ * placement_policy.  The result depends only on the topology of the cpus it
+ * was given, so the same policy always yields the same placement and
+ * placements can be compared against each other run to run.
+ */
+template < typename TRAITS >
+class basic_placement_engine
+{
+   public:
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+
+   public:
+    /*!
+     * Constructs a basic_placement_engine over the given set of cpus.
+     *
+     * \param cpus the cpus to place onto
+     */
+    inline basic_placement_engine(const cpu_set_type &cpus)
+        : cpus_(cpus.begin(), cpus.end())
+    {
+        std::sort(cpus_.begin(), cpus_.end(), compact_less());
+    }
+
+    /*!
+     * Get the number of cpus this engine places onto.
+     *
+     * \return the number of cpus
+     */
+    inline std::size_t size() const { return cpus_.size(); }
+
+    /*!
+     * Get every cpu in the order the given policy hands them out.
+     *
+     * \param cpus [out] the ordered cpus
+     * \param policy [in] the placement policy
+     * \return true if there are cpus, false otherwise.
+     */
+    inline bool get_order(std::vector< cpu_type > &cpus,
+                          const placement_policy &policy) const
+    {
+        cpus.clear();
+
+        switch (policy.kind())
+        {
+            case placement_policy::compact_kind:
+                cpus = cpus_;
+                break;
+
+            case placement_policy::scatter_kind:
+            {
+                const placement_level::type levels[] = {
+                    placement_level::socket, placement_level::numa,
+                    placement_level::core};
+                interleave(cpus, cpus_, levels, 3);
+                break;
+            }
+
+            case placement_policy::numa_balanced_kind:
+            {
+                const placement_level::type levels[] = {placement_level::numa,
+                                                        placement_level::core};
+                interleave(cpus, cpus_, levels, 2);
+                break;
+            }
+
+            case placement_policy::spread_kind:
+            {
+                const placement_level::type levels[] = {policy.level()};
+                interleave(cpus, cpus_, levels, 1);
+                break;
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    /*!
+     * Get the first count cpus of the given policy's order, one per thread.
+     *
+     * \param cpus [out] the ordered cpus
+     * \param policy [in] the placement policy
+     * \param count [in] the number of cpus
+     * \return true if count cpus were placed, false if there are fewer than
+     *         count cpus.
+     */
+    inline bool place(std::vector< cpu_type > &cpus,
+                      const placement_policy &policy,
+                      std::size_t count) const
+    {
+        cpus.clear();
+
+        if (count > cpus_.size())
+        {
+            return false;
+        }
+
+        get_order(cpus, policy);
+        cpus.resize(count);
+        return true;
+    }
+
+    /*!
+     * Get count places of the given granularity in the order of the given
+     * policy.  Each place is the set of cpus making up one unit of the
+     * granularity, so placing with a granularity of core gives every thread
+     * a whole core including its hyperthread siblings.
+     *
+     * \param places [out] the ordered places
+     * \param policy [in] the placement policy
+     * \param count [in] the number of places
+     * \param granularity [in] the level each place covers
+     * \return true if count places were placed, false if there are fewer
+     *         than count units of the granularity.
+     */
+    inline bool place(
+        std::vector< cpu_set_type > &places,
+        const placement_policy &policy,
+        std::size_t count,
+        const placement_level::type &granularity = placement_level::core) const
+    {
+        places.clear();
+
+        std::vector< cpu_type > order;
+        get_order(order, policy);
+
+        std::map< key_type, std::size_t > place_by_key;
+        typename std::vector< cpu_type >::const_iterator i = order.begin();
+        typename std::vector< cpu_type >::const_iterator iend = order.end();
+
+        for (; i != iend; ++i)
+        {
+            key_type key = make_key(*i, granularity);
+            typename std::map< key_type, std::size_t >::iterator j =
+                place_by_key.find(key);
+
+            if (j == place_by_key.end())
+            {
+                j = place_by_key.insert(std::make_pair(key, places.size()))
+                        .first;
+                places.push_back(cpu_set_type());
+            }
+
+            places[j->second].insert(*i);
+        }
+
+        if (count > places.size())
+        {
+            places.clear();
+            return false;
+        }
+
+        places.resize(count);
+        return true;
+    }
+
+   private:
+    typedef std::pair< int32_t, std::pair< int32_t, int32_t > > key_type;
+
+    struct compact_less
+    {
+        inline bool operator()(const cpu_type &lhs, const cpu_type &rhs) const
+        {
+            if (lhs.socket() != rhs.socket())
+            {
+                return lhs.socket() < rhs.socket();
+            }
+            else if (lhs.numa() != rhs.numa())
+            {
+                return lhs.numa() < rhs.numa();
+            }
+            else if (lhs.core() != rhs.core())
+            {
+                return lhs.core() < rhs.core();
+            }
+            else if (lhs.processing_unit() != rhs.processing_unit())
+            {
+                return lhs.processing_unit() < rhs.processing_unit();
+            }
+
+            return lhs < rhs;
+        }
+    };
+
+    /*!
+     * Get the key of the unit of the given level a cpu belongs to.
+     */
+    static inline key_type make_key(const cpu_type &cpu,
+                                    const placement_level::type &level)
+    {
+        switch (level)
+        {
+            case placement_level::socket:
+                return key_type(cpu.socket(), std::make_pair(0, 0));
+            case placement_level::numa:
+                return key_type(cpu.numa(), std::make_pair(0, 0));
+            case placement_level::core:
+                return key_type(cpu.socket(),
+                                std::make_pair(cpu.core(), int32_t(0)));
+            default:
+                return key_type(
+                    cpu.socket(),
+                    std::make_pair(cpu.core(), int32_t(cpu.processing_unit())));
+        }
+    }
+
+    /*!
+     * Order cpus by grouping them by the first level, ordering each group by
+     * the remaining levels, and then taking one cpu from each group in turn.
+     * The input must be in compact order and each group stays in compact
+     * order once the levels run out.
+     */
+    static inline void interleave(std::vector< cpu_type > &out,
+                                  const std::vector< cpu_type > &cpus,
+                                  const placement_level::type *levels,
+                                  std::size_t level_count)
+    {
+        if (level_count == 0)
+        {
+            out.insert(out.end(), cpus.begin(), cpus.end());
+            return;
+        }
+
+        std::map< key_type, std::vector< cpu_type > > groups;
+        typename std::vector< cpu_type >::const_iterator i = cpus.begin();
+        typename std::vector< cpu_type >::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            groups[make_key(*i, levels[0])].push_back(*i);
+        }
+
+        std::vector< std::vector< cpu_type > > ordered;
+        ordered.reserve(groups.size());
+
+        typename std::map< key_type, std::vector< cpu_type > >::const_iterator
+            j = groups.begin();
+        typename std::map< key_type, std::vector< cpu_type > >::const_iterator
+            jend = groups.end();
+
+        for (; j != jend; ++j)
+        {
+            ordered.push_back(std::vector< cpu_type >());
+            interleave(ordered.back(), j->second, levels + 1, level_count - 1);
+        }
+
+        std::size_t start = out.size();
+
+        for (std::size_t n = 0; out.size() - start < cpus.size(); ++n)
+        {
+            for (std::size_t g = 0; g < ordered.size(); ++g)
+            {
+                if (n < ordered[g].size())
+                {
+                    out.push_back(ordered[g][n]);
+                }
+            }
+        }
+    }
+
+   private:
+    std::vector< cpu_type > cpus_;
+};
+}  // namespace impl
+}  // namespace cpuaff
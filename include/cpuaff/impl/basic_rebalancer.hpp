@@ -0,0 +1,572 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED) && \
+    defined(CPUAFF_CPU_LOAD_SUPPORTED)
+
+#include "../config.hpp"
+#include "../cpu_times.hpp"
+#include "../placement_policy.hpp"
+#include "../sched_stats.hpp"
+#include "atomic.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_load_sampler.hpp"
+#include "basic_cpu_set.hpp"
+#include "basic_thread_registry.hpp"
+#include "mutex.hpp"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_rebalancer watches groups of threads that are allowed to float over
+ * a set of cpus and steers them away from hot cpus.  A group is the threads
+ * registered in a basic_thread_registry under one role name, and the cpus
+ * they registered with are the cpus they may float over.
+ *
+ * Every round the rebalancer samples the load of every cpu and the run
+ * queue wait of every thread in its groups.  A thread that stays contended
+ * for rebalance_policy::patience rounds is moved to the least loaded last
+ * level cache domain of its numa node if that is clearly less loaded, or
+ * otherwise has its mask narrowed to the cpus of its current domain that are
+ * not hot.  Moves never cross a numa node and always keep a thread within a
+ * single cache domain.  A moved thread is left alone for
+ * rebalance_policy::cooldown rounds and gets its full cpu set back after
+ * rebalance_policy::relax_after calm rounds.
+ *
+ * Threads whose masks are narrowed no longer match their registration, so a
+ * drift_auditor watching the same registry will report them.
+ *
+ * A round reads /proc and calls sched_setaffinity without holding the lock
+ * that add_group(), remove_group() and get_mask() wait on.
+ */
+template < typename TRAITS >
+class basic_rebalancer
+{
+   public:
+    typedef typename TRAITS::thread_control_type thread_control_type;
+    typedef typename TRAITS::periodic_runner_type periodic_runner_type;
+    typedef typename TRAITS::cpu_identifier_wrapper_type
+        cpu_identifier_wrapper_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+    typedef basic_cpu_load_sampler< TRAITS > cpu_load_sampler_type;
+    typedef basic_thread_registry< TRAITS > thread_registry_type;
+    typedef basic_thread_placement< TRAITS > thread_placement_type;
+
+   public:
+    /*!
+     * Construct a basic_rebalancer for groups of threads of a registry.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     * \param registry the thread registry the groups are registered in
+     * \param policy the thresholds to act on
+     * \param proc_root where procfs is mounted
+     */
+    inline basic_rebalancer(const affinity_manager_type &affinity_manager,
+                            const thread_registry_type &registry,
+                            const rebalance_policy &policy = rebalance_policy(),
+                            const std::string &proc_root = "/proc")
+        : affinity_manager_(affinity_manager)
+        , registry_(registry)
+        , policy_(policy)
+        , load_(affinity_manager, proc_root)
+        , rounds_(0)
+        , contentions_(0)
+        , moves_(0)
+        , narrows_(0)
+        , widens_(0)
+    {
+    }
+
+    inline ~basic_rebalancer() { stop(); }
+
+    /*!
+     * Balance the threads registered under a role name.
+     *
+     * \param name [in] the role name
+     */
+    inline void add_group(const std::string &name)
+    {
+        mutex_guard guard(lock_);
+        groups_.insert(name);
+    }
+
+    /*!
+     * Stop balancing the threads registered under a role name.  Threads the
+     * rebalancer moved or narrowed get their full cpu set back.  This waits
+     * for a round in progress.
+     *
+     * \param name [in] the role name
+     * \return true if the group was being balanced, false otherwise.
+     */
+    inline bool remove_group(const std::string &name)
+    {
+        mutex_guard round_guard(round_lock_);
+        std::map< thread_id_type, thread_state > states;
+
+        {
+            mutex_guard guard(lock_);
+
+            if (groups_.erase(name) == 0)
+            {
+                return false;
+            }
+
+            states = states_;
+        }
+
+        typename std::map< thread_id_type, thread_state >::iterator i =
+            states.begin();
+
+        while (i != states.end())
+        {
+            if (i->second.name == name)
+            {
+                restore(i->second, i->first);
+                states.erase(i++);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        mutex_guard guard(lock_);
+        states_.swap(states);
+        return true;
+    }
+
+    /*!
+     * Start rebalancing on a background thread.
+     *
+     * \param interval_ms [in] the time between rounds in milliseconds
+     * \return true if the background thread was started, false if it was
+     *         already running or could not be created.
+     */
+    inline bool start(const uint64_t &interval_ms = 1000)
+    {
+        return runner_.start(&basic_rebalancer::tick, this,
+                             interval_ms * uint64_t(1000000));
+    }
+
+    /*!
+     * Stop the background thread, waiting for a round in progress.
+     */
+    inline void stop() { runner_.stop(); }
+
+    /*!
+     * Check if the background thread is running.
+     *
+     * \return true if rebalancing in the background, false otherwise
+     */
+    inline bool running() const { return runner_.running(); }
+
+    /*!
+     * Run one round: sample, and move or narrow threads that have been
+     * contended for long enough.  This is what the background thread calls;
+     * it may also be called directly.
+     *
+     * \return true if the cpu load could be sampled, false otherwise.
+     */
+    inline bool rebalance()
+    {
+        // rounds are serialized by round_lock_, which guards the sampler
+        // and the thread states; lock_ only guards what other callers read
+        mutex_guard round_guard(round_lock_);
+
+        if (!load_.sample())
+        {
+            return false;
+        }
+
+        std::vector< thread_placement_type > registrations;
+        std::map< thread_id_type, thread_state > states;
+        std::set< std::string > groups;
+        thread_control_type control;
+
+        {
+            mutex_guard guard(lock_);
+            groups = groups_;
+        }
+
+        registry_.get_registrations(registrations);
+
+        for (std::size_t i = 0; i < registrations.size(); ++i)
+        {
+            const thread_placement_type &registration = registrations[i];
+
+            if (groups.find(registration.name()) == groups.end())
+            {
+                continue;
+            }
+
+            sched_stats stats;
+            typename std::map< thread_id_type, thread_state >::iterator
+                previous = states_.find(registration.thread());
+
+            if (!control.get_sched_stats(stats, registration.thread()))
+            {
+                // keep what is known about the thread until its stats can
+                // be read again, as its mask may have been narrowed
+                if (previous != states_.end())
+                {
+                    states.insert(*previous);
+                }
+
+                continue;
+            }
+
+            thread_state &state = states[registration.thread()];
+
+            if (previous == states_.end() ||
+                previous->second.intended != registration.intended())
+            {
+                // a new thread, or one that registered again, starts out
+                // with its full cpu set and a baseline
+                if (previous != states_.end() &&
+                    previous->second.mask != previous->second.intended)
+                {
+                    apply(registration.intended(), registration.thread());
+                }
+
+                state.name = registration.name();
+                state.intended = registration.intended();
+                state.mask = registration.intended();
+                state.stats = stats;
+                continue;
+            }
+
+            state = previous->second;
+            step(state, registration.thread(), stats - state.stats);
+            state.stats = stats;
+        }
+
+        {
+            mutex_guard guard(lock_);
+            states_.swap(states);
+        }
+
+        atomic::fetch_add(rounds_, uint64_t(1));
+        return true;
+    }
+
+    /*!
+     * Get the cpus a balanced thread is currently confined to.
+     *
+     * \param cpus [out] the cpus
+     * \param tid [in] the kernel thread id
+     * \return true if the thread is being balanced, false otherwise.
+     */
+    inline bool get_mask(cpu_set_type &cpus, const thread_id_type &tid) const
+    {
+        mutex_guard guard(lock_);
+
+        typename std::map< thread_id_type, thread_state >::const_iterator i =
+            states_.find(tid);
+
+        cpus.clear();
+
+        if (i != states_.end())
+        {
+            cpus = i->second.mask;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the number of rounds run.
+     *
+     * \return the number of rounds
+     */
+    inline uint64_t rounds() const { return atomic::load(rounds_); }
+
+    /*!
+     * Get the number of times a thread was contended for long enough to be
+     * acted on, whether or not a better placement was found.
+     *
+     * \return the number of sustained contentions
+     */
+    inline uint64_t contentions() const { return atomic::load(contentions_); }
+
+    /*!
+     * Get the number of times a thread was moved to another cache domain.
+     *
+     * \return the number of moves
+     */
+    inline uint64_t moves() const { return atomic::load(moves_); }
+
+    /*!
+     * Get the number of times a thread's mask was narrowed within its cache
+     * domain.
+     *
+     * \return the number of narrows
+     */
+    inline uint64_t narrows() const { return atomic::load(narrows_); }
+
+    /*!
+     * Get the number of times a thread got its full cpu set back.
+     *
+     * \return the number of widens
+     */
+    inline uint64_t widens() const { return atomic::load(widens_); }
+
+   private:
+    basic_rebalancer(const basic_rebalancer &);
+    basic_rebalancer &operator=(const basic_rebalancer &);
+
+    struct thread_state
+    {
+        std::string name;
+        cpu_set_type intended;
+        cpu_set_type mask;
+        sched_stats stats;
+        int contended;
+        int calm;
+        int cooldown;
+
+        inline thread_state() : contended(0), calm(0), cooldown(0) {}
+    };
+
+    static inline void tick(void *self)
+    {
+        static_cast< basic_rebalancer * >(self)->rebalance();
+    }
+
+    /*!
+     * Give a thread that is no longer balanced its full cpu set back if the
+     * rebalancer narrowed it.
+     */
+    inline void restore(const thread_state &state, const thread_id_type &tid)
+    {
+        if (state.mask != state.intended && apply(state.intended, tid))
+        {
+            atomic::fetch_add(widens_, uint64_t(1));
+        }
+    }
+
+    inline void step(thread_state &state,
+                     const thread_id_type &tid,
+                     const sched_stats &delta)
+    {
+        uint64_t runnable = delta.run_time + delta.wait_time;
+        bool contended =
+            runnable != 0 &&
+            double(delta.wait_time) > policy_.wait_threshold * double(runnable);
+
+        if (state.cooldown > 0)
+        {
+            --state.cooldown;
+            state.contended = 0;
+            state.calm = 0;
+            return;
+        }
+
+        state.contended = contended ? state.contended + 1 : 0;
+        state.calm = contended ? 0 : state.calm + 1;
+
+        if (state.contended >= policy_.patience)
+        {
+            atomic::fetch_add(contentions_, uint64_t(1));
+            state.contended = 0;
+            state.cooldown = policy_.cooldown;
+            relocate(state, tid);
+        }
+        else if (state.calm >= policy_.relax_after &&
+                 state.mask != state.intended &&
+                 apply(state.intended, tid))
+        {
+            atomic::fetch_add(widens_, uint64_t(1));
+            state.mask = state.intended;
+            state.calm = 0;
+            state.cooldown = policy_.cooldown;
+        }
+    }
+
+    /*!
+     * Move a contended thread to a cooler cache domain of its numa node, or
+     * narrow it to the cooler cpus of its own domain.
+     */
+    inline void relocate(thread_state &state, const thread_id_type &tid)
+    {
+        thread_control_type control;
+        cpu_identifier_wrapper_type id;
+        cpu_type current;
+
+        if (!control.get_last_cpu(id, tid) ||
+            !affinity_manager_.get_cpu_from_id(current, id) ||
+            state.intended.find(current) == state.intended.end())
+        {
+            if (state.mask.empty())
+            {
+                return;
+            }
+
+            current = *state.mask.begin();
+        }
+
+        // the cache domains of the thread's numa node it is allowed on
+        std::map< llc_type, cpu_set_type > domains;
+        typename cpu_set_type::const_iterator i = state.intended.begin();
+        typename cpu_set_type::const_iterator iend = state.intended.end();
+
+        for (; i != iend; ++i)
+        {
+            if (i->numa() == current.numa())
+            {
+                domains[i->llc()].insert(*i);
+            }
+        }
+
+        const cpu_set_type &home = domains[current.llc()];
+        double home_load;
+        bool home_known = utilization(home_load, home);
+
+        const cpu_set_type *best = NULL;
+        double best_load = 0.0;
+        typename std::map< llc_type, cpu_set_type >::const_iterator j =
+            domains.begin();
+        typename std::map< llc_type, cpu_set_type >::const_iterator jend =
+            domains.end();
+
+        for (; j != jend; ++j)
+        {
+            double load;
+
+            if (j->first != current.llc() && utilization(load, j->second) &&
+                (best == NULL || load < best_load))
+            {
+                best = &j->second;
+                best_load = load;
+            }
+        }
+
+        if (best != NULL && home_known &&
+            best_load + policy_.margin < home_load && apply(*best, tid))
+        {
+            atomic::fetch_add(moves_, uint64_t(1));
+            state.mask = *best;
+            return;
+        }
+
+        cpu_set_type cooler;
+        i = home.begin();
+        iend = home.end();
+
+        for (; i != iend; ++i)
+        {
+            cpu_times times;
+
+            if (load_.get_delta(times, *i) &&
+                times.utilization() < policy_.hot_utilization)
+            {
+                cooler.insert(*i);
+            }
+        }
+
+        if (!cooler.empty() && cooler != state.mask && apply(cooler, tid))
+        {
+            atomic::fetch_add(narrows_, uint64_t(1));
+            state.mask = cooler;
+        }
+    }
+
+    /*!
+     * Get the mean utilization of the cpus of a set that have been sampled.
+     */
+    inline bool utilization(double &load, const cpu_set_type &cpus) const
+    {
+        double total = 0.0;
+        int count = 0;
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            cpu_times times;
+
+            if (load_.get_delta(times, *i))
+            {
+                total += times.utilization();
+                ++count;
+            }
+        }
+
+        load = (count != 0) ? total / double(count) : 0.0;
+        return count != 0;
+    }
+
+    inline bool apply(const cpu_set_type &cpus, const thread_id_type &tid)
+    {
+        std::set< cpu_identifier_wrapper_type > ids;
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            ids.insert(i->id());
+        }
+
+        return thread_control_type().set_affinity(ids, tid);
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    const thread_registry_type &registry_;
+    rebalance_policy policy_;
+    cpu_load_sampler_type load_;
+    std::set< std::string > groups_;
+    std::map< thread_id_type, thread_state > states_;
+    volatile uint64_t rounds_;
+    volatile uint64_t contentions_;
+    volatile uint64_t moves_;
+    volatile uint64_t narrows_;
+    volatile uint64_t widens_;
+    mutable mutex lock_;
+    mutex round_lock_;
+    periodic_runner_type runner_;
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
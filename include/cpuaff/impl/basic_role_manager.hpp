@@ -0,0 +1,644 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../config.hpp"
+#include "../parse_error.hpp"
+#include "../placement_policy.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include "basic_cpu_set_parser.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_role is a named thread role resolved against the cpu topology: the
+ * cpus its threads may run on and how they should use them.
+ */
+template < typename TRAITS >
+class basic_role
+{
+   public:
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+
+   public:
+    /*!
+     * Constructs an unnamed role that may run anywhere.
+     */
+    inline basic_role()
+        : exclusive_(false)
+        , smt_(smt_policy::all)
+        , memory_(memory_policy::system_default)
+    {
+    }
+
+    /*!
+     * Get the name of the role.
+     *
+     * \return the name
+     */
+    inline const std::string &name() const { return name_; }
+
+    /*!
+     * Get the cpu expression the role was declared with.
+     *
+     * \return the cpu expression
+     */
+    inline const std::string &expression() const { return expression_; }
+
+    /*!
+     * Get the cpus the role resolved to.
+     *
+     * \return the cpus
+     */
+    inline const cpu_set_type &cpus() const { return cpus_; }
+
+    /*!
+     * Check if the role's cpus are reserved for it alone.
+     *
+     * \return true if the role is exclusive, false otherwise
+     */
+    inline bool exclusive() const { return exclusive_; }
+
+    /*!
+     * Get how the role uses hyperthreads.
+     *
+     * \return the smt policy
+     */
+    inline const smt_policy::type &smt() const { return smt_; }
+
+    /*!
+     * Get where the role's memory is allocated.
+     *
+     * \return the memory policy
+     */
+    inline const memory_policy::type &memory() const { return memory_; }
+
+   private:
+    template < typename T >
+    friend class basic_role_manager;
+
+    std::string name_;
+    std::string expression_;
+    cpu_set_type cpus_;
+    bool exclusive_;
+    smt_policy::type smt_;
+    memory_policy::type memory_;
+};
+
+/*!
+ * basic_role_manager resolves named thread roles declared in a configuration
+ * file or in the CPUAFF_PLACEMENT environment variable.  Each declaration is
+ * a "role.attribute = value" line (or a ';' separated entry in the
+ * environment variable) with the attributes:
+ *
+ * - cpus: a cpu_set_parser expression (required)
+ * - exclusive: true or false.  The cpus of an exclusive role are taken away
+ *   from every other role and may not overlap another exclusive role.
+ * - smt: all or one.  one keeps a single processing unit per core.
+ * - memory: default, local, or interleave
+ *
+ * For instance:
+ *
+ *     md_feed.cpus = numa:0/core:2-3
+ *     md_feed.exclusive = true
+ *     md_feed.smt = one
+ *     workers.cpus = *
+ *
+ * Later declarations override earlier ones, so the environment variable can
+ * adjust a configuration file.  Code then calls pin_role("md_feed").
+ */
+template < typename TRAITS >
+class basic_role_manager
+{
+   public:
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+    typedef basic_cpu_set_parser< TRAITS > cpu_set_parser_type;
+    typedef basic_role< TRAITS > role_type;
+
+   public:
+    /*!
+     * Constructs a basic_role_manager with no roles that resolves against
+     * every cpu of the affinity manager.
+     *
+     * \param affinity_manager the affinity manager
+     */
+    inline basic_role_manager(const affinity_manager_type &affinity_manager)
+        : affinity_manager_(affinity_manager), parser_(affinity_manager)
+    {
+    }
+
+    /*!
+     * Constructs a basic_role_manager with no roles that resolves against
+     * the given cpus only.
+     *
+     * \param affinity_manager the affinity manager
+     * \param cpus the cpus roles may use
+     */
+    inline basic_role_manager(const affinity_manager_type &affinity_manager,
+                              const cpu_set_type &cpus)
+        : affinity_manager_(affinity_manager), parser_(affinity_manager, cpus)
+    {
+    }
+
+    /*!
+     * Load role declarations from a file, one per line.  Blank lines and
+     * everything after a '#' are ignored.
+     *
+     * \param path [in] the path of the file
+     * \param error [out] what went wrong if loading fails
+     * \return true if the file was loaded and every role resolved, false
+     *         otherwise.
+     */
+    inline bool load_file(const std::string &path, parse_error &error)
+    {
+        std::ifstream file(path.c_str());
+
+        if (!file)
+        {
+            error = parse_error(0, "unable to open " + path);
+            return false;
+        }
+
+        std::vector< std::string > lines;
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            lines.push_back(line);
+        }
+
+        return load(lines, "line", error);
+    }
+
+    /*!
+     * Load ';' separated role declarations from a string.
+     *
+     * \param text [in] the declarations
+     * \param error [out] what went wrong if loading fails
+     * \return true if the declarations were loaded and every role resolved,
+     *         false otherwise.
+     */
+    inline bool load_string(const std::string &text, parse_error &error)
+    {
+        std::vector< std::string > entries;
+        std::string entry;
+        std::istringstream buf(text);
+
+        while (std::getline(buf, entry, ';'))
+        {
+            entries.push_back(entry);
+        }
+
+        return load(entries, "entry", error);
+    }
+
+    /*!
+     * Load ';' separated role declarations from an environment variable.  A
+     * variable that is not set declares nothing.
+     *
+     * \param error [out] what went wrong if loading fails
+     * \param name [in] the name of the environment variable
+     * \return true if the declarations were loaded and every role resolved,
+     *         false otherwise.
+     */
+    inline bool load_environment(parse_error &error,
+                                 const std::string &name = "CPUAFF_PLACEMENT")
+    {
+        const char *text = getenv(name.c_str());
+        return (text) ? load_string(text, error) : true;
+    }
+
+    /*!
+     * Check if a role has been declared.
+     *
+     * \param name [in] the name of the role
+     * \return true if the role exists, false otherwise.
+     */
+    inline bool has_role(const std::string &name) const
+    {
+        return roles_.find(name) != roles_.end();
+    }
+
+    /*!
+     * Get a resolved role.
+     *
+     * \param role [out] the role
+     * \param name [in] the name of the role
+     * \return true if the role exists, false otherwise.
+     */
+    inline bool get_role(role_type &role, const std::string &name) const
+    {
+        typename std::map< std::string, role_type >::const_iterator i =
+            roles_.find(name);
+
+        if (i != roles_.end())
+        {
+            role = i->second;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Get the names of every declared role.
+     *
+     * \param names [out] the role names
+     * \return true if any roles are declared, false otherwise.
+     */
+    inline bool get_role_names(std::vector< std::string > &names) const
+    {
+        names.clear();
+
+        typename std::map< std::string, role_type >::const_iterator i =
+            roles_.begin();
+        typename std::map< std::string, role_type >::const_iterator iend =
+            roles_.end();
+
+        for (; i != iend; ++i)
+        {
+            names.push_back(i->first);
+        }
+
+        return !names.empty();
+    }
+
+    /*!
+     * Get the cpus a role resolved to.
+     *
+     * \param cpus [out] the cpus
+     * \param name [in] the name of the role
+     * \return true if the role exists, false otherwise.
+     */
+    inline bool get_role_cpus(cpu_set_type &cpus,
+                              const std::string &name) const
+    {
+        typename std::map< std::string, role_type >::const_iterator i =
+            roles_.find(name);
+
+        cpus.clear();
+
+        if (i != roles_.end())
+        {
+            cpus = i->second.cpus();
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Pin the calling thread to a role's cpus and apply its memory policy
+     * where the platform supports memory policies.  A role with the
+     * system_default memory policy leaves the thread's policy as it is, so
+     * a policy inherited from, for instance, numactl is kept.  A failure to
+     * apply the memory policy is not reported; use the overload that takes
+     * policy_applied to see it.
+     *
+     * \param name [in] the name of the role
+     * \return true if the thread was pinned, false otherwise.
+     */
+    inline bool pin_role(const std::string &name) const
+    {
+        bool policy_applied;
+        return pin_role(policy_applied, name);
+    }
+
+    /*!
+     * Pin the calling thread to a role's cpus and apply its memory policy
+     * where the platform supports memory policies.  The thread may be pinned
+     * even if its memory policy could not be applied.
+     *
+     * \param policy_applied [out] false if the role's memory policy could not
+     * be applied, true otherwise, including when there was nothing to apply
+     * \param name [in] the name of the role
+     * \return true if the thread was pinned, false otherwise.
+     */
+    inline bool pin_role(bool &policy_applied, const std::string &name) const
+    {
+        typename std::map< std::string, role_type >::const_iterator i =
+            roles_.find(name);
+
+        policy_applied = true;
+
+        if (i == roles_.end() ||
+            !affinity_manager_.set_affinity(i->second.cpus()))
+        {
+            return false;
+        }
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+        std::set< numa_type > numas;
+        typename cpu_set_type::const_iterator j = i->second.cpus().begin();
+        typename cpu_set_type::const_iterator jend = i->second.cpus().end();
+
+        for (; j != jend; ++j)
+        {
+            if (j->numa() >= 0)
+            {
+                numas.insert(j->numa());
+            }
+        }
+
+        memory_policy::type policy = i->second.memory();
+
+        if (policy == memory_policy::interleave && numas.empty())
+        {
+            policy = memory_policy::system_default;
+        }
+
+        if (policy != memory_policy::system_default)
+        {
+            policy_applied =
+                typename TRAITS::set_memory_policy_type()(policy, numas);
+        }
+#endif
+
+        return true;
+    }
+
+   private:
+    basic_role_manager(const basic_role_manager &);
+    basic_role_manager &operator=(const basic_role_manager &);
+
+    static inline std::string trim(const std::string &str,
+                                   std::string::size_type &offset)
+    {
+        std::string::size_type begin = str.find_first_not_of(" \t\r\n");
+
+        if (begin == std::string::npos)
+        {
+            offset = str.size();
+            return std::string();
+        }
+
+        std::string::size_type end = str.find_last_not_of(" \t\r\n");
+        offset = begin;
+        return str.substr(begin, end - begin + 1);
+    }
+
+    static inline bool is_name(const std::string &str)
+    {
+        return !str.empty() &&
+               str.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+                                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "0123456789_") == std::string::npos;
+    }
+
+    static inline std::string where(const char *unit, std::size_t n)
+    {
+        std::ostringstream buf;
+        buf << unit << " " << n << ": ";
+        return buf.str();
+    }
+
+    inline bool load(const std::vector< std::string > &lines,
+                     const char *unit,
+                     parse_error &error)
+    {
+        std::map< std::string, role_type > roles = roles_;
+
+        for (std::size_t n = 0; n < lines.size(); ++n)
+        {
+            std::string line = lines[n].substr(0, lines[n].find('#'));
+            std::string::size_type equals = line.find('=');
+            std::string::size_type key_offset;
+            std::string::size_type value_offset;
+
+            if (trim(line, key_offset).empty())
+            {
+                continue;
+            }
+
+            if (equals == std::string::npos)
+            {
+                error = parse_error(line.size() + 1,
+                                    where(unit, n + 1) + "expected '='");
+                return false;
+            }
+
+            std::string key = trim(line.substr(0, equals), key_offset);
+            std::string value = trim(line.substr(equals + 1), value_offset);
+            std::string::size_type dot = key.find('.');
+            value_offset += equals + 1;
+
+            if (dot == std::string::npos || !is_name(key.substr(0, dot)))
+            {
+                error = parse_error(key_offset + 1,
+                                    where(unit, n + 1) +
+                                        "expected role.attribute");
+                return false;
+            }
+
+            std::string name = key.substr(0, dot);
+            std::string attribute = key.substr(dot + 1);
+            role_type &role = roles[name];
+            role.name_ = name;
+
+            if (attribute == "cpus")
+            {
+                cpu_set_type cpus;
+                parse_error expression_error;
+
+                if (!parser_.parse(cpus, value, expression_error))
+                {
+                    error = parse_error(
+                        value_offset + expression_error.column(),
+                        where(unit, n + 1) + expression_error.message());
+                    return false;
+                }
+
+                role.expression_ = value;
+                role.cpus_ = cpus;
+            }
+            else if (attribute == "exclusive" &&
+                     (value == "true" || value == "false"))
+            {
+                role.exclusive_ = (value == "true");
+            }
+            else if (attribute == "smt" && (value == "all" || value == "one"))
+            {
+                role.smt_ =
+                    (value == "one") ? smt_policy::one : smt_policy::all;
+            }
+            else if (attribute == "memory" &&
+                     (value == "default" || value == "local" ||
+                      value == "interleave"))
+            {
+                if (value == "local")
+                {
+                    role.memory_ = memory_policy::local;
+                }
+                else if (value == "interleave")
+                {
+                    role.memory_ = memory_policy::interleave;
+                }
+                else
+                {
+                    role.memory_ = memory_policy::system_default;
+                }
+            }
+            else if (attribute == "exclusive" || attribute == "smt" ||
+                     attribute == "memory")
+            {
+                error = parse_error(value_offset + 1,
+                                    where(unit, n + 1) + "invalid value '" +
+                                        value + "' for " + attribute);
+                return false;
+            }
+            else
+            {
+                error = parse_error(key_offset + dot + 2,
+                                    where(unit, n + 1) +
+                                        "unknown attribute '" + attribute +
+                                        "' (expected cpus, exclusive, smt, "
+                                        "or memory)");
+                return false;
+            }
+        }
+
+        if (resolve(roles, error))
+        {
+            roles_.swap(roles);
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Apply the smt and exclusivity rules to freshly parsed roles.
+     */
+    inline bool resolve(std::map< std::string, role_type > &roles,
+                        parse_error &error) const
+    {
+        typename std::map< std::string, role_type >::iterator i;
+        cpu_set_type reserved;
+
+        for (i = roles.begin(); i != roles.end(); ++i)
+        {
+            role_type &role = i->second;
+
+            if (role.expression_.empty())
+            {
+                error =
+                    parse_error(0, "role '" + role.name_ + "' has no cpus");
+                return false;
+            }
+
+            // re-resolve from the expression so smt and exclusivity are
+            // applied to the declared cpus every time
+            parser_.parse(role.cpus_, role.expression_);
+
+            if (role.smt_ == smt_policy::one)
+            {
+                std::set< std::pair< socket_type, core_type > > cores;
+                cpu_set_type cpus;
+                typename cpu_set_type::const_iterator j = role.cpus_.begin();
+                typename cpu_set_type::const_iterator jend = role.cpus_.end();
+
+                for (; j != jend; ++j)
+                {
+                    if (cores.insert(std::make_pair(j->socket(), j->core()))
+                            .second)
+                    {
+                        cpus.insert(*j);
+                    }
+                }
+
+                role.cpus_.swap(cpus);
+            }
+
+            if (role.exclusive_)
+            {
+                typename cpu_set_type::const_iterator j = role.cpus_.begin();
+                typename cpu_set_type::const_iterator jend = role.cpus_.end();
+
+                for (; j != jend; ++j)
+                {
+                    if (!reserved.insert(*j).second)
+                    {
+                        error = parse_error(0, "exclusive role '" +
+                                                   role.name_ +
+                                                   "' overlaps another "
+                                                   "exclusive role");
+                        return false;
+                    }
+                }
+            }
+        }
+
+        for (i = roles.begin(); i != roles.end(); ++i)
+        {
+            role_type &role = i->second;
+
+            if (!role.exclusive_)
+            {
+                typename cpu_set_type::const_iterator j = reserved.begin();
+                typename cpu_set_type::const_iterator jend = reserved.end();
+
+                for (; j != jend; ++j)
+                {
+                    role.cpus_.erase(*j);
+                }
+            }
+
+            if (role.cpus_.empty())
+            {
+                error = parse_error(0, "role '" + role.name_ +
+                                           "' has no cpus left");
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    cpu_set_parser_type parser_;
+    std::map< std::string, role_type > roles_;
+};
+}  // namespace impl
+}  // namespace cpuaff
@@ -31,10 +31,12 @@
 #pragma once
 
 #include "../config.hpp"
+#include "atomic.hpp"
 #include "basic_cpu.hpp"
 #include "basic_cpu_set.hpp"
 #include <map>
-#include <queue>
+#include <stdint.h>
+#include <vector>
 
 namespace cpuaff
 {
@@ -44,6 +46,10 @@ namespace impl
  * basic_round_robin_allocator is a utility class that takes a set of cpus
  * and returns them as requested in a round-robin fashion.  It organizes the
  * cpus such that it returns consecutive cpus from different cores if it can.
+ *
+ * The order is computed once at construction and never modified afterwards,
+ * and the position in the round-robin is a single atomic counter, so
+ * concurrent calls to allocate() are safe and wait-free.
  */
 template < typename TRAITS >
 class basic_round_robin_allocator
@@ -58,45 +64,67 @@ class basic_round_robin_allocator
      *
      * \param cpus the set of cpus that this allocator should iterate over
      */
-    inline basic_round_robin_allocator(const cpu_set_type &cpus)
+    inline basic_round_robin_allocator(const cpu_set_type &cpus) : cursor_(0)
     {
         initialize(cpus);
     }
 
     /*!
-     * Get the next cpu in the round-robin.
+     * Get the next cpu in the round-robin.  The allocator must not be empty.
      *
      * \return the next cpu in the round robin
      */
-    inline cpu_type allocate()
+    inline const cpu_type &allocate()
+    {
+        return cpus_[atomic::fetch_add(cursor_, uint64_t(1)) % cpus_.size()];
+    }
+
+    /*!
+     * Get the next cpu in the round-robin.
+     *
+     * \param cpu [out] the next cpu in the round-robin
+     * \return true if the allocator has cpus, false otherwise
+     */
+    inline bool allocate(cpu_type &cpu)
     {
-        cpu_type retval = cpu_queue_.front();
-        cpu_queue_.pop();
-        cpu_queue_.push(retval);
-        return retval;
+        if (!cpus_.empty())
+        {
+            cpu = allocate();
+            return true;
+        }
+
+        return false;
     }
 
     /*!
-     * Get the next count cpus in the round-robin.
+     * Get the next count cpus in the round-robin.  The cpus are reserved with
+     * a single atomic step so concurrent callers never interleave.
      *
      * \param cpus [out] the set of the next count cpus in the round-robin
-     * \param count [in] the number of cpus to return.  If this number is
-     *                   greater than the total number of cpus in the
-     *                   round-robin just the full set will be returned.
+     * \param count [in] the number of cpus to return
+     * \return true if count distinct cpus were returned, false if count is
+     *         greater than the number of cpus in the round-robin
      */
     inline bool allocate(cpu_set_type &cpus, uint32_t count)
     {
         cpus.clear();
 
+        if (count > cpus_.size())
+        {
+            return false;
+        }
+
+        uint64_t start = atomic::fetch_add(cursor_, uint64_t(count));
+
         for (uint32_t i = 0; i < count; ++i)
         {
-            cpus.insert(allocate());
+            cpus.insert(cpus_[(start + i) % cpus_.size()]);
         }
 
         return true;
     }
 
-    inline int size() { return cpu_queue_.size(); }
+    inline int size() const { return int(cpus_.size()); }
 
    private:
     /*!
@@ -117,6 +145,8 @@ class basic_round_robin_allocator
             cpus_by_pu[i->processing_unit()].insert(*i);
         }
 
+        cpus_.reserve(cpus.size());
+
         typename std::map< processing_unit_type, cpu_set_type >::const_iterator
             j = cpus_by_pu.begin();
         typename std::map< processing_unit_type, cpu_set_type >::const_iterator
@@ -124,20 +154,15 @@ class basic_round_robin_allocator
 
         for (; j != jend; ++j)
         {
-            typename cpu_set_type::iterator k = j->second.begin();
-            typename cpu_set_type::iterator kend = j->second.end();
-
-            for (; k != kend; ++k)
-            {
-                cpu_queue_.push(*k);
-            }
+            cpus_.insert(cpus_.end(), j->second.begin(), j->second.end());
         }
 
-        return !!cpus.size();
+        return !cpus_.empty();
     }
 
    private:
-    std::queue< cpu_type > cpu_queue_;
+    std::vector< cpu_type > cpus_;
+    volatile uint64_t cursor_;
 };
 }  // namespace impl
 }  // namespace cpuaff
@@ -0,0 +1,225 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+
+#include "../config.hpp"
+#include "../sched_stats.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_thread_registry.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_sched_sampler samples the scheduler counters (run time, run queue
+ * wait time, context switches, and migrations) of the threads of a
+ * basic_thread_registry and reports what changed since the previous sample,
+ * per thread, per cpu, and per role.  Run queue wait on a cpu that is meant
+ * to be dedicated to a thread is the clearest sign that placement is broken.
+ *
+ * A thread's delta is attributed to the cpu it last ran on, which is exact
+ * for threads pinned to a single cpu.  The first sample of a thread only
+ * records a baseline, so its delta is zero.
+ */
+template < typename TRAITS >
+class basic_sched_sampler
+{
+   public:
+    typedef typename TRAITS::thread_control_type thread_control_type;
+    typedef typename TRAITS::cpu_identifier_wrapper_type
+        cpu_identifier_wrapper_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_thread_registry< TRAITS > thread_registry_type;
+    typedef basic_thread_placement< TRAITS > thread_placement_type;
+
+   public:
+    /*!
+     * Construct a basic_sched_sampler for the threads of a registry.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     * \param registry the thread registry to sample
+     */
+    inline basic_sched_sampler(const affinity_manager_type &affinity_manager,
+                               const thread_registry_type &registry)
+        : affinity_manager_(affinity_manager), registry_(registry)
+    {
+    }
+
+    /*!
+     * Sample every registered thread and replace the deltas with the change
+     * since the previous sample.  Threads that have exited are dropped.
+     *
+     * \return true if any thread was sampled, false otherwise.
+     */
+    inline bool sample()
+    {
+        thread_control_type control;
+        std::vector< thread_placement_type > registrations;
+        std::map< thread_id_type, sched_stats > totals;
+
+        registry_.get_registrations(registrations);
+        deltas_by_thread_.clear();
+        deltas_by_cpu_.clear();
+        deltas_by_role_.clear();
+
+        for (std::size_t i = 0; i < registrations.size(); ++i)
+        {
+            const thread_id_type &tid = registrations[i].thread();
+            sched_stats stats;
+
+            if (!control.get_sched_stats(stats, tid))
+            {
+                continue;
+            }
+
+            totals[tid] = stats;
+
+            typename std::map< thread_id_type, sched_stats >::const_iterator
+                previous = totals_.find(tid);
+            sched_stats delta;
+
+            if (previous != totals_.end())
+            {
+                delta = stats - previous->second;
+            }
+
+            delta.has_migrations = stats.has_migrations;
+            deltas_by_thread_[tid] = delta;
+            deltas_by_role_[registrations[i].name()] += delta;
+
+            cpu_identifier_wrapper_type id;
+            cpu_type cpu;
+
+            if (control.get_last_cpu(id, tid) &&
+                affinity_manager_.get_cpu_from_id(cpu, id))
+            {
+                deltas_by_cpu_[cpu] += delta;
+            }
+        }
+
+        totals_.swap(totals);
+        return !totals_.empty();
+    }
+
+    /*!
+     * Get the counters of a thread since it started, as of the last sample.
+     *
+     * \param stats [out] the counters
+     * \param tid [in] the kernel thread id
+     * \return true if the thread was sampled, false otherwise.
+     */
+    inline bool get_totals(sched_stats &stats, const thread_id_type &tid) const
+    {
+        return find(stats, totals_, tid);
+    }
+
+    /*!
+     * Get the change in a thread's counters between the last two samples.
+     *
+     * \param stats [out] the change
+     * \param tid [in] the kernel thread id
+     * \return true if the thread was sampled, false otherwise.
+     */
+    inline bool get_delta(sched_stats &stats, const thread_id_type &tid) const
+    {
+        return find(stats, deltas_by_thread_, tid);
+    }
+
+    /*!
+     * Get the change in counters between the last two samples summed by the
+     * cpu each thread last ran on.
+     *
+     * \param deltas [out] the changes by cpu
+     * \return true if any changes were attributed to a cpu, false otherwise.
+     */
+    inline bool get_deltas_by_cpu(
+        std::map< cpu_type, sched_stats > &deltas) const
+    {
+        deltas = deltas_by_cpu_;
+        return !deltas.empty();
+    }
+
+    /*!
+     * Get the change in counters between the last two samples summed by the
+     * role name each thread registered with.
+     *
+     * \param deltas [out] the changes by role
+     * \return true if any threads were sampled, false otherwise.
+     */
+    inline bool get_deltas_by_role(
+        std::map< std::string, sched_stats > &deltas) const
+    {
+        deltas = deltas_by_role_;
+        return !deltas.empty();
+    }
+
+   private:
+    basic_sched_sampler(const basic_sched_sampler &);
+    basic_sched_sampler &operator=(const basic_sched_sampler &);
+
+    static inline bool find(sched_stats &stats,
+                            const std::map< thread_id_type, sched_stats > &m,
+                            const thread_id_type &tid)
+    {
+        typename std::map< thread_id_type, sched_stats >::const_iterator i =
+            m.find(tid);
+
+        if (i != m.end())
+        {
+            stats = i->second;
+            return true;
+        }
+
+        return false;
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    const thread_registry_type &registry_;
+    std::map< thread_id_type, sched_stats > totals_;
+    std::map< thread_id_type, sched_stats > deltas_by_thread_;
+    std::map< cpu_type, sched_stats > deltas_by_cpu_;
+    std::map< std::string, sched_stats > deltas_by_role_;
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
@@ -0,0 +1,556 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../options.hpp"
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+
+#include "../config.hpp"
+#include "atomic.hpp"
+#include "basic_affinity_manager.hpp"
+#include "basic_cpu.hpp"
+#include "basic_cpu_set.hpp"
+#include "basic_role_manager.hpp"
+#include "mutex.hpp"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * basic_thread_placement is a snapshot of where a registered thread was
+ * meant to run and where it is actually running.
+ */
+template < typename TRAITS >
+class basic_thread_placement
+{
+   public:
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+
+   public:
+    inline basic_thread_placement()
+        : thread_(0), alive_(false), has_last_cpu_(false)
+    {
+    }
+
+    /*!
+     * Get the kernel thread id of the thread.
+     *
+     * \return the thread id
+     */
+    inline const thread_id_type &thread() const { return thread_; }
+
+    /*!
+     * Get the role name the thread registered with.
+     *
+     * \return the role name
+     */
+    inline const std::string &name() const { return name_; }
+
+    /*!
+     * Get the cpus the thread was pinned to when it registered.
+     *
+     * \return the intended cpus
+     */
+    inline const cpu_set_type &intended() const { return intended_; }
+
+    /*!
+     * Get the cpus the thread is currently allowed to run on.
+     *
+     * \return the actual cpus
+     */
+    inline const cpu_set_type &actual() const { return actual_; }
+
+    /*!
+     * Check if the thread still exists.
+     *
+     * \return true if the thread is alive, false otherwise
+     */
+    inline bool alive() const { return alive_; }
+
+    /*!
+     * Check if the cpu the thread last ran on is known.
+     *
+     * \return true if last_cpu() is valid, false otherwise
+     */
+    inline bool has_last_cpu() const { return has_last_cpu_; }
+
+    /*!
+     * Get the cpu the thread last ran on.
+     *
+     * \return the cpu
+     */
+    inline const cpu_type &last_cpu() const { return last_cpu_; }
+
+    /*!
+     * Check if the thread has drifted from its intended placement, that is
+     * its affinity mask was changed or it last ran outside of it.
+     *
+     * \return true if the thread is alive and misplaced, false otherwise
+     */
+    inline bool misplaced() const
+    {
+        return alive_ && (actual_ != intended_ ||
+                          (has_last_cpu_ &&
+                           intended_.find(last_cpu_) == intended_.end()));
+    }
+
+   private:
+    template < typename T >
+    friend class basic_thread_registry;
+
+    thread_id_type thread_;
+    std::string name_;
+    cpu_set_type intended_;
+    cpu_set_type actual_;
+    bool alive_;
+    bool has_last_cpu_;
+    cpu_type last_cpu_;
+};
+
+/*!
+ * basic_thread_registry keeps track of the threads of this process by role.
+ * A thread registers itself under a role name; the registry names the thread
+ * (so it shows up in ps -L, top -H, and perf), pins it, and remembers the
+ * cpus it was meant to run on.  dump_placement() then reports, for every
+ * registered thread, the intended mask, the mask the kernel actually has,
+ * and the cpu the thread last ran on.
+ */
+template < typename TRAITS >
+class basic_thread_registry
+{
+   public:
+    typedef typename TRAITS::thread_control_type thread_control_type;
+    typedef typename TRAITS::cpu_identifier_wrapper_type
+        cpu_identifier_wrapper_type;
+    typedef basic_affinity_manager< TRAITS > affinity_manager_type;
+    typedef basic_cpu< TRAITS > cpu_type;
+    typedef basic_cpu_set< TRAITS > cpu_set_type;
+    typedef basic_role_manager< TRAITS > role_manager_type;
+    typedef basic_thread_placement< TRAITS > thread_placement_type;
+
+   public:
+    /*!
+     * Construct an empty basic_thread_registry.
+     *
+     * \param affinity_manager the affinity manager for this machine
+     */
+    inline basic_thread_registry(const affinity_manager_type &affinity_manager)
+        : affinity_manager_(affinity_manager), generation_(0)
+    {
+    }
+
+    /*!
+     * Register the calling thread: name it, pin it to the given cpus, and
+     * record them as its intended placement.  Registering again replaces the
+     * previous registration.
+     *
+     * \param name [in] the role name of the thread
+     * \param cpus [in] the cpus the thread should run on
+     * \return true if the thread was pinned and registered, false otherwise.
+     */
+    inline bool register_thread(const std::string &name,
+                                const cpu_set_type &cpus)
+    {
+        return affinity_manager_.set_affinity(cpus) && add(name, cpus);
+    }
+
+    /*!
+     * Register the calling thread without pinning it.  Its current affinity
+     * is recorded as its intended placement.
+     *
+     * \param name [in] the role name of the thread
+     * \return true if the thread was registered, false otherwise.
+     */
+    inline bool register_thread(const std::string &name)
+    {
+        cpu_set_type cpus;
+        return affinity_manager_.get_affinity(cpus) && add(name, cpus);
+    }
+
+    /*!
+     * Register the calling thread under a role of a role manager.  The
+     * thread is pinned with pin_role() so the role's memory policy applies
+     * too.
+     *
+     * \param roles [in] the role manager
+     * \param name [in] the role name
+     * \return true if the thread was pinned and registered, false otherwise.
+     */
+    inline bool register_thread(const role_manager_type &roles,
+                                const std::string &name)
+    {
+        cpu_set_type cpus;
+        return roles.get_role_cpus(cpus, name) && roles.pin_role(name) &&
+               add(name, cpus);
+    }
+
+    /*!
+     * Remove the calling thread from the registry.
+     *
+     * \return true if the thread was registered, false otherwise.
+     */
+    inline bool unregister_thread()
+    {
+        return unregister_thread(thread_control_type().current_thread());
+    }
+
+    /*!
+     * Remove a thread from the registry.
+     *
+     * \param tid [in] the kernel thread id
+     * \return true if the thread was registered, false otherwise.
+     */
+    inline bool unregister_thread(const thread_id_type &tid)
+    {
+        mutex_guard guard(lock_);
+
+        if (threads_.erase(tid) > 0)
+        {
+            atomic::fetch_add(generation_, uint64_t(1));
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * Remove every registered thread that no longer exists.
+     *
+     * \return the number of threads removed
+     */
+    inline int prune()
+    {
+        std::vector< thread_id_type > tids;
+
+        {
+            mutex_guard guard(lock_);
+            tids.reserve(threads_.size());
+
+            typename std::map< thread_id_type,
+                               thread_placement_type >::const_iterator i =
+                threads_.begin();
+
+            for (; i != threads_.end(); ++i)
+            {
+                tids.push_back(i->first);
+            }
+        }
+
+        // check liveness outside of the lock so registering threads never
+        // wait on the filesystem
+        thread_control_type control;
+        std::vector< thread_id_type > dead;
+
+        for (size_t i = 0; i < tids.size(); ++i)
+        {
+            if (!control.is_alive(tids[i]))
+            {
+                dead.push_back(tids[i]);
+            }
+        }
+
+        if (dead.empty())
+        {
+            return 0;
+        }
+
+        mutex_guard guard(lock_);
+        int removed = 0;
+
+        for (size_t i = 0; i < dead.size(); ++i)
+        {
+            if (threads_.erase(dead[i]) > 0)
+            {
+                atomic::fetch_add(generation_, uint64_t(1));
+                ++removed;
+            }
+        }
+
+        return removed;
+    }
+
+    /*!
+     * Get the number of registered threads.
+     *
+     * \return the number of registered threads
+     */
+    inline int size() const
+    {
+        mutex_guard guard(lock_);
+        return int(threads_.size());
+    }
+
+    /*!
+     * Get the live placement of a registered thread.
+     *
+     * \param placement [out] the placement
+     * \param tid [in] the kernel thread id
+     * \return true if the thread is registered, false otherwise.
+     */
+    inline bool get_placement(thread_placement_type &placement,
+                              const thread_id_type &tid) const
+    {
+        {
+            mutex_guard guard(lock_);
+
+            typename std::map< thread_id_type,
+                               thread_placement_type >::const_iterator i =
+                threads_.find(tid);
+
+            if (i == threads_.end())
+            {
+                return false;
+            }
+
+            placement = i->second;
+        }
+
+        // read /proc outside of the lock so registering threads never wait
+        // on the filesystem
+        inspect(placement);
+        return true;
+    }
+
+    /*!
+     * Get the live placement of every registered thread, ordered by thread
+     * id.
+     *
+     * \param placements [out] the placements
+     * \return true if any threads are registered, false otherwise.
+     */
+    inline bool get_placements(
+        std::vector< thread_placement_type > &placements) const
+    {
+        get_registrations(placements);
+
+        for (std::size_t i = 0; i < placements.size(); ++i)
+        {
+            inspect(placements[i]);
+        }
+
+        return !placements.empty();
+    }
+
+    /*!
+     * Get every registration as it was recorded, without reading the live
+     * state of the threads.  Only thread(), name(), and intended() are set.
+     *
+     * \param placements [out] the registrations, ordered by thread id
+     * \return true if any threads are registered, false otherwise.
+     */
+    inline bool get_registrations(
+        std::vector< thread_placement_type > &placements) const
+    {
+        mutex_guard guard(lock_);
+        placements.clear();
+
+        typename std::map< thread_id_type,
+                           thread_placement_type >::const_iterator i =
+            threads_.begin();
+        typename std::map< thread_id_type,
+                           thread_placement_type >::const_iterator iend =
+            threads_.end();
+
+        for (; i != iend; ++i)
+        {
+            placements.push_back(i->second);
+        }
+
+        return !placements.empty();
+    }
+
+    /*!
+     * Get a counter that changes every time a thread is registered or
+     * removed, so that observers can tell cheaply whether to call
+     * get_registrations() again.
+     *
+     * \return the generation
+     */
+    inline uint64_t generation() const { return atomic::load(generation_); }
+
+    /*!
+     * Print one line per registered thread with its id, role name, intended
+     * cpus, actual cpus, and last cpu, as native cpu ids.  Threads that have
+     * drifted are flagged "MISPLACED" and threads that have exited "EXITED".
+     *
+     * \param s [in] the stream to print to
+     */
+    inline void dump_placement(std::ostream &s = std::cout) const
+    {
+        std::vector< thread_placement_type > placements;
+        get_placements(placements);
+
+        for (std::size_t i = 0; i < placements.size(); ++i)
+        {
+            const thread_placement_type &p = placements[i];
+
+            s << "tid: " << p.thread() << ", name: " << p.name()
+              << ", intended: ";
+            print_ids(s, p.intended());
+
+            if (!p.alive())
+            {
+                s << ", EXITED" << std::endl;
+                continue;
+            }
+
+            s << ", actual: ";
+            print_ids(s, p.actual());
+            s << ", last_cpu: ";
+
+            if (p.has_last_cpu())
+            {
+                s << p.last_cpu().id().get();
+            }
+            else
+            {
+                s << "?";
+            }
+
+            if (p.misplaced())
+            {
+                s << ", MISPLACED";
+            }
+
+            s << std::endl;
+        }
+    }
+
+   private:
+    basic_thread_registry(const basic_thread_registry &);
+    basic_thread_registry &operator=(const basic_thread_registry &);
+
+    inline bool add(const std::string &name, const cpu_set_type &cpus)
+    {
+        thread_control_type control;
+        thread_placement_type placement;
+        placement.thread_ = control.current_thread();
+        placement.name_ = name;
+        placement.intended_ = cpus;
+
+        // a name the kernel rejects does not stop the thread being tracked
+        control.set_name(name);
+
+        mutex_guard guard(lock_);
+        threads_[placement.thread_] = placement;
+        atomic::fetch_add(generation_, uint64_t(1));
+        return true;
+    }
+
+    inline void inspect(thread_placement_type &placement) const
+    {
+        thread_control_type control;
+        std::set< cpu_identifier_wrapper_type > ids;
+        cpu_identifier_wrapper_type id;
+
+        placement.actual_.clear();
+        placement.alive_ = control.is_alive(placement.thread_) &&
+                           control.get_affinity(ids, placement.thread_);
+
+        typename std::set< cpu_identifier_wrapper_type >::const_iterator i =
+            ids.begin();
+        typename std::set< cpu_identifier_wrapper_type >::const_iterator
+            iend = ids.end();
+
+        for (; i != iend; ++i)
+        {
+            cpu_type cpu;
+
+            if (affinity_manager_.get_cpu_from_id(cpu, *i))
+            {
+                placement.actual_.insert(cpu);
+            }
+        }
+
+        placement.has_last_cpu_ =
+            placement.alive_ && control.get_last_cpu(id, placement.thread_) &&
+            affinity_manager_.get_cpu_from_id(placement.last_cpu_, id);
+    }
+
+    static inline void print_ids(std::ostream &s, const cpu_set_type &cpus)
+    {
+        // print native ids as a kernel style list, for instance 0-3,8
+        std::vector< cpu_identifier_wrapper_type > ids;
+        typename cpu_set_type::const_iterator i = cpus.begin();
+        typename cpu_set_type::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            ids.push_back(i->id());
+        }
+
+        std::sort(ids.begin(), ids.end());
+
+        for (std::size_t j = 0; j < ids.size();)
+        {
+            std::size_t k = j;
+
+            while (k + 1 < ids.size() &&
+                   ids[k + 1].get() == ids[k].get() + 1)
+            {
+                ++k;
+            }
+
+            s << ((j != 0) ? "," : "") << ids[j].get();
+
+            if (k != j)
+            {
+                s << "-" << ids[k].get();
+            }
+
+            j = k + 1;
+        }
+
+        if (ids.empty())
+        {
+            s << "-";
+        }
+    }
+
+   private:
+    const affinity_manager_type &affinity_manager_;
+    std::map< thread_id_type, thread_placement_type > threads_;
+    volatile uint64_t generation_;
+    mutable mutex lock_;
+};
+}  // namespace impl
+}  // namespace cpuaff
+
+#endif
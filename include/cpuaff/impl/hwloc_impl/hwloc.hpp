@@ -101,11 +101,13 @@ struct cpu_info
     cpu_spec spec;
     cpu_identifier_wrapper id;
     numa_type numa;
+    llc_type llc;
 
     inline cpu_info(const cpu_spec &s,
                     const cpu_identifier_type &i,
-                    const numa_type &n)
-        : spec(s), id(i), numa(n)
+                    const numa_type &n,
+                    const llc_type &l = -1)
+        : spec(s), id(i), numa(n), llc(l)
     {
     }
 };
@@ -147,7 +149,8 @@ class topology_reader
             cpus_.push_back(
                 cpu_info(cpu_spec(socket_type(socket_id_), core_type(core_id_),
                                   processing_unit_type(processing_unit_id_++)),
-                         hwloc_bitmap_first(obj->cpuset), numa_type(numa_id_)));
+                         hwloc_bitmap_first(obj->cpuset), numa_type(numa_id_),
+                         read_llc(obj)));
         }
 
         for (unsigned int i = 0; i < obj->arity; ++i)
@@ -156,6 +159,34 @@ class topology_reader
         }
     }
 
+    /*!
+     * Get the logical index of the outermost data or unified cache above a
+     * processing unit, which hwloc numbers from zero per level.
+     */
+    static inline llc_type read_llc(hwloc_obj_t obj)
+    {
+        llc_type llc = -1;
+        unsigned int llc_depth = 0;
+
+        for (obj = obj->parent; obj != NULL; obj = obj->parent)
+        {
+#if HWLOC_API_VERSION >= 0x00020000
+            bool cache = hwloc_obj_type_is_dcache(obj->type);
+#else
+            bool cache = obj->type == HWLOC_OBJ_CACHE &&
+                         obj->attr->cache.type != HWLOC_OBJ_CACHE_INSTRUCTION;
+#endif
+
+            if (cache && obj->attr->cache.depth > llc_depth)
+            {
+                llc = llc_type(obj->logical_index);
+                llc_depth = obj->attr->cache.depth;
+            }
+        }
+
+        return llc;
+    }
+
    private:
     unsigned int numa_id_;
     unsigned int socket_id_;
@@ -234,6 +265,57 @@ struct set_affinity
     }
 };
 
+struct get_current_cpu
+{
+    inline bool operator()(cpu_identifier_type &id)
+    {
+        bool retval = false;
+        hwloc_cpuset_t cpu_set = hwloc_bitmap_alloc();
+
+        if (0 == hwloc_get_last_cpu_location(topology::instance().get(),
+                                             cpu_set, HWLOC_CPUBIND_THREAD))
+        {
+            int first = hwloc_bitmap_first(cpu_set);
+
+            if (first >= 0)
+            {
+                id = cpu_identifier_type(first);
+                retval = true;
+            }
+        }
+
+        hwloc_bitmap_free(cpu_set);
+
+        return retval;
+    }
+};
+
+// restartable sequences are not available through hwloc, so per cpu data
+// is always updated with atomic operations
+struct per_cpu_ops
+{
+    inline bool available() { return false; }
+    inline bool current_cpu(cpu_identifier_type &) { return false; }
+
+    inline int add(volatile intptr_t *, intptr_t, const cpu_identifier_type &)
+    {
+        return -1;
+    }
+
+    inline int compare_and_store(volatile intptr_t *,
+                                 intptr_t,
+                                 intptr_t,
+                                 const cpu_identifier_type &)
+    {
+        return -1;
+    }
+
+    inline int pop(volatile intptr_t *, intptr_t &, const cpu_identifier_type &)
+    {
+        return -1;
+    }
+};
+
 #if defined(CPUAFF_PCI_SUPPORTED)
 
 typedef std::string pci_address_type;
@@ -291,6 +373,8 @@ struct traits
     typedef hwloc_impl::cpu_loader_vector_type cpu_loader_vector_type;
     typedef get_affinity get_affinity_type;
     typedef set_affinity set_affinity_type;
+    typedef get_current_cpu get_current_cpu_type;
+    typedef per_cpu_ops per_cpu_ops_type;
 
 #if defined(CPUAFF_PCI_SUPPORTED)
     typedef hwloc_impl::pci_address_type pci_address_type;
@@ -0,0 +1,121 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// glibc registers an rseq area for every thread from 2.35 on and exports
+// where it lives.  Define CPUAFF_NO_RSEQ to always go through sched_getcpu().
+#if !defined(CPUAFF_NO_RSEQ) && defined(__GLIBC__) &&                 \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35)) &&   \
+    (defined(__x86_64__) || defined(__aarch64__))
+#include <sys/rseq.h>
+#define CPUAFF_RSEQ_SUPPORTED
+#endif
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+/*!
+ * Reads the native id of the cpu the calling thread is running on.  When
+ * the thread has a registered rseq area the kernel keeps the id there and it
+ * is a plain load; otherwise sched_getcpu() is used, which goes through the
+ * vDSO where the kernel provides one.  Either way the answer may be stale by
+ * the time the caller uses it unless the thread is pinned.
+ */
+class current_cpu_reader
+{
+   public:
+    /*!
+     * Get the native id of the current cpu.
+     *
+     * \return the native cpu id, or -1 if it could not be determined.
+     */
+    static inline int get()
+    {
+#if defined(CPUAFF_RSEQ_SUPPORTED)
+        const volatile struct rseq *area = rseq_area();
+
+        if (area)
+        {
+            // cpu_id is negative if registration failed for this thread
+            int32_t cpu = int32_t(area->cpu_id);
+
+            if (cpu >= 0)
+            {
+                return cpu;
+            }
+        }
+#endif
+
+        return sched_getcpu();
+    }
+
+    /*!
+     * Check whether the calling thread reads its cpu from an rseq area.
+     */
+    static inline bool uses_rseq()
+    {
+#if defined(CPUAFF_RSEQ_SUPPORTED)
+        const volatile struct rseq *area = rseq_area();
+        return area && int32_t(area->cpu_id) >= 0;
+#else
+        return false;
+#endif
+    }
+
+#if defined(CPUAFF_RSEQ_SUPPORTED)
+    /*!
+     * Get the rseq area glibc registered for the calling thread.
+     *
+     * \return the area, or NULL if glibc did not register one (for instance
+     * when disabled with the glibc.pthread.rseq tunable).
+     */
+    static inline const volatile struct rseq *rseq_area()
+    {
+        if (__rseq_size == 0)
+        {
+            return NULL;
+        }
+
+        return reinterpret_cast< const volatile struct rseq * >(
+            static_cast< char * >(__builtin_thread_pointer()) + __rseq_offset);
+    }
+#endif
+};
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
@@ -0,0 +1,247 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "../../fwd.hpp"
+#include "set_reader.hpp"
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+class irq_reader
+{
+   public:
+    struct raw_irq_info
+    {
+        int32_t irq;
+        uint64_t count;
+        std::string description;
+
+        inline raw_irq_info() : irq(-1), count(0) {}
+    };
+
+   public:
+    inline irq_reader(const std::string &proc_root = "/proc",
+                      const std::string &sys_root = "/sys")
+        : proc_root_(proc_root), sys_root_(sys_root)
+    {
+    }
+
+    inline bool load()
+    {
+        irqs_.clear();
+
+        std::ifstream infile((proc_root_ + "/interrupts").c_str());
+
+        if (infile.good())
+        {
+            std::string line;
+            std::getline(infile, line);
+
+            // the header has one column per online cpu
+            std::istringstream header(line);
+            std::string column;
+            int32_t columns = 0;
+
+            while (header >> column)
+            {
+                ++columns;
+            }
+
+            while (std::getline(infile, line))
+            {
+                raw_irq_info info;
+
+                if (parse_irq(info, line, columns))
+                {
+                    irqs_.push_back(info);
+                }
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    inline const std::vector< raw_irq_info > &irqs() const { return irqs_; }
+
+    inline bool read_device_irqs(std::set< int32_t > &irqs,
+                                 const std::string &address) const
+    {
+        irqs.clear();
+
+        std::string device = sys_root_ + "/bus/pci/devices/" + address;
+        DIR *dir;
+        struct dirent *ent;
+
+        if ((dir = opendir((device + "/msi_irqs").c_str())) != NULL)
+        {
+            while ((ent = readdir(dir)) != NULL)
+            {
+                if (ent->d_name[0] >= '0' && ent->d_name[0] <= '9')
+                {
+                    irqs.insert(atoi(ent->d_name));
+                }
+            }
+
+            closedir(dir);
+        }
+
+        if (irqs.empty())
+        {
+            // fall back to the legacy INTx interrupt line
+            std::ifstream infile((device + "/irq").c_str());
+
+            if (infile.good())
+            {
+                int32_t irq = 0;
+                infile >> irq;
+
+                if (irq > 0)
+                {
+                    irqs.insert(irq);
+                }
+            }
+        }
+
+        return !irqs.empty();
+    }
+
+    inline bool read_affinity(std::set< int32_t > &cpus,
+                              const int32_t &irq) const
+    {
+        cpus.clear();
+        std::ifstream infile(affinity_file(irq).c_str());
+
+        if (infile.good())
+        {
+            std::string line;
+            std::getline(infile, line);
+            set_reader::read_int_set(cpus, line);
+        }
+
+        return !cpus.empty();
+    }
+
+    inline bool write_affinity(const int32_t &irq,
+                               const std::set< int32_t > &cpus) const
+    {
+        std::string list;
+
+        if (set_reader::write_int_set(list, cpus))
+        {
+            std::ofstream outfile(affinity_file(irq).c_str());
+
+            if (outfile.good())
+            {
+                outfile << list << std::endl;
+                outfile.close();
+                return !outfile.fail();
+            }
+        }
+
+        return false;
+    }
+
+   private:
+    inline std::string affinity_file(const int32_t &irq) const
+    {
+        std::ostringstream buf;
+        buf << proc_root_ << "/irq/" << irq << "/smp_affinity_list";
+        return buf.str();
+    }
+
+    inline bool parse_irq(raw_irq_info &info,
+                          const std::string &line,
+                          int32_t columns)
+    {
+        std::string::size_type colon = line.find(':');
+
+        if (colon == std::string::npos)
+        {
+            return false;
+        }
+
+        // only numbered interrupts can be steered, so skip NMI, LOC, etc.
+        std::string irq = line.substr(0, colon);
+        std::string::size_type first = irq.find_first_not_of(' ');
+
+        if (first == std::string::npos ||
+            irq.find_first_not_of("0123456789", first) != std::string::npos)
+        {
+            return false;
+        }
+
+        info.irq = int32_t(atoi(irq.c_str() + first));
+
+        std::istringstream buf(line.substr(colon + 1));
+
+        for (int32_t i = 0; i < columns; ++i)
+        {
+            uint64_t count = 0;
+
+            if (!(buf >> count))
+            {
+                break;
+            }
+
+            info.count += count;
+        }
+
+        std::getline(buf, info.description);
+        first = info.description.find_first_not_of(' ');
+        info.description = (first == std::string::npos)
+                               ? std::string()
+                               : info.description.substr(first);
+
+        return true;
+    }
+
+   private:
+    std::string proc_root_;
+    std::string sys_root_;
+    std::vector< raw_irq_info > irqs_;
+};
+
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
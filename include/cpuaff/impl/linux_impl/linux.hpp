@@ -31,7 +31,9 @@
 #pragma once
 
 #include "../../cpu_spec.hpp"
+#include "../../placement_policy.hpp"
 
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
@@ -43,13 +45,34 @@
 #include <sched.h>
 #include <unistd.h>
 
+#include "current_cpu_reader.hpp"
+#include "rseq_ops.hpp"
 #include "sysfs_reader.hpp"
 
 #if defined(CPUAFF_PCI_SUPPORTED)
 #include "../../pci_device_spec.hpp"
+#include "irq_reader.hpp"
 #include "pci_device_reader.hpp"
 #endif
 
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+#include <sys/mman.h>
+#include "page_mover.hpp"
+#endif
+
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+#include "shared_cpu_table.hpp"
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+#include "periodic_runner.hpp"
+#include "thread_inspector.hpp"
+#endif
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+#include "proc_stat_reader.hpp"
+#endif
+
 namespace cpuaff
 {
 namespace impl
@@ -80,11 +103,13 @@ struct cpu_info
     cpu_spec spec;
     cpu_identifier_wrapper id;
     numa_type numa;
+    llc_type llc;
 
     inline cpu_info(const cpu_spec &s,
                     const cpu_identifier_type &i,
-                    const numa_type &n)
-        : spec(s), id(i), numa(n)
+                    const numa_type &n,
+                    const llc_type &l = -1)
+        : spec(s), id(i), numa(n), llc(l)
     {
     }
 };
@@ -101,6 +126,7 @@ struct cpu_loader
         std::map< int32_t, std::map< int32_t, int32_t > > cores_by_socket;
         std::map< int32_t, std::map< int32_t, std::vector< int32_t > > >
             pus_by_socket_by_core;
+        std::map< int32_t, int32_t > llcs;
 
         if (sysfs_reader::load_cpus(pus))
         {
@@ -129,10 +155,29 @@ struct cpu_loader
                 pu_id = pus_by_socket_by_core[pu->socket][core].size();
                 pus_by_socket_by_core[pu->socket][core].push_back(0);
 
+                // number the last level caches from zero in the order they
+                // are found, as with cores
+                llc_type llc = -1;
+
+                if (pu->llc >= 0)
+                {
+                    std::map< int32_t, int32_t >::iterator j =
+                        llcs.find(pu->llc);
+
+                    if (j == llcs.end())
+                    {
+                        j = llcs.insert(std::make_pair(pu->llc,
+                                                       int32_t(llcs.size())))
+                                .first;
+                    }
+
+                    llc = llc_type(j->second);
+                }
+
                 v.push_back(cpu_info(
                     cpu_spec(socket_type(pu->socket), core_type(core),
                              processing_unit_type(pu_id)),
-                    cpu_identifier_type(pu->native), numa_type(pu->node)));
+                    cpu_identifier_type(pu->native), numa_type(pu->node), llc));
             }
         }
 
@@ -183,28 +228,332 @@ struct set_affinity
     }
 };
 
+struct get_current_cpu
+{
+    inline bool operator()(cpu_identifier_type &id)
+    {
+        id = current_cpu_reader::get();
+        return id >= 0;
+    }
+};
+
+struct per_cpu_ops
+{
+    inline bool available() { return rseq_ops::available(); }
+
+    inline bool current_cpu(cpu_identifier_type &id)
+    {
+        id = rseq_ops::current_cpu();
+        return id >= 0;
+    }
+
+    inline int add(volatile intptr_t *value,
+                   intptr_t count,
+                   const cpu_identifier_type &id)
+    {
+        return rseq_ops::add(value, count, id);
+    }
+
+    inline int compare_and_store(volatile intptr_t *value,
+                                 intptr_t expected,
+                                 intptr_t desired,
+                                 const cpu_identifier_type &id)
+    {
+        return rseq_ops::compare_and_store(value, expected, desired, id);
+    }
+
+    inline int pop(volatile intptr_t *head,
+                   intptr_t &popped,
+                   const cpu_identifier_type &id)
+    {
+        return rseq_ops::pop(head, popped, id);
+    }
+};
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+
+struct get_page_numa
+{
+    inline bool operator()(std::vector< numa_type > &numas,
+                           const void *buffer,
+                           std::size_t length)
+    {
+        return page_mover::query(numas, buffer, length);
+    }
+};
+
+struct set_memory_policy
+{
+    inline bool operator()(const memory_policy::type &policy,
+                           const std::set< numa_type > &numas)
+    {
+        switch (policy)
+        {
+            case memory_policy::local:
+                return page_mover::set_policy(page_mover::mpol_preferred,
+                                              std::vector< numa_type >());
+
+            case memory_policy::interleave:
+                return page_mover::set_policy(
+                    page_mover::mpol_interleave,
+                    std::vector< numa_type >(numas.begin(), numas.end()));
+
+            default:
+                return page_mover::set_policy(page_mover::mpol_default,
+                                              std::vector< numa_type >());
+        }
+    }
+};
+
+struct set_page_numa
+{
+    inline bool operator()(const void *buffer,
+                           std::size_t length,
+                           const std::vector< numa_type > &numas)
+    {
+        return page_mover::move(buffer, length, numas);
+    }
+};
+
+struct node_allocator
+{
+    /*!
+     * Map zeroed, page aligned memory that prefers to be backed by the given
+     * numa node.  The preference is only a hint; if the node cannot be used
+     * the memory comes from wherever the kernel would otherwise take it.
+     *
+     * If strict is set the memory is bound to the node instead, so that it
+     * is only ever backed by that node, and NULL is returned if it cannot be
+     * bound.
+     */
+    inline void *allocate(std::size_t length,
+                          const numa_type &numa,
+                          bool strict = false)
+    {
+        void *buffer = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (buffer == MAP_FAILED)
+        {
+            return NULL;
+        }
+
+        if (numa >= 0 &&
+            !page_mover::bind(buffer, length,
+                              (strict) ? page_mover::mpol_bind
+                                       : page_mover::mpol_preferred,
+                              std::vector< numa_type >(1, numa)) &&
+            strict)
+        {
+            munmap(buffer, length);
+            return NULL;
+        }
+
+        return buffer;
+    }
+
+    inline void deallocate(void *buffer, std::size_t length)
+    {
+        munmap(buffer, length);
+    }
+};
+
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+
+struct thread_control
+{
+    inline thread_id_type current_thread()
+    {
+        return thread_inspector::current_thread();
+    }
+
+    inline bool set_name(const std::string &name)
+    {
+        return thread_inspector::set_name(name);
+    }
+
+    inline bool get_name(std::string &name, const thread_id_type &tid)
+    {
+        return thread_inspector::get_name(name, tid);
+    }
+
+    inline bool is_alive(const thread_id_type &tid)
+    {
+        return thread_inspector::is_alive(tid);
+    }
+
+    inline bool get_affinity(std::set< cpu_identifier_wrapper > &cpus,
+                             const thread_id_type &tid)
+    {
+        std::vector< cpu_identifier_wrapper > ids;
+        cpus.clear();
+
+        if (thread_inspector::get_affinity(ids, tid))
+        {
+            cpus.insert(ids.begin(), ids.end());
+            return true;
+        }
+
+        return false;
+    }
+
+    inline bool get_affinity(std::vector< cpu_identifier_wrapper > &cpus,
+                             const thread_id_type &tid)
+    {
+        return thread_inspector::get_affinity(cpus, tid);
+    }
+
+    inline bool set_affinity(const std::set< cpu_identifier_wrapper > &cpus,
+                             const thread_id_type &tid)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+
+        std::set< cpu_identifier_wrapper >::const_iterator i = cpus.begin();
+        std::set< cpu_identifier_wrapper >::const_iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            CPU_SET(i->get(), &cpu_set);
+        }
+
+        return (0 == sched_setaffinity(pid_t(tid), sizeof(cpu_set_t),
+                                       &cpu_set));
+    }
+
+    inline bool get_sched_stats(sched_stats &stats, const thread_id_type &tid)
+    {
+        return thread_inspector::get_sched_stats(stats, tid);
+    }
+
+    inline bool get_last_cpu(cpu_identifier_wrapper &cpu,
+                             const thread_id_type &tid)
+    {
+        int id;
+
+        if (thread_inspector::get_last_cpu(id, tid))
+        {
+            cpu = cpu_identifier_wrapper(id);
+            return true;
+        }
+
+        return false;
+    }
+};
+
+#endif
+
 #if defined(CPUAFF_PCI_SUPPORTED)
 
 typedef std::string pci_address_type;
 
+/*!
+ * A pci address (domain:bus:device.function) packed into a single integer so
+ * that it compares, copies, and hashes without touching a string.  The domain
+ * is kept at 32 bits rather than 16 because Intel VMD exposes domains of
+ * 0x10000 and above.
+ */
 class pci_address_wrapper
 {
    public:
-    inline pci_address_wrapper() {}
+    typedef uint64_t packed_type;
+
+   public:
+    inline pci_address_wrapper() : address_(invalid()) {}
     inline pci_address_wrapper(const pci_address_type &address)
-        : address_(address)
+        : address_(parse(address.c_str()))
     {
     }
 
    public:
-    const inline pci_address_type &get() const { return address_; }
+    /*!
+     * Get the address in its sysfs form, for instance "0000:3b:00.1".
+     */
+    inline pci_address_type get() const
+    {
+        if (!valid())
+        {
+            return pci_address_type();
+        }
+
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%04x:%02x:%02x.%x", domain(), bus(),
+                 device(), function());
+        return buf;
+    }
+
+    inline bool valid() const { return address_ != invalid(); }
+    inline const packed_type &packed() const { return address_; }
+    inline uint32_t domain() const { return uint32_t(address_ >> 16); }
+    inline uint32_t bus() const { return uint32_t(address_ >> 8) & 0xff; }
+    inline uint32_t device() const { return uint32_t(address_ >> 3) & 0x1f; }
+    inline uint32_t function() const { return uint32_t(address_) & 0x7; }
+
+    /*!
+     * Get a hash of the address for callers that keep their own hash tables
+     * of devices.
+     */
+    inline std::size_t hash() const
+    {
+        // fold the domain into the low bits where bus:device.function live
+        return std::size_t(address_ ^ (address_ >> 29));
+    }
+
     inline bool operator<(const pci_address_wrapper &rhs) const
     {
         return address_ < rhs.address_;
     }
 
+    inline bool operator==(const pci_address_wrapper &rhs) const
+    {
+        return address_ == rhs.address_;
+    }
+
+    inline bool operator!=(const pci_address_wrapper &rhs) const
+    {
+        return address_ != rhs.address_;
+    }
+
+   private:
+    static inline packed_type invalid() { return ~packed_type(0); }
+
+    static inline packed_type parse(const char *address)
+    {
+        // accept dddd:bb:dd.f as well as the domainless bb:dd.f lspci prints
+        unsigned int domain = 0;
+        unsigned int bus;
+        unsigned int device;
+        unsigned int function;
+        int consumed = 0;
+
+        if (sscanf(address, "%x:%x:%x.%x%n", &domain, &bus, &device,
+                   &function, &consumed) != 4 ||
+            address[consumed] != '\0')
+        {
+            domain = 0;
+            consumed = 0;
+
+            if (sscanf(address, "%x:%x.%x%n", &bus, &device, &function,
+                       &consumed) != 3 ||
+                address[consumed] != '\0')
+            {
+                return invalid();
+            }
+        }
+
+        if (bus > 0xff || device > 0x1f || function > 0x7)
+        {
+            return invalid();
+        }
+
+        return (packed_type(domain) << 16) | (packed_type(bus) << 8) |
+               (packed_type(device) << 3) | packed_type(function);
+    }
+
    private:
-    pci_address_type address_;
+    packed_type address_;
 };
 
 struct pci_device_info
@@ -212,11 +561,33 @@ struct pci_device_info
     pci_device_spec spec;
     numa_type numa;
     pci_address_type address;
-
-    inline pci_device_info(const pci_device_spec &s,
-                           const numa_type &n,
-                           const pci_address_type &a)
-        : spec(s), numa(n), address(a)
+    pci_address_type parent;
+    std::string root_complex;
+    pci_address_type physical_function;
+    std::vector< pci_address_type > virtual_functions;
+    std::set< cpu_identifier_wrapper > local_cpus;
+    pci_class_type device_class;
+    pci_device_spec subsystem;
+    pci_link_speed_type current_link_speed;
+    pci_link_width_type current_link_width;
+    pci_link_speed_type max_link_speed;
+    pci_link_width_type max_link_width;
+
+    inline pci_device_info(const pci_device_reader::raw_pci_info &info)
+        : spec(info.spec)
+        , numa(info.numa)
+        , address(info.address)
+        , parent(info.parent)
+        , root_complex(info.root_complex)
+        , physical_function(info.physical_function)
+        , virtual_functions(info.virtual_functions)
+        , local_cpus(info.local_cpus.begin(), info.local_cpus.end())
+        , device_class(info.device_class)
+        , subsystem(info.subsystem)
+        , current_link_speed(info.current_link_speed)
+        , current_link_width(info.current_link_width)
+        , max_link_speed(info.max_link_speed)
+        , max_link_width(info.max_link_width)
     {
     }
 };
@@ -238,13 +609,7 @@ struct pci_loader
 
             for (; i != iend; ++i)
             {
-                std::ostringstream buf;
-                buf << std::hex;
-                buf << std::setfill('0') << std::setw(4) << i->spec.vendor();
-                buf << ":" << std::setfill('0') << std::setw(4)
-                    << i->spec.device();
-
-                v.push_back(pci_device_info(i->spec, i->numa, i->address));
+                v.push_back(pci_device_info(*i));
             }
 
             return true;
@@ -254,6 +619,17 @@ struct pci_loader
     }
 };
 
+struct pci_address_resolver
+{
+    inline bool operator()(std::vector< pci_address_type > &addresses,
+                           const std::string &device_class,
+                           const std::string &name)
+    {
+        return pci_device_reader::read_class_device_addresses(
+            addresses, device_class, name);
+    }
+};
+
 #endif
 
 struct traits
@@ -264,12 +640,36 @@ struct traits
     typedef linux_impl::cpu_loader_vector_type cpu_loader_vector_type;
     typedef get_affinity get_affinity_type;
     typedef set_affinity set_affinity_type;
+    typedef get_current_cpu get_current_cpu_type;
+    typedef per_cpu_ops per_cpu_ops_type;
 
 #if defined(CPUAFF_PCI_SUPPORTED)
     typedef linux_impl::pci_address_type pci_address_type;
     typedef pci_address_wrapper pci_address_wrapper_type;
     typedef pci_loader pci_loader_type;
     typedef linux_impl::pci_loader_vector_type pci_loader_vector_type;
+    typedef irq_reader irq_reader_type;
+    typedef pci_address_resolver pci_address_resolver_type;
+#endif
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+    typedef get_page_numa get_page_numa_type;
+    typedef set_page_numa set_page_numa_type;
+    typedef set_memory_policy set_memory_policy_type;
+    typedef node_allocator node_allocator_type;
+#endif
+
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+    typedef shared_cpu_table shared_cpu_table_type;
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+    typedef thread_control thread_control_type;
+    typedef periodic_runner periodic_runner_type;
+#endif
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+    typedef proc_stat_reader cpu_times_reader_type;
 #endif
 };
 
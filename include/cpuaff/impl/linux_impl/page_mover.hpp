@@ -0,0 +1,242 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "../../fwd.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+namespace page_mover
+{
+// from linux/mempolicy.h, which is not always available
+const int move_flag = (1 << 1);
+const int mpol_default = 0;
+const int mpol_preferred = 1;
+const int mpol_bind = 2;
+const int mpol_interleave = 3;
+
+inline std::size_t page_size()
+{
+    long size = sysconf(_SC_PAGESIZE);
+    return (size > 0) ? std::size_t(size) : std::size_t(4096);
+}
+
+inline void get_pages(std::vector< void * > &pages,
+                      const void *buffer,
+                      std::size_t length)
+{
+    pages.clear();
+
+    if (length == 0)
+    {
+        return;
+    }
+
+    std::size_t size = page_size();
+    uintptr_t begin = uintptr_t(buffer) & ~uintptr_t(size - 1);
+    uintptr_t end = uintptr_t(buffer) + length;
+
+    pages.reserve((end - begin + size - 1) / size);
+
+    for (uintptr_t page = begin; page < end; page += size)
+    {
+        pages.push_back(reinterpret_cast< void * >(page));
+    }
+}
+
+inline bool move_pages(std::vector< int > &status,
+                       std::vector< void * > &pages,
+                       int *nodes,
+                       int flags)
+{
+    status.assign(pages.size(), -1);
+
+    if (pages.empty())
+    {
+        return true;
+    }
+
+    long rc = syscall(SYS_move_pages, 0, (unsigned long)pages.size(),
+                      &pages[0], nodes, &status[0], flags);
+
+    return rc >= 0;
+}
+
+inline bool query(std::vector< numa_type > &numas,
+                  const void *buffer,
+                  std::size_t length)
+{
+    numas.clear();
+
+    std::vector< void * > pages;
+    std::vector< int > status;
+    get_pages(pages, buffer, length);
+
+    if (move_pages(status, pages, NULL, 0))
+    {
+        numas.reserve(status.size());
+
+        std::vector< int >::const_iterator i = status.begin();
+        std::vector< int >::const_iterator iend = status.end();
+
+        for (; i != iend; ++i)
+        {
+            // negative status means the page is not present (or not
+            // accessible), which we report as numa node -1
+            numas.push_back((*i >= 0) ? numa_type(*i) : numa_type(-1));
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+inline bool move(const void *buffer,
+                 std::size_t length,
+                 const std::vector< numa_type > &targets)
+{
+    if (targets.empty())
+    {
+        return false;
+    }
+
+    std::vector< void * > pages;
+    std::vector< int > nodes;
+    std::vector< int > status;
+    get_pages(pages, buffer, length);
+
+    nodes.reserve(pages.size());
+
+    for (std::size_t i = 0; i < pages.size(); ++i)
+    {
+        nodes.push_back(int(targets[i % targets.size()]));
+    }
+
+    if (nodes.empty())
+    {
+        return true;
+    }
+
+    if (move_pages(status, pages, &nodes[0], move_flag))
+    {
+        std::vector< int >::const_iterator i = status.begin();
+        std::vector< int >::const_iterator iend = status.end();
+
+        for (; i != iend; ++i)
+        {
+            // pages that have never been touched have nothing to move
+            if (*i < 0 && *i != -ENOENT)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * Build the node mask taken by set_mempolicy and mbind.  Returns the maxnode
+ * argument that goes with it.
+ */
+inline unsigned long make_node_mask(std::vector< unsigned long > &mask,
+                                    const std::vector< numa_type > &targets)
+{
+    const std::size_t bits = sizeof(unsigned long) * 8;
+    mask.clear();
+
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        if (targets[i] < 0)
+        {
+            continue;
+        }
+
+        std::size_t node = std::size_t(targets[i]);
+
+        if (mask.size() <= node / bits)
+        {
+            mask.resize(node / bits + 1, 0);
+        }
+
+        mask[node / bits] |= 1UL << (node % bits);
+    }
+
+    // the kernel ignores the last bit of maxnode
+    return (mask.empty()) ? 0 : mask.size() * bits + 1;
+}
+
+/*!
+ * Set the memory policy of the calling thread.  A policy that takes no nodes
+ * (mpol_default, or mpol_preferred to allocate on the local node) is given
+ * an empty node list.
+ */
+inline bool set_policy(int mode, const std::vector< numa_type > &targets)
+{
+    std::vector< unsigned long > mask;
+    unsigned long maxnode = make_node_mask(mask, targets);
+
+    return 0 == syscall(SYS_set_mempolicy, mode,
+                        (mask.empty()) ? NULL : &mask[0], maxnode);
+}
+
+/*!
+ * Set the memory policy of a page aligned range of the address space.  Pages
+ * that are already resident are not moved, so this should be done before the
+ * range is first touched.
+ */
+inline bool bind(const void *buffer,
+                 std::size_t length,
+                 int mode,
+                 const std::vector< numa_type > &targets)
+{
+    std::vector< unsigned long > mask;
+    unsigned long maxnode = make_node_mask(mask, targets);
+
+    return 0 == syscall(SYS_mbind, buffer, (unsigned long)length, mode,
+                        (mask.empty()) ? NULL : &mask[0], maxnode, 0);
+}
+}  // namespace page_mover
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
@@ -31,13 +31,17 @@
 #pragma once
 #include "../../pci_device_spec.hpp"
 #include "set_reader.hpp"
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <dirent.h>
-#include <fstream>
-#include <iostream>
+#include <fcntl.h>
+#include <limits.h>
+#include <set>
 #include <sstream>
 #include <stdint.h>
 #include <string>
+#include <unistd.h>
 #include <vector>
 
 namespace cpuaff
@@ -54,12 +58,25 @@ class pci_device_reader
         pci_device_spec spec;
         numa_type numa;
         std::string address;
-
-        inline raw_pci_info() : numa(-1) {}
-        inline raw_pci_info(const pci_device_spec &s,
-                            const numa_type &n,
-                            const std::string &a)
-            : spec(s), numa(n), address(a)
+        std::string parent;
+        std::string root_complex;
+        std::string physical_function;
+        std::vector< std::string > virtual_functions;
+        std::set< int32_t > local_cpus;
+        pci_class_type device_class;
+        pci_device_spec subsystem;
+        pci_link_speed_type current_link_speed;
+        pci_link_width_type current_link_width;
+        pci_link_speed_type max_link_speed;
+        pci_link_width_type max_link_width;
+
+        inline raw_pci_info()
+            : numa(-1)
+            , device_class(-1)
+            , current_link_speed(0)
+            , current_link_width(0)
+            , max_link_speed(0)
+            , max_link_width(0)
         {
         }
     };
@@ -74,7 +91,10 @@ class pci_device_reader
         {
             while ((ent = readdir(dir)) != NULL)
             {
-                load_device(ent->d_name);
+                if (ent->d_name[0] != '.')
+                {
+                    load_device(ent->d_name);
+                }
             }
 
             closedir(dir);
@@ -90,84 +110,278 @@ class pci_device_reader
         return devices_;
     }
 
+    /*!
+     * Read the pci addresses in the sysfs path of a class device (for
+     * instance "net" and "eth0" or "block" and "nvme0n1").  The addresses are
+     * ordered from the device closest to the class device up to the root
+     * port.
+     */
+    static inline bool read_class_device_addresses(
+        std::vector< std::string > &addresses,
+        const std::string &device_class,
+        const std::string &name)
+    {
+        addresses.clear();
+
+        if (name.empty() || name.find('/') != std::string::npos)
+        {
+            return false;
+        }
+
+        std::string link = "/sys/class/" + device_class + "/" + name;
+        char path[PATH_MAX];
+
+        if (realpath(link.c_str(), path) != NULL)
+        {
+            std::string component;
+            std::istringstream buf(path);
+
+            while (std::getline(buf, component, '/'))
+            {
+                if (is_address(component))
+                {
+                    addresses.insert(addresses.begin(), component);
+                }
+            }
+        }
+
+        return !addresses.empty();
+    }
+
    private:
-    inline bool load_device(const std::string &address)
+    static inline bool is_address(const std::string &str)
+    {
+        // dddd:bb:dd.f where the domain may be wider than four digits
+        std::string::size_type colon = str.find(':');
+
+        return (colon != std::string::npos && colon >= 4 &&
+                str.length() == colon + 8 && str[colon + 3] == ':' &&
+                str[colon + 6] == '.' &&
+                str.find_first_not_of("0123456789abcdef:.") ==
+                    std::string::npos);
+    }
+
+    inline bool load_device(const char *address)
     {
         raw_pci_info info;
+        char buf[4096];
+
+        // every device has a vendor and a device id
+        if (!read_attribute(buf, sizeof(buf), address, "vendor"))
+        {
+            return false;
+        }
+
+        info.spec.vendor(pci_vendor_id_type(strtol(buf, NULL, 0)));
+
+        if (!read_attribute(buf, sizeof(buf), address, "device"))
+        {
+            return false;
+        }
+
+        info.spec.device(pci_device_id_type(strtol(buf, NULL, 0)));
         info.address = address;
+        read_hierarchy(info);
+        read_sriov(info);
 
-        if (!read_numa(info))
+        if (read_attribute(buf, sizeof(buf), address, "numa_node"))
         {
-            info.numa = -1;
+            info.numa = numa_type(atoi(buf));
         }
 
-        if (read_device_spec(info))
+        if (read_attribute(buf, sizeof(buf), address, "local_cpulist"))
         {
-            devices_.push_back(info);
-            return true;
+            set_reader::read_int_set(info.local_cpus, buf);
+        }
+        else if (read_attribute(buf, sizeof(buf), address, "local_cpus"))
+        {
+            set_reader::read_int_mask(info.local_cpus, buf);
         }
 
-        return false;
+        if (read_attribute(buf, sizeof(buf), address, "class"))
+        {
+            info.device_class = pci_class_type(strtol(buf, NULL, 0));
+        }
+
+        if (read_attribute(buf, sizeof(buf), address, "subsystem_vendor"))
+        {
+            info.subsystem.vendor(pci_vendor_id_type(strtol(buf, NULL, 0)));
+        }
+
+        if (read_attribute(buf, sizeof(buf), address, "subsystem_device"))
+        {
+            info.subsystem.device(pci_device_id_type(strtol(buf, NULL, 0)));
+        }
+
+        // devices without a pcie link (or whose link speed is "Unknown")
+        // are left at 0
+        if (read_attribute(buf, sizeof(buf), address, "current_link_speed"))
+        {
+            info.current_link_speed = pci_link_speed_type(strtod(buf, NULL));
+        }
+
+        if (read_attribute(buf, sizeof(buf), address, "current_link_width"))
+        {
+            info.current_link_width = pci_link_width_type(atoi(buf));
+        }
+
+        if (read_attribute(buf, sizeof(buf), address, "max_link_speed"))
+        {
+            info.max_link_speed = pci_link_speed_type(strtod(buf, NULL));
+        }
+
+        if (read_attribute(buf, sizeof(buf), address, "max_link_width"))
+        {
+            info.max_link_width = pci_link_width_type(atoi(buf));
+        }
+
+        devices_.push_back(info);
+        return true;
     }
 
-    inline bool read_numa(raw_pci_info &info)
+    /*!
+     * Resolve the sysfs path of a device (for instance
+     * /sys/devices/pci0000:00/0000:00:01.0/0000:01:00.0) into the bridge it
+     * sits behind and the root complex it belongs to.  A device attached
+     * directly to the root complex has no parent.
+     */
+    static inline bool read_hierarchy(raw_pci_info &info)
     {
-        bool retval = false;
-        std::ostringstream buf;
-        buf << "/sys/bus/pci/devices/" << info.address << "/numa_node";
+        std::string link = "/sys/bus/pci/devices/" + info.address;
+        char path[PATH_MAX];
 
-        std::ifstream infile(buf.str().c_str());
+        info.parent.clear();
+        info.root_complex.clear();
 
-        if (infile.good())
+        if (realpath(link.c_str(), path) == NULL)
         {
-            std::string line;
-            std::getline(infile, line);
+            return false;
+        }
 
-            info.numa = atoi(line.c_str());
-            retval = true;
+        std::string component;
+        std::istringstream buf(path);
 
-            infile.close();
+        while (std::getline(buf, component, '/'))
+        {
+            if (component == info.address)
+            {
+                break;
+            }
+            else if (is_address(component))
+            {
+                info.parent = component;
+            }
+            else if (component.compare(0, 3, "pci") == 0 &&
+                     component.find(':') != std::string::npos)
+            {
+                // a root complex nested behind a device (as with intel vmd)
+                // starts a new hierarchy
+                info.root_complex = component;
+                info.parent.clear();
+            }
         }
 
-        return retval;
+        return !info.root_complex.empty();
     }
 
-    inline bool read_device_spec(raw_pci_info &info)
+    /*!
+     * Read the sr-iov links of a device.  A virtual function links back to
+     * its physical function through "physfn" and a physical function links
+     * to each of its virtual functions through "virtfn0", "virtfn1", etc.
+     */
+    static inline void read_sriov(raw_pci_info &info)
     {
-        bool retval = false;
+        char buf[64];
 
-        std::ostringstream buf;
-        buf << "/sys/bus/pci/devices/" << info.address << "/vendor";
+        info.physical_function.clear();
+        info.virtual_functions.clear();
 
-        std::ifstream vendorFile(buf.str().c_str());
+        if (read_link(buf, sizeof(buf), info.address.c_str(), "physfn"))
+        {
+            info.physical_function = buf;
+        }
 
-        if (vendorFile.good())
+        for (int i = 0;; ++i)
         {
-            std::string line;
-            std::getline(vendorFile, line);
+            char link[32];
+            snprintf(link, sizeof(link), "virtfn%d", i);
 
-            info.spec.vendor(pci_vendor_id_type(strtol(line.c_str(), NULL, 0)));
+            if (!read_link(buf, sizeof(buf), info.address.c_str(), link))
+            {
+                break;
+            }
 
-            vendorFile.close();
+            info.virtual_functions.push_back(buf);
+        }
+    }
 
-            buf.str("");
-            buf << "/sys/bus/pci/devices/" << info.address << "/device";
+    /*!
+     * Read the last component of the target of a symbolic link in a device
+     * directory.
+     */
+    static inline bool read_link(char *buf,
+                                 std::size_t size,
+                                 const char *address,
+                                 const char *link)
+    {
+        char path[PATH_MAX];
+        char target[PATH_MAX];
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/%s", address,
+                 link);
 
-            std::ifstream deviceFile(buf.str().c_str());
+        ssize_t length = readlink(path, target, sizeof(target) - 1);
 
-            if (deviceFile.good())
-            {
-                std::getline(deviceFile, line);
+        if (length <= 0)
+        {
+            return false;
+        }
 
-                info.spec.device(
-                    pci_device_id_type(strtol(line.c_str(), NULL, 0)));
+        target[length] = '\0';
 
-                vendorFile.close();
-                retval = true;
-            }
+        const char *name = strrchr(target, '/');
+        name = (name) ? name + 1 : target;
+
+        if (strlen(name) >= size || !is_address(name))
+        {
+            return false;
+        }
+
+        strcpy(buf, name);
+        return true;
+    }
+
+    static inline bool read_attribute(char *buf,
+                                      std::size_t size,
+                                      const char *address,
+                                      const char *attribute)
+    {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/%s", address,
+                 attribute);
+
+        int fd = open(path, O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        ssize_t length = pread(fd, buf, size - 1, 0);
+        close(fd);
+
+        if (length <= 0)
+        {
+            return false;
+        }
+
+        while (length > 0 &&
+               (buf[length - 1] == '\n' || buf[length - 1] == ' '))
+        {
+            --length;
         }
 
-        return retval;
+        buf[length] = '\0';
+        return length > 0;
     }
 
    private:
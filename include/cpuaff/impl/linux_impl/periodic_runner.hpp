@@ -0,0 +1,174 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+/*!
+ * Runs a callback on a background thread at a fixed interval until stopped.
+ * The thread sleeps on a condition variable against the monotonic clock so
+ * that stop() wakes it immediately and wall clock changes do not disturb the
+ * interval.
+ */
+class periodic_runner
+{
+   public:
+    typedef void (*callback_type)(void *);
+
+   public:
+    inline periodic_runner()
+        : callback_(NULL)
+        , arg_(NULL)
+        , interval_(0)
+        , running_(false)
+        , stopping_(false)
+    {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&cond_, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_init(&mutex_, NULL);
+    }
+
+    inline ~periodic_runner()
+    {
+        stop();
+        pthread_cond_destroy(&cond_);
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    /*!
+     * Start calling callback(arg) every interval nanoseconds, the first call
+     * being made one interval from now.
+     */
+    inline bool start(callback_type callback, void *arg, uint64_t interval)
+    {
+        if (running_ || callback == NULL || interval == 0)
+        {
+            return false;
+        }
+
+        callback_ = callback;
+        arg_ = arg;
+        interval_ = interval;
+        stopping_ = false;
+
+        running_ = (0 == pthread_create(&thread_, NULL, run, this));
+        return running_;
+    }
+
+    /*!
+     * Stop the background thread and wait for it to exit.  A callback that
+     * is in progress is allowed to finish.
+     */
+    inline void stop()
+    {
+        if (!running_)
+        {
+            return;
+        }
+
+        pthread_mutex_lock(&mutex_);
+        stopping_ = true;
+        pthread_cond_signal(&cond_);
+        pthread_mutex_unlock(&mutex_);
+
+        pthread_join(thread_, NULL);
+        running_ = false;
+    }
+
+    inline bool running() const { return running_; }
+
+   private:
+    periodic_runner(const periodic_runner &);
+    periodic_runner &operator=(const periodic_runner &);
+
+    static inline void *run(void *arg)
+    {
+        periodic_runner *self = static_cast< periodic_runner * >(arg);
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+        pthread_mutex_lock(&self->mutex_);
+
+        while (!self->stopping_)
+        {
+            // advance the deadline rather than sleeping for the interval so
+            // the time spent in the callback does not accumulate as drift
+            uint64_t nsec = uint64_t(deadline.tv_nsec) + self->interval_;
+            deadline.tv_sec += time_t(nsec / uint64_t(1000000000));
+            deadline.tv_nsec = long(nsec % uint64_t(1000000000));
+
+            int rc = 0;
+
+            while (!self->stopping_ && rc != ETIMEDOUT)
+            {
+                rc = pthread_cond_timedwait(&self->cond_, &self->mutex_,
+                                            &deadline);
+            }
+
+            if (self->stopping_)
+            {
+                break;
+            }
+
+            pthread_mutex_unlock(&self->mutex_);
+            self->callback_(self->arg_);
+            pthread_mutex_lock(&self->mutex_);
+        }
+
+        pthread_mutex_unlock(&self->mutex_);
+        return NULL;
+    }
+
+   private:
+    callback_type callback_;
+    void *arg_;
+    uint64_t interval_;
+    bool running_;
+    bool stopping_;
+    pthread_t thread_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;
+};
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
@@ -0,0 +1,173 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../../cpu_times.hpp"
+#include <fcntl.h>
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+/*!
+ * Reads the per cpu lines of /proc/stat.  The file is kept open and read
+ * with a single pread into a buffer that only grows, and parsed by hand, so
+ * repeated reads do not allocate once the buffer and the output vector have
+ * reached their working size.
+ */
+class proc_stat_reader
+{
+   public:
+    typedef std::vector< std::pair< int, cpu_times > > cpu_times_vector_type;
+
+   public:
+    inline proc_stat_reader(const std::string &proc_root = "/proc")
+        : path_(proc_root + "/stat"), fd_(-1), buffer_(8192)
+    {
+    }
+
+    inline ~proc_stat_reader()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+    /*!
+     * Read the times of every online cpu, as pairs of native cpu id and
+     * times since boot.
+     */
+    inline bool read(cpu_times_vector_type &cpus)
+    {
+        cpus.clear();
+
+        if (fd_ < 0 && (fd_ = open(path_.c_str(), O_RDONLY)) < 0)
+        {
+            return false;
+        }
+
+        ssize_t length;
+
+        // the whole file has to be read in one go to be consistent, so grow
+        // the buffer until it fits
+        while ((length = pread(fd_, &buffer_[0], buffer_.size() - 1, 0)) ==
+               ssize_t(buffer_.size() - 1))
+        {
+            buffer_.resize(buffer_.size() * 2);
+        }
+
+        if (length <= 0)
+        {
+            return false;
+        }
+
+        buffer_[length] = '\0';
+        parse(cpus, &buffer_[0]);
+        return !cpus.empty();
+    }
+
+   private:
+    proc_stat_reader(const proc_stat_reader &);
+    proc_stat_reader &operator=(const proc_stat_reader &);
+
+    static inline bool is_digit(const char &c) { return c >= '0' && c <= '9'; }
+
+    static inline uint64_t number(const char *&p)
+    {
+        uint64_t value = 0;
+
+        while (*p == ' ')
+        {
+            ++p;
+        }
+
+        for (; is_digit(*p); ++p)
+        {
+            value = value * 10 + uint64_t(*p - '0');
+        }
+
+        return value;
+    }
+
+    static inline void parse(cpu_times_vector_type &cpus, const char *p)
+    {
+        // the aggregate "cpu " line comes first and the per cpu lines follow
+        // it, so stop at the first line after them
+        while (*p != '\0')
+        {
+            if (p[0] == 'c' && p[1] == 'p' && p[2] == 'u' && is_digit(p[3]))
+            {
+                p += 3;
+                int id = int(number(p));
+                cpu_times times;
+                times.user = number(p);
+                times.nice = number(p);
+                times.system = number(p);
+                times.idle = number(p);
+                times.iowait = number(p);
+                times.irq = number(p);
+                times.softirq = number(p);
+                times.steal = number(p);
+                cpus.push_back(std::make_pair(id, times));
+            }
+            else if (!cpus.empty())
+            {
+                return;
+            }
+
+            while (*p != '\0' && *p != '\n')
+            {
+                ++p;
+            }
+
+            if (*p == '\n')
+            {
+                ++p;
+            }
+        }
+    }
+
+   private:
+    std::string path_;
+    int fd_;
+    std::vector< char > buffer_;
+};
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
@@ -0,0 +1,225 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "current_cpu_reader.hpp"
+#include <stdint.h>
+
+#if defined(CPUAFF_RSEQ_SUPPORTED) && defined(__x86_64__) && \
+    defined(RSEQ_SIG)
+#define CPUAFF_RSEQ_OPS_SUPPORTED
+#endif
+
+#if defined(CPUAFF_RSEQ_OPS_SUPPORTED)
+
+#define CPUAFF_RSEQ_STR_(x) #x
+#define CPUAFF_RSEQ_STR(x) CPUAFF_RSEQ_STR_(x)
+
+// Each critical section is described by a struct rseq_cs (version, flags,
+// start_ip, post_commit_offset, abort_ip) emitted into the __rseq_cs section
+// at label 3.  The section starts at label 1, commits with the store at
+// label 2 and restarts at label 4, which must be preceded by the signature
+// glibc registered the thread's rseq area with.  Offsets 4 and 8 into the
+// rseq area are cpu_id and rseq_cs.
+#define CPUAFF_RSEQ_DEFINE_TABLE                                   \
+    ".pushsection __rseq_cs, \"aw\"\n\t"                           \
+    ".balign 32\n\t"                                               \
+    "3:\n\t"                                                       \
+    ".long 0x0, 0x0\n\t"                                           \
+    ".quad 1f, (2f - 1f), 4f\n\t"                                  \
+    ".popsection\n\t"                                              \
+    ".pushsection __rseq_cs_ptr_array, \"aw\"\n\t"                 \
+    ".quad 3b\n\t"                                                 \
+    ".popsection\n\t"
+
+#define CPUAFF_RSEQ_START                                          \
+    "leaq 3b(%%rip), %%rax\n\t"                                    \
+    "movq %%rax, %%fs:8(%[rseq_offset])\n\t"                       \
+    "1:\n\t"                                                       \
+    "cmpl %[cpu], %%fs:4(%[rseq_offset])\n\t"                      \
+    "jnz 4f\n\t"
+
+#define CPUAFF_RSEQ_DEFINE_ABORT                                   \
+    ".pushsection __rseq_failure, \"ax\"\n\t"                      \
+    ".byte 0x0f, 0xb9, 0x3d\n\t"                                   \
+    ".long " CPUAFF_RSEQ_STR(RSEQ_SIG) "\n\t"                      \
+    "4:\n\t"                                                       \
+    "jmp %l[aborted]\n\t"                                          \
+    ".popsection\n\t"
+
+#endif
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+/*!
+ * Per cpu operations built on restartable sequences.  Each operation is
+ * given the native id of the cpu the caller expects to be running on and
+ * only commits, with a single plain store, if the thread is still running on
+ * that cpu and was not preempted, migrated or interrupted by a signal on the
+ * way.  Otherwise it reports that it was aborted and the caller retries.
+ *
+ * The operations are only safe if every update of the data belonging to a
+ * cpu is made by a thread running on that cpu through these operations.
+ * glibc (2.35 and later) registers the rseq area of every thread it creates;
+ * where it did not, available() is false and none of this can be used.
+ */
+namespace rseq_ops
+{
+enum result
+{
+    aborted = -1,
+    committed = 0,
+    mismatch = 1
+};
+
+/*!
+ * Check whether the calling thread can use restartable sequences.
+ */
+inline bool available()
+{
+#if defined(CPUAFF_RSEQ_OPS_SUPPORTED)
+    return current_cpu_reader::uses_rseq();
+#else
+    return false;
+#endif
+}
+
+/*!
+ * Get the native id of the current cpu from the rseq area.
+ *
+ * \return the native cpu id, or -1 if the thread has no rseq area.
+ */
+inline int current_cpu()
+{
+#if defined(CPUAFF_RSEQ_OPS_SUPPORTED)
+    const volatile struct rseq *area = current_cpu_reader::rseq_area();
+
+    if (area)
+    {
+        int32_t cpu = int32_t(area->cpu_id);
+        return (cpu >= 0) ? cpu : -1;
+    }
+#endif
+
+    return -1;
+}
+
+/*!
+ * Add count to *value if running on cpu.
+ */
+inline result add(volatile intptr_t *value, intptr_t count, int cpu)
+{
+#if defined(CPUAFF_RSEQ_OPS_SUPPORTED)
+    __asm__ __volatile__ goto(CPUAFF_RSEQ_DEFINE_TABLE CPUAFF_RSEQ_START
+                              "addq %[count], %[value]\n\t"
+                              "2:\n\t" CPUAFF_RSEQ_DEFINE_ABORT
+                              : /* no outputs */
+                              : [cpu] "r"(cpu),
+                                [rseq_offset] "r"(__rseq_offset),
+                                [value] "m"(*value), [count] "er"(count)
+                              : "memory", "cc", "rax"
+                              : aborted);
+    return committed;
+aborted:
+#endif
+    return aborted;
+}
+
+/*!
+ * Replace *value with desired if running on cpu and *value is expected.
+ */
+inline result compare_and_store(volatile intptr_t *value,
+                                intptr_t expected,
+                                intptr_t desired,
+                                int cpu)
+{
+#if defined(CPUAFF_RSEQ_OPS_SUPPORTED)
+    __asm__ __volatile__ goto(CPUAFF_RSEQ_DEFINE_TABLE CPUAFF_RSEQ_START
+                              "cmpq %[value], %[expected]\n\t"
+                              "jnz %l[mismatched]\n\t"
+                              "movq %[desired], %[value]\n\t"
+                              "2:\n\t" CPUAFF_RSEQ_DEFINE_ABORT
+                              : /* no outputs */
+                              : [cpu] "r"(cpu),
+                                [rseq_offset] "r"(__rseq_offset),
+                                [value] "m"(*value), [expected] "r"(expected),
+                                [desired] "r"(desired)
+                              : "memory", "cc", "rax"
+                              : aborted, mismatched);
+    return committed;
+aborted:
+    return aborted;
+mismatched:
+    return mismatch;
+#else
+    return aborted;
+#endif
+}
+
+/*!
+ * Pop the head of an intrusive list whose head is *head if running on cpu.
+ * The first word of every node of the list is the pointer to the next node.
+ * Reports mismatch if the list is empty.
+ */
+inline result pop(volatile intptr_t *head, intptr_t &popped, int cpu)
+{
+#if defined(CPUAFF_RSEQ_OPS_SUPPORTED)
+    __asm__ __volatile__ goto(CPUAFF_RSEQ_DEFINE_TABLE CPUAFF_RSEQ_START
+                              "movq %[head], %%rbx\n\t"
+                              "testq %%rbx, %%rbx\n\t"
+                              "jz %l[empty]\n\t"
+                              "movq %%rbx, %[popped]\n\t"
+                              "movq (%%rbx), %%rbx\n\t"
+                              "movq %%rbx, %[head]\n\t"
+                              "2:\n\t" CPUAFF_RSEQ_DEFINE_ABORT
+                              : /* no outputs */
+                              : [cpu] "r"(cpu),
+                                [rseq_offset] "r"(__rseq_offset),
+                                [head] "m"(*head), [popped] "m"(popped)
+                              : "memory", "cc", "rax", "rbx"
+                              : aborted, empty);
+    return committed;
+aborted:
+    return aborted;
+empty:
+    return mismatch;
+#else
+    return aborted;
+#endif
+}
+}  // namespace rseq_ops
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
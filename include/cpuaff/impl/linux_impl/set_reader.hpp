@@ -30,6 +30,7 @@
 
 #pragma once
 
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <set>
@@ -93,6 +94,89 @@ inline bool read_int_set(std::set< int32_t > &set, const std::string &str)
 
     return true;
 }
+
+inline bool read_int_mask(std::set< int32_t > &set, const std::string &str)
+{
+    set.clear();
+
+    // masks are comma separated 32 bit hex words, most significant first
+    int32_t bit = 0;
+    std::string::const_reverse_iterator i = str.rbegin();
+    std::string::const_reverse_iterator iend = str.rend();
+
+    for (; i != iend; ++i)
+    {
+        int32_t nibble;
+
+        if (*i >= '0' && *i <= '9')
+        {
+            nibble = *i - '0';
+        }
+        else if (*i >= 'a' && *i <= 'f')
+        {
+            nibble = *i - 'a' + 10;
+        }
+        else if (*i >= 'A' && *i <= 'F')
+        {
+            nibble = *i - 'A' + 10;
+        }
+        else
+        {
+            continue;
+        }
+
+        for (int32_t j = 0; j < 4; ++j)
+        {
+            if (nibble & (1 << j))
+            {
+                set.insert(bit + j);
+            }
+        }
+
+        bit += 4;
+    }
+
+    return true;
+}
+
+inline bool write_int_set(std::string &str, const std::set< int32_t > &set)
+{
+    str.clear();
+
+    std::set< int32_t >::const_iterator i = set.begin();
+    std::set< int32_t >::const_iterator iend = set.end();
+
+    while (i != iend)
+    {
+        int32_t begin = *i;
+        int32_t end = *i;
+
+        for (++i; i != iend && *i == end + 1; ++i)
+        {
+            end = *i;
+        }
+
+        char buf[32];
+
+        if (begin == end)
+        {
+            snprintf(buf, sizeof(buf), "%d", begin);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "%d-%d", begin, end);
+        }
+
+        if (!str.empty())
+        {
+            str += ",";
+        }
+
+        str += buf;
+    }
+
+    return !str.empty();
+}
 }  // namespace set_reader
 }  // namespace linux_impl
 }  // namespace impl
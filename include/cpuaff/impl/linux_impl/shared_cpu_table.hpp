@@ -0,0 +1,242 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../atomic.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+/*!
+ * A table of process ids in a posix shared memory object, one slot per cpu
+ * index.  A slot holds 0 when the cpu is unclaimed and the pid of the
+ * claiming process otherwise.  Every update is a single compare and swap so
+ * cooperating processes never need a lock, and a claim held by a process
+ * that no longer exists can be taken over.
+ *
+ * Whether a process exists is checked with kill(pid, 0), so a claim whose
+ * owner exited is still honoured if the kernel has since given its pid to
+ * an unrelated process.  Such a claim is only dropped once that process
+ * exits too.
+ */
+class shared_cpu_table
+{
+   public:
+    inline shared_cpu_table() : slots_(NULL), size_(0) {}
+    inline ~shared_cpu_table() { close(); }
+
+    /*!
+     * Open (creating if needed) the shared memory object with the given name
+     * and make sure it has at least size slots.  The mode is only used when
+     * the object is created; processes of other users can only cooperate if
+     * it grants them read and write access.
+     */
+    inline bool open(const std::string &name,
+                     std::size_t size,
+                     mode_t mode = 0600)
+    {
+        close();
+
+        if (size == 0)
+        {
+            return false;
+        }
+
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, mode);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        // openers that need a larger object grow it under an exclusive lock,
+        // so the size one of them saw cannot be truncated away by another
+        // that saw an older one.  The object never shrinks and new pages
+        // read as zero, so the slots need no lock.
+        std::size_t length = size * sizeof(int32_t);
+        struct stat st;
+        bool sized = flock(fd, LOCK_EX) == 0;
+
+        if (sized)
+        {
+            sized = fstat(fd, &st) == 0 &&
+                    (std::size_t(st.st_size) >= length ||
+                     ftruncate(fd, length) == 0);
+            flock(fd, LOCK_UN);
+        }
+
+        if (!sized)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void *p =
+            mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (p == MAP_FAILED)
+        {
+            return false;
+        }
+
+        slots_ = static_cast< volatile int32_t * >(p);
+        size_ = size;
+        return true;
+    }
+
+    inline void close()
+    {
+        if (slots_)
+        {
+            munmap(const_cast< int32_t * >(slots_), size_ * sizeof(int32_t));
+            slots_ = NULL;
+            size_ = 0;
+        }
+    }
+
+    /*!
+     * Remove the shared memory object with the given name.  Processes that
+     * have it open keep their mapping.
+     */
+    static inline bool unlink(const std::string &name)
+    {
+        return shm_unlink(name.c_str()) == 0;
+    }
+
+    inline bool is_open() const { return slots_ != NULL; }
+    inline std::size_t size() const { return size_; }
+
+    /*!
+     * Claim a slot for the given pid.  This succeeds if the slot is free,
+     * already held by pid, or held by a process that has exited.
+     */
+    inline bool claim(std::size_t index, int32_t pid)
+    {
+        if (index >= size_ || pid <= 0)
+        {
+            return false;
+        }
+
+        for (;;)
+        {
+            int32_t owner = atomic::load(slots_[index]);
+
+            if (owner == pid)
+            {
+                return true;
+            }
+            else if (owner != 0 && is_alive(owner))
+            {
+                return false;
+            }
+            else if (atomic::compare_exchange(slots_[index], owner, pid))
+            {
+                return true;
+            }
+        }
+    }
+
+    /*!
+     * Release a slot held by the given pid.
+     */
+    inline bool release(std::size_t index, int32_t pid)
+    {
+        return index < size_ &&
+               atomic::compare_exchange(slots_[index], pid, int32_t(0));
+    }
+
+    /*!
+     * Get the pid holding a slot or 0 if it is free.
+     */
+    inline int32_t owner(std::size_t index) const
+    {
+        return (index < size_) ? atomic::load(slots_[index]) : 0;
+    }
+
+    /*!
+     * Free every slot held by a process that has exited and return how many
+     * were freed.
+     */
+    inline std::size_t reclaim()
+    {
+        std::size_t retval = 0;
+
+        for (std::size_t i = 0; i < size_; ++i)
+        {
+            int32_t owner = atomic::load(slots_[i]);
+
+            if (owner != 0 && !is_alive(owner) &&
+                atomic::compare_exchange(slots_[i], owner, int32_t(0)))
+            {
+                ++retval;
+            }
+        }
+
+        return retval;
+    }
+
+    static inline int32_t current_pid() { return int32_t(getpid()); }
+
+    /*!
+     * Check whether a process exists.  A process we may not signal still
+     * exists.  This cannot tell a process from a later one that was given
+     * the same pid.
+     */
+    static inline bool is_alive(int32_t pid)
+    {
+        return kill(pid_t(pid), 0) == 0 || errno != ESRCH;
+    }
+
+   private:
+    shared_cpu_table(const shared_cpu_table &);
+    shared_cpu_table &operator=(const shared_cpu_table &);
+
+   private:
+    volatile int32_t *slots_;
+    std::size_t size_;
+};
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
@@ -52,6 +52,7 @@ struct pu
     int32_t socket;
     int32_t core;
     int32_t native;
+    int32_t llc;
 };
 
 inline bool read_list(std::set< int32_t > &set, const std::string &_file)
@@ -167,6 +168,50 @@ inline int32_t read_core(int32_t node, int32_t cpu)
     }
 }
 
+/*!
+ * Identify the last level cache of a cpu: the data or unified cache with the
+ * highest level.  Kernels that do not report a cache id get the lowest cpu
+ * sharing the cache instead, which is just as unique.  Returns -1 if the
+ * caches are not reported at all.
+ */
+inline int32_t read_llc(int32_t cpu)
+{
+    int32_t llc = -1;
+    int32_t llc_level = 0;
+
+    for (int32_t index = 0;; ++index)
+    {
+        std::ostringstream dir;
+        dir << "/sys/devices/system/cpu/cpu" << cpu << "/cache/index" << index;
+
+        std::set< int32_t > levels;
+        std::string type;
+        std::ifstream infile((dir.str() + "/type").c_str());
+
+        if (!read_list(levels, dir.str() + "/level") ||
+            !std::getline(infile, type))
+        {
+            break;
+        }
+
+        if (type == "Instruction" || *levels.begin() < llc_level)
+        {
+            continue;
+        }
+
+        std::set< int32_t > ids;
+
+        if (read_list(ids, dir.str() + "/id") ||
+            read_list(ids, dir.str() + "/shared_cpu_list"))
+        {
+            llc = *ids.begin();
+            llc_level = *levels.begin();
+        }
+    }
+
+    return llc;
+}
+
 inline bool read_cpu(std::vector< pu > &pus, int32_t cpu)
 {
     int32_t socket = read_socket(cpu);
@@ -177,6 +222,7 @@ inline bool read_cpu(std::vector< pu > &pus, int32_t cpu)
     u.native = cpu;
     u.socket = (socket == -1) ? 0 : socket;
     u.core = (core == -1) ? 0 : core;
+    u.llc = read_llc(cpu);
     pus.push_back(u);
     return true;
 }
@@ -193,6 +239,7 @@ inline bool read_cpu(std::vector< pu > &pus, int32_t node, int32_t cpu)
         u.native = cpu;
         u.socket = socket;
         u.core = core;
+        u.llc = read_llc(cpu);
         pus.push_back(u);
         return true;
     }
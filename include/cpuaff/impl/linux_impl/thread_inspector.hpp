@@ -0,0 +1,273 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../../sched_stats.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+namespace cpuaff
+{
+namespace impl
+{
+namespace linux_impl
+{
+/*!
+ * Reads and sets the scheduling state of individual threads of this process
+ * by kernel thread id, using /proc/self/task for what the kernel does not
+ * expose through a system call.
+ */
+class thread_inspector
+{
+   public:
+    /*!
+     * Get the kernel thread id of the calling thread.
+     */
+    static inline int32_t current_thread()
+    {
+        return int32_t(syscall(SYS_gettid));
+    }
+
+    /*!
+     * Name the calling thread.  The kernel keeps at most 15 characters.
+     */
+    static inline bool set_name(const std::string &name)
+    {
+        return 0 == pthread_setname_np(pthread_self(),
+                                       name.substr(0, 15).c_str());
+    }
+
+    /*!
+     * Get the name the kernel has for a thread.
+     */
+    static inline bool get_name(std::string &name, const int32_t &tid)
+    {
+        std::ifstream infile(path(tid, "comm").c_str());
+        name.clear();
+        return !!std::getline(infile, name);
+    }
+
+    /*!
+     * Check if a thread of this process still exists.
+     */
+    static inline bool is_alive(const int32_t &tid)
+    {
+        return 0 == access(path(tid, "stat").c_str(), F_OK);
+    }
+
+    /*!
+     * Get the cpus a thread is allowed to run on, in increasing order.  This
+     * is what /proc/self/task/<tid>/status reports as Cpus_allowed_list,
+     * read with a system call instead of parsing text.  The vector is
+     * cleared and refilled, so a caller that reuses it does not allocate.
+     */
+    template < typename T >
+    static inline bool get_affinity(std::vector< T > &cpus, const int32_t &tid)
+    {
+        cpu_set_t cpu_set;
+        cpus.clear();
+
+        if (0 != sched_getaffinity(pid_t(tid), sizeof(cpu_set_t), &cpu_set))
+        {
+            return false;
+        }
+
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+        {
+            if (CPU_ISSET(i, &cpu_set))
+            {
+                cpus.push_back(T(i));
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * Get the cpu a thread last ran on.  This is the processor field of
+     * /proc/self/task/<tid>/stat, the 39th field overall and the 37th after
+     * the parenthesised command name, which may itself contain spaces.  The
+     * file is read into a stack buffer so that periodic callers do not
+     * allocate.
+     */
+    static inline bool get_last_cpu(int &cpu, const int32_t &tid)
+    {
+        char buf[1024];
+
+        if (!read_file(buf, sizeof(buf), tid, "stat"))
+        {
+            return false;
+        }
+
+        const char *p = strrchr(buf, ')');
+
+        if (p == NULL)
+        {
+            return false;
+        }
+
+        for (int field = 0; field < 37; ++field)
+        {
+            while (*p != '\0' && *p != ' ')
+            {
+                ++p;
+            }
+
+            if (*p == '\0')
+            {
+                return false;
+            }
+
+            ++p;
+        }
+
+        char *end;
+        long value = strtol(p, &end, 10);
+
+        if (end == p || value < 0)
+        {
+            return false;
+        }
+
+        cpu = int(value);
+        return true;
+    }
+
+    /*!
+     * Get the scheduler counters of a thread.  Run time, run queue wait
+     * time, and timeslices come from /proc/self/task/<tid>/schedstat and the
+     * context switch counts from status.  Migrations come from sched, which
+     * only exists on kernels built with CONFIG_SCHED_DEBUG.
+     */
+    static inline bool get_sched_stats(sched_stats &stats, const int32_t &tid)
+    {
+        char buf[4096];
+        stats = sched_stats();
+
+        if (!read_file(buf, sizeof(buf), tid, "schedstat"))
+        {
+            return false;
+        }
+
+        char *p = buf;
+        stats.run_time = strtoull(p, &p, 10);
+        stats.wait_time = strtoull(p, &p, 10);
+        stats.timeslices = strtoull(p, &p, 10);
+
+        if (!read_file(buf, sizeof(buf), tid, "status") ||
+            !find_value(stats.voluntary_switches, buf,
+                        "\nvoluntary_ctxt_switches:") ||
+            !find_value(stats.involuntary_switches, buf,
+                        "\nnonvoluntary_ctxt_switches:"))
+        {
+            return false;
+        }
+
+        stats.has_migrations =
+            read_file(buf, sizeof(buf), tid, "sched") &&
+            find_value(stats.migrations, buf, "\nse.nr_migrations");
+
+        return true;
+    }
+
+   private:
+    /*!
+     * Read the start of /proc/self/task/<tid>/<file> into buf as a
+     * terminated string without allocating.
+     */
+    static inline bool read_file(char *buf,
+                                 std::size_t size,
+                                 const int32_t &tid,
+                                 const char *file)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "/proc/self/task/%d/%s", int(tid), file);
+
+        int fd = open(name, O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        ssize_t length = read(fd, buf, size - 1);
+        close(fd);
+
+        if (length <= 0)
+        {
+            return false;
+        }
+
+        buf[length] = '\0';
+        return true;
+    }
+
+    /*!
+     * Find key in buf and parse the number after the ':' that follows it.
+     */
+    static inline bool find_value(uint64_t &value,
+                                  const char *buf,
+                                  const char *key)
+    {
+        const char *p = strstr(buf, key);
+
+        if (p == NULL || (p = strchr(p, ':')) == NULL)
+        {
+            return false;
+        }
+
+        char *end;
+        value = strtoull(p + 1, &end, 10);
+        return end != p + 1;
+    }
+
+    static inline std::string path(const int32_t &tid, const char *file)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "/proc/self/task/%d/%s", int(tid), file);
+        return buf;
+    }
+};
+}  // namespace linux_impl
+}  // namespace impl
+}  // namespace cpuaff
@@ -0,0 +1,78 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+namespace cpuaff
+{
+namespace impl
+{
+/*!
+ * A blocking lock for critical sections that allocate, do i/o or call out
+ * to user code.  A waiter sleeps instead of spinning, so a holder that is
+ * preempted does not keep the cpu it was preempted on busy.
+ */
+class mutex
+{
+   public:
+    inline mutex() { pthread_mutex_init(&mutex_, NULL); }
+    inline ~mutex() { pthread_mutex_destroy(&mutex_); }
+
+    inline void lock() { pthread_mutex_lock(&mutex_); }
+    inline void unlock() { pthread_mutex_unlock(&mutex_); }
+
+   private:
+    mutex(const mutex &);
+    mutex &operator=(const mutex &);
+
+   private:
+    pthread_mutex_t mutex_;
+};
+
+/*!
+ * Holds a mutex for the lifetime of the guard.
+ */
+class mutex_guard
+{
+   public:
+    inline explicit mutex_guard(mutex &m) : mutex_(m) { mutex_.lock(); }
+    inline ~mutex_guard() { mutex_.unlock(); }
+
+   private:
+    mutex_guard(const mutex_guard &);
+    mutex_guard &operator=(const mutex_guard &);
+
+   private:
+    mutex &mutex_;
+};
+}  // namespace impl
+}  // namespace cpuaff
@@ -83,6 +83,35 @@ struct set_affinity
     }
 };
 
+struct get_current_cpu
+{
+    inline bool operator()(cpu_identifier_type &id) { return false; }
+};
+
+struct per_cpu_ops
+{
+    inline bool available() { return false; }
+    inline bool current_cpu(cpu_identifier_type &) { return false; }
+
+    inline int add(volatile intptr_t *, intptr_t, const cpu_identifier_type &)
+    {
+        return -1;
+    }
+
+    inline int compare_and_store(volatile intptr_t *,
+                                 intptr_t,
+                                 intptr_t,
+                                 const cpu_identifier_type &)
+    {
+        return -1;
+    }
+
+    inline int pop(volatile intptr_t *, intptr_t &, const cpu_identifier_type &)
+    {
+        return -1;
+    }
+};
+
 #if defined(CPUAFF_PCI_SUPPORTED)
 
 typedef std::string pci_address_type;
@@ -140,6 +169,8 @@ struct traits
     typedef null::cpu_loader_vector_type cpu_loader_vector_type;
     typedef get_affinity get_affinity_type;
     typedef set_affinity set_affinity_type;
+    typedef get_current_cpu get_current_cpu_type;
+    typedef per_cpu_ops per_cpu_ops_type;
 
 #if defined(CPUAFF_PCI_SUPPORTED)
     typedef null::pci_address_type pci_address_type;
@@ -32,6 +32,10 @@
 
 #if defined(__linux__)
 #define CPUAFF_PCI_SUPPORTED
+#define CPUAFF_PAGE_PLACEMENT_SUPPORTED
+#define CPUAFF_CPU_REGISTRY_SUPPORTED
+#define CPUAFF_THREAD_REGISTRY_SUPPORTED
+#define CPUAFF_CPU_LOAD_SUPPORTED
 #endif
 
 #if defined(_WIN32) || defined(_AIX) || defined(__FreeBSD__) || \
@@ -43,4 +47,8 @@
 
 #if defined(CPUAFF_USE_HWLOC)
 #undef CPUAFF_PCI_SUPPORTED
+#undef CPUAFF_PAGE_PLACEMENT_SUPPORTED
+#undef CPUAFF_CPU_REGISTRY_SUPPORTED
+#undef CPUAFF_THREAD_REGISTRY_SUPPORTED
+#undef CPUAFF_CPU_LOAD_SUPPORTED
 #endif
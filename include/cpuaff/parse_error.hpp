@@ -0,0 +1,93 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+namespace cpuaff
+{
+/*!
+ * A description of why a piece of text could not be parsed and where.
+ */
+class parse_error
+{
+   public:
+    /*!
+     * Constructs an empty parse_error.
+     */
+    inline parse_error() : column_(0) {}
+
+    /*!
+     * Constructs a parse_error with the given column and message.
+     *
+     * \param column the one based column the error was found at
+     * \param message what went wrong
+     */
+    inline parse_error(const std::size_t &column, const std::string &message)
+        : column_(column), message_(message)
+    {
+    }
+
+   public:
+    /*!
+     * Get the one based column the error was found at.
+     *
+     * \return the column
+     */
+    inline const std::size_t &column() const { return column_; }
+
+    /*!
+     * Get what went wrong.
+     *
+     * \return the message
+     */
+    inline const std::string &message() const { return message_; }
+
+    /*!
+     * Get the column and message as a single string, for instance
+     * "column 7: expected a number".
+     *
+     * \return the error as a string
+     */
+    inline std::string what() const
+    {
+        std::ostringstream buf;
+        buf << "column " << column_ << ": " << message_;
+        return buf.str();
+    }
+
+   private:
+    std::size_t column_;
+    std::string message_;
+};
+}  // namespace cpuaff
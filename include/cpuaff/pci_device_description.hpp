@@ -102,9 +102,31 @@ class pci_device_description
         device_description_ = val;
     }
 
+    /*!
+     * Get the subsystem description.  This is empty if the subsystem is not
+     * known.
+     *
+     * \return the subsystem description
+     */
+    inline const std::string &subsystem_description() const
+    {
+        return subsystem_description_;
+    }
+
+    /*!
+     * Set the subsystem description.
+     *
+     * \param val the subsystem description
+     */
+    inline void subsystem_description(const std::string &val)
+    {
+        subsystem_description_ = val;
+    }
+
    private:
     std::string vendor_description_;
     std::string device_description_;
+    std::string subsystem_description_;
 };
 }  // namespace cpuaff
 
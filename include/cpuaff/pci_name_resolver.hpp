@@ -31,25 +31,52 @@
 #pragma once
 #include "pci_device_description.hpp"
 #include "pci_device_spec.hpp"
-#include <cstdlib>
-#include <fstream>
-#include <map>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
 #include <sstream>
+#include <stdint.h>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace cpuaff
 {
 class pci_name_resolver
 {
+   public:
+    /*!
+     * A name within the pci.ids file.  It points directly into the mapped
+     * file and is only valid for the lifetime of the pci_name_resolver.
+     */
+    typedef std::pair< const char *, std::size_t > name_type;
+
    public:
     /*!
      * Constructs a pci_name_resolver with the given file.  The given file
      * should be a pci.ids file from the
-     * (PCI ID Project)[http://pci-ids.ucw.cz].
+     * (PCI ID Project)[http://pci-ids.ucw.cz].  The file is mapped into
+     * memory and only an index of the offsets of the names is built.
      *
      * \param file the file name to read
      */
-    inline pci_name_resolver(const std::string &file) { initialize(file); }
+    inline pci_name_resolver(const std::string &file)
+        : data_(NULL), size_(0)
+    {
+        initialize(file);
+    }
+
+    inline ~pci_name_resolver()
+    {
+        if (data_ != NULL)
+        {
+            munmap(const_cast< char * >(data_), size_);
+        }
+    }
 
     /*!
      * Get the pci_device_description for the given pci_device_spec.
@@ -59,45 +86,115 @@ class pci_name_resolver
      * \return true if the description can be found, false otherwise.
      */
     inline bool get_description(pci_device_description &des,
-                                const pci_device_spec &spec)
+                                const pci_device_spec &spec) const
     {
-        std::map< pci_device_spec, pci_device_description >::iterator i =
-            description_by_id_.find(spec);
+        name_type name;
 
-        if (i != description_by_id_.end())
+        if (find_vendor(name, spec.vendor()))
         {
-            des = i->second;
-            return true;
+            des.vendor_description(std::string(name.first, name.second));
         }
         else
         {
-            i = description_by_id_.find(pci_device_spec(spec.vendor(), 0));
+            des.vendor_description(format_id(spec.vendor()));
+        }
 
-            if (i != description_by_id_.end())
-            {
-                des = i->second;
-                std::ostringstream buf;
-                buf << std::hex << std::setfill('0') << std::setw(4)
-                    << spec.device();
-                des.device_description(buf.str());
-                return true;
-            }
-            else
-            {
-                std::ostringstream buf;
-                buf << std::hex << std::setfill('0') << std::setw(4)
-                    << spec.vendor();
-                des.vendor_description(buf.str());
-                buf.str("");
-                buf << std::hex << std::setfill('0') << std::setw(4)
-                    << spec.device();
-                des.device_description(buf.str());
-                return true;
-            }
+        if (find_device(name, spec))
+        {
+            des.device_description(std::string(name.first, name.second));
+        }
+        else
+        {
+            des.device_description(format_id(spec.device()));
+        }
+
+        des.subsystem_description("");
+
+        return true;
+    }
+
+    /*!
+     * Get the pci_device_description for the given pci_device_spec and
+     * subsystem.
+     *
+     * \param des [out] the pci_device_description
+     * \param spec [in] the pci_device_spec
+     * \param subsystem [in] the subsystem vendor and device
+     * \return true if the description can be found, false otherwise.
+     */
+    inline bool get_description(pci_device_description &des,
+                                const pci_device_spec &spec,
+                                const pci_device_spec &subsystem) const
+    {
+        get_description(des, spec);
+
+        name_type name;
+
+        if (find_subsystem(name, spec, subsystem))
+        {
+            des.subsystem_description(std::string(name.first, name.second));
         }
+
+        return true;
+    }
+
+    /*!
+     * Find the name of the given vendor without copying it.
+     *
+     * \param name [out] the vendor name
+     * \param vendor [in] the vendor id
+     * \return true if the vendor is found, false otherwise.
+     */
+    inline bool find_vendor(name_type &name,
+                            const pci_vendor_id_type &vendor) const
+    {
+        return find(name, vendors_, make_key(vendor, 0, 0, 0));
     }
 
+    /*!
+     * Find the name of the given device without copying it.
+     *
+     * \param name [out] the device name
+     * \param spec [in] the vendor and device ids
+     * \return true if the device is found, false otherwise.
+     */
+    inline bool find_device(name_type &name, const pci_device_spec &spec) const
+    {
+        return find(name, devices_,
+                    make_key(spec.vendor(), spec.device(), 0, 0));
+    }
+
+    /*!
+     * Find the name of the given subsystem without copying it.
+     *
+     * \param name [out] the subsystem name
+     * \param spec [in] the vendor and device ids
+     * \param subsystem [in] the subsystem vendor and device ids
+     * \return true if the subsystem is found, false otherwise.
+     */
+    inline bool find_subsystem(name_type &name,
+                               const pci_device_spec &spec,
+                               const pci_device_spec &subsystem) const
+    {
+        return find(name, subsystems_,
+                    make_key(spec.vendor(), spec.device(), subsystem.vendor(),
+                             subsystem.device()));
+    }
+
+   private:
+    struct entry
+    {
+        uint64_t key;
+        uint32_t offset;
+        uint32_t length;
+
+        inline bool operator<(const entry &rhs) const { return key < rhs.key; }
+    };
+
    private:
+    pci_name_resolver(const pci_name_resolver &);
+    pci_name_resolver &operator=(const pci_name_resolver &);
+
     /*!
      * Initializes a pci_name_resolver with the given file.  The given file
      * should be a pci.ids file from the
@@ -108,92 +205,197 @@ class pci_name_resolver
      */
     inline bool initialize(const std::string &file)
     {
-        std::ifstream infile(file.c_str());
-        bool retval = infile.good();
+        int fd = open(file.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
 
-        int32_t vendor = 0;
-        std::string vendor_description;
-        int32_t device = 0;
-        std::string device_description;
+        struct stat st;
 
-        while (infile.good())
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
         {
-            std::string line;
-            std::getline(infile, line);
+            void *data =
+                mmap(NULL, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE,
+                     fd, 0);
 
-            if (line.length() > 2 && line[0] != '#' &&
-                line.substr(0, 2) != "C ")
+            if (data != MAP_FAILED)
             {
-                if (line[0] == '\t')
+                data_ = static_cast< const char * >(data);
+                size_ = std::size_t(st.st_size);
+            }
+        }
+
+        close(fd);
+
+        if (data_ != NULL)
+        {
+            build_index();
+            return true;
+        }
+
+        return false;
+    }
+
+    inline void build_index()
+    {
+        const char *end = data_ + size_;
+        const char *line = data_;
+
+        int32_t vendor = -1;
+        int32_t device = -1;
+
+        while (line < end)
+        {
+            const char *eol = static_cast< const char * >(
+                memchr(line, '\n', std::size_t(end - line)));
+
+            if (eol == NULL)
+            {
+                eol = end;
+            }
+
+            std::size_t length = std::size_t(eol - line);
+            int32_t id;
+            int32_t subid;
+
+            if (length == 0 || line[0] == '#')
+            {
+                // blank lines and comments
+            }
+            else if (line[0] == 'C' && length > 1 && line[1] == ' ')
+            {
+                // the device classes follow, which are not vendors
+                vendor = -1;
+                device = -1;
+            }
+            else if (line[0] != '\t')
+            {
+                vendor = (length > 6 && parse_id(id, line)) ? id : -1;
+                device = -1;
+
+                if (vendor >= 0)
                 {
-                    if (line[1] != '\t')
-                    {
-                        if (parse_device(line, device, device_description))
-                        {
-                            description_by_id_[pci_device_spec(vendor,
-                                                               device)] =
-                                pci_device_description(vendor_description,
-                                                       device_description);
-                        }
-                        else
-                        {
-                            device = 0;
-                            device_description = "";
-                        }
-                    }
+                    add(vendors_, make_key(vendor, 0, 0, 0), line + 6, eol);
                 }
-                else
+            }
+            else if (vendor < 0)
+            {
+                // belongs to a class or a malformed vendor
+            }
+            else if (length > 1 && line[1] != '\t')
+            {
+                device = (length > 7 && parse_id(id, line + 1)) ? id : -1;
+
+                if (device >= 0)
                 {
-                    if (parse_vendor(line, vendor, vendor_description))
-                    {
-                        description_by_id_[pci_device_spec(vendor, 0)] =
-                            pci_device_description(vendor_description, "");
-                    }
-                    else
-                    {
-                        vendor = 0;
-                        vendor_description = "";
-                    }
-
-                    device = 0;
-                    device_description = "";
+                    add(devices_, make_key(vendor, device, 0, 0), line + 7,
+                        eol);
                 }
             }
+            else if (device >= 0 && length > 13 && parse_id(id, line + 2) &&
+                     parse_id(subid, line + 7))
+            {
+                add(subsystems_, make_key(vendor, device, id, subid),
+                    line + 13, eol);
+            }
+
+            line = eol + 1;
         }
 
-        return retval;
+        // pci.ids is sorted, but sort anyway to guarantee the lookups work
+        std::sort(vendors_.begin(), vendors_.end());
+        std::sort(devices_.begin(), devices_.end());
+        std::sort(subsystems_.begin(), subsystems_.end());
+    }
+
+    inline void add(std::vector< entry > &entries,
+                    const uint64_t &key,
+                    const char *begin,
+                    const char *end)
+    {
+        entry e;
+        e.key = key;
+        e.offset = uint32_t(begin - data_);
+        e.length = uint32_t(end - begin);
+        entries.push_back(e);
     }
 
-    inline bool parse_vendor(const std::string &line,
-                             int32_t &vendor,
-                             std::string &vendor_description)
+    inline bool find(name_type &name,
+                     const std::vector< entry > &entries,
+                     const uint64_t &key) const
     {
-        if (line.length() > 6)
+        entry e;
+        e.key = key;
+
+        std::vector< entry >::const_iterator i =
+            std::lower_bound(entries.begin(), entries.end(), e);
+
+        if (i != entries.end() && i->key == key)
         {
-            vendor = int32_t(strtol(line.substr(0, 4).c_str(), NULL, 16));
-            vendor_description = line.substr(6);
+            name.first = data_ + i->offset;
+            name.second = i->length;
             return true;
         }
 
         return false;
     }
 
-    inline bool parse_device(const std::string &line,
-                             int32_t &device,
-                             std::string &device_description)
+    static inline uint64_t make_key(const int32_t &vendor,
+                                    const int32_t &device,
+                                    const int32_t &subvendor,
+                                    const int32_t &subdevice)
     {
-        if (line.length() > 7)
+        return (uint64_t(vendor & 0xffff) << 48) |
+               (uint64_t(device & 0xffff) << 32) |
+               (uint64_t(subvendor & 0xffff) << 16) |
+               uint64_t(subdevice & 0xffff);
+    }
+
+    static inline bool parse_id(int32_t &id, const char *str)
+    {
+        id = 0;
+
+        for (int i = 0; i < 4; ++i)
         {
-            device = int32_t(strtol(line.substr(1, 4).c_str(), NULL, 16));
-            device_description = line.substr(7);
-            return true;
+            char c = str[i];
+            id <<= 4;
+
+            if (c >= '0' && c <= '9')
+            {
+                id |= c - '0';
+            }
+            else if (c >= 'a' && c <= 'f')
+            {
+                id |= c - 'a' + 10;
+            }
+            else if (c >= 'A' && c <= 'F')
+            {
+                id |= c - 'A' + 10;
+            }
+            else
+            {
+                return false;
+            }
         }
 
-        return false;
+        return true;
+    }
+
+    static inline std::string format_id(const int32_t &id)
+    {
+        std::ostringstream buf;
+        buf << std::hex << std::setfill('0') << std::setw(4) << id;
+        return buf.str();
     }
 
    private:
-    std::map< pci_device_spec, pci_device_description > description_by_id_;
+    const char *data_;
+    std::size_t size_;
+    std::vector< entry > vendors_;
+    std::vector< entry > devices_;
+    std::vector< entry > subsystems_;
 };
 
 }  // namespace cpuaff
@@ -0,0 +1,218 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "fwd.hpp"
+
+namespace cpuaff
+{
+/*!
+ * The levels of the cpu topology a placement can be spread over.
+ */
+struct placement_level
+{
+    enum type
+    {
+        socket,
+        numa,
+        core,
+        processing_unit
+    };
+};
+
+/*!
+ * How the hyperthreads of a core are used by a placement.
+ */
+struct smt_policy
+{
+    enum type
+    {
+        all,  //!< use every processing unit of a core
+        one   //!< use only one processing unit of each core
+    };
+};
+
+/*!
+ * Where a thread's memory is allocated.
+ */
+struct memory_policy
+{
+    enum type
+    {
+        system_default,  //!< leave the policy to the operating system
+        local,           //!< allocate on the node the thread is running on
+        interleave       //!< interleave over the nodes of the thread's cpus
+    };
+};
+
+/*!
+ * A placement_policy describes how a placement engine orders cpus, in the
+ * spirit of OpenMP's proc_bind.  Policies are built with the static factory
+ * functions.
+ */
+class placement_policy
+{
+   public:
+    enum kind_type
+    {
+        compact_kind,
+        scatter_kind,
+        numa_balanced_kind,
+        spread_kind
+    };
+
+   public:
+    /*!
+     * Fill one core before moving to the next, one numa node before moving to
+     * the next, and one socket before moving to the next.  Neighbouring
+     * places share as much of the memory hierarchy as possible.
+     *
+     * \return the compact policy
+     */
+    static inline placement_policy compact()
+    {
+        return placement_policy(compact_kind, placement_level::processing_unit);
+    }
+
+    /*!
+     * Spread consecutive places across sockets first, then across the numa
+     * nodes of each socket, then across cores, and only then across the
+     * processing units of a core.
+     *
+     * \return the scatter policy
+     */
+    static inline placement_policy scatter()
+    {
+        return placement_policy(scatter_kind, placement_level::socket);
+    }
+
+    /*!
+     * Spread consecutive places evenly across numa nodes regardless of
+     * socket, and within a node across cores before hyperthread siblings.
+     *
+     * \return the numa balanced policy
+     */
+    static inline placement_policy numa_balanced()
+    {
+        return placement_policy(numa_balanced_kind, placement_level::numa);
+    }
+
+    /*!
+     * Spread consecutive places across the units of the given level and fill
+     * each unit compactly.  Spreading by processing_unit is the same as
+     * compact.
+     *
+     * \param level the level to spread over
+     * \return the spread policy
+     */
+    static inline placement_policy spread_by(const placement_level::type &level)
+    {
+        return placement_policy(spread_kind, level);
+    }
+
+   public:
+    /*!
+     * Get the kind of this policy.
+     *
+     * \return the kind of this policy
+     */
+    inline const kind_type &kind() const { return kind_; }
+
+    /*!
+     * Get the outermost level this policy spreads over.
+     *
+     * \return the level
+     */
+    inline const placement_level::type &level() const { return level_; }
+
+   private:
+    inline placement_policy(const kind_type &k,
+                            const placement_level::type &l)
+        : kind_(k), level_(l)
+    {
+    }
+
+   private:
+    kind_type kind_;
+    placement_level::type level_;
+};
+
+/*!
+ * The thresholds a rebalancer uses to decide when to move a thread.  The
+ * defaults act on sustained contention only and leave a thread alone for a
+ * while after moving it, so that threads do not ping-pong between cpus.
+ */
+struct rebalance_policy
+{
+    /*!
+     * The fraction of its runnable time a thread may spend waiting on a run
+     * queue before it counts as contended.
+     */
+    double wait_threshold;
+
+    /*!
+     * The utilization above which a cpu is considered hot.
+     */
+    double hot_utilization;
+
+    /*!
+     * How much less utilized another cache domain must be before a thread
+     * is moved there.
+     */
+    double margin;
+
+    /*!
+     * The number of consecutive contended rounds before a thread is moved.
+     */
+    int patience;
+
+    /*!
+     * The number of rounds a thread is left alone after it was moved.
+     */
+    int cooldown;
+
+    /*!
+     * The number of consecutive calm rounds before a thread that was moved
+     * gets its full cpu set back.
+     */
+    int relax_after;
+
+    inline rebalance_policy()
+        : wait_threshold(0.05)
+        , hot_utilization(0.85)
+        , margin(0.2)
+        , patience(3)
+        , cooldown(5)
+        , relax_after(30)
+    {
+    }
+};
+}  // namespace cpuaff
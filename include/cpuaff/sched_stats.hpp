@@ -0,0 +1,105 @@
+/* Copyright (c) 2015-2017, Daniel C. Dillon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace cpuaff
+{
+/*!
+ * Scheduler counters for a thread, or the sum over several threads.  Times
+ * are in nanoseconds.  wait_time is the time spent runnable but waiting on a
+ * run queue, which should stay near zero for a thread with a dedicated core.
+ */
+struct sched_stats
+{
+    uint64_t run_time;
+    uint64_t wait_time;
+    uint64_t timeslices;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t migrations;
+
+    /*!
+     * False when the kernel does not report migrations (it needs
+     * CONFIG_SCHED_DEBUG), in which case migrations is always zero.
+     */
+    bool has_migrations;
+
+    inline sched_stats()
+        : run_time(0)
+        , wait_time(0)
+        , timeslices(0)
+        , voluntary_switches(0)
+        , involuntary_switches(0)
+        , migrations(0)
+        , has_migrations(false)
+    {
+    }
+
+    inline sched_stats &operator+=(const sched_stats &rhs)
+    {
+        run_time += rhs.run_time;
+        wait_time += rhs.wait_time;
+        timeslices += rhs.timeslices;
+        voluntary_switches += rhs.voluntary_switches;
+        involuntary_switches += rhs.involuntary_switches;
+        migrations += rhs.migrations;
+        has_migrations = has_migrations || rhs.has_migrations;
+        return *this;
+    }
+
+    /*!
+     * The change from an earlier sample of the same thread.  Counters that
+     * went backwards (the thread id was reused) are taken as zero.
+     */
+    inline sched_stats operator-(const sched_stats &earlier) const
+    {
+        sched_stats delta;
+        delta.run_time = minus(run_time, earlier.run_time);
+        delta.wait_time = minus(wait_time, earlier.wait_time);
+        delta.timeslices = minus(timeslices, earlier.timeslices);
+        delta.voluntary_switches =
+            minus(voluntary_switches, earlier.voluntary_switches);
+        delta.involuntary_switches =
+            minus(involuntary_switches, earlier.involuntary_switches);
+        delta.migrations = minus(migrations, earlier.migrations);
+        delta.has_migrations = has_migrations && earlier.has_migrations;
+        return delta;
+    }
+
+   private:
+    static inline uint64_t minus(const uint64_t &lhs, const uint64_t &rhs)
+    {
+        return (lhs > rhs) ? lhs - rhs : 0;
+    }
+};
+}  // namespace cpuaff
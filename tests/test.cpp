@@ -34,6 +34,53 @@
 
 #include "../include/cpuaff/cpuaff.hpp"
 
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <ftw.h>
+#include <sys/stat.h>
+
+// helpers for building fake procfs/sysfs trees
+namespace
+{
+std::string make_temp_dir()
+{
+    char path[] = "/tmp/cpuaff_test_XXXXXX";
+    return (mkdtemp(path) != NULL) ? std::string(path) : std::string();
+}
+
+void make_dirs(const std::string &path)
+{
+    std::string::size_type pos = 1;
+
+    while ((pos = path.find('/', pos)) != std::string::npos)
+    {
+        mkdir(path.substr(0, pos).c_str(), 0755);
+        ++pos;
+    }
+
+    mkdir(path.c_str(), 0755);
+}
+
+void write_file(const std::string &path, const std::string &contents)
+{
+    make_dirs(path.substr(0, path.rfind('/')));
+    std::ofstream outfile(path.c_str());
+    outfile << contents;
+}
+
+int remove_entry(const char *path, const struct stat *, int, struct FTW *)
+{
+    return remove(path);
+}
+
+void remove_dir(const std::string &path)
+{
+    // children first, without following symlinks out of the tree
+    nftw(path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+}  // namespace
+
 #if defined(CPUAFF_PCI_SUPPORTED)
 TEST_CASE("pci_device_manager", "[pci_device_manager]")
 {
@@ -55,7 +102,312 @@ TEST_CASE("pci_device_manager", "[pci_device_manager]")
         REQUIRE(manager.get_pci_devices_by_spec(devices, device.spec()));
         REQUIRE(manager.get_pci_devices_by_numa(devices, device.numa()));
         REQUIRE(manager.get_pci_devices_by_vendor(devices, device.vendor()));
+
+        if (device.device_class() >= 0)
+        {
+            REQUIRE(manager.get_pci_devices_by_class(devices,
+                                                     device.device_class()));
+            REQUIRE(devices.find(device) != devices.end());
+            REQUIRE(manager.get_pci_devices_by_class(
+                devices, device.device_class() & 0xff0000, 0xff0000));
+            REQUIRE(devices.find(device) != devices.end());
+        }
+
+        // addresses round trip through their packed form
+        cpuaff::pci_device::pci_address_wrapper_type address("0000:3b:00.1");
+        REQUIRE(address.valid());
+        REQUIRE(address.get() == "0000:3b:00.1");
+        REQUIRE(address.domain() == 0);
+        REQUIRE(address.bus() == 0x3b);
+        REQUIRE(address.device() == 0);
+        REQUIRE(address.function() == 1);
+        REQUIRE(address == cpuaff::pci_device::pci_address_wrapper_type(
+                               "3b:00.1"));
+        REQUIRE(address < cpuaff::pci_device::pci_address_wrapper_type(
+                              "0000:3b:00.2"));
+        REQUIRE(address.hash() ==
+                cpuaff::pci_device::pci_address_wrapper_type(address.get())
+                    .hash());
+        REQUIRE(address.hash() !=
+                cpuaff::pci_device::pci_address_wrapper_type("0001:3b:00.1")
+                    .hash());
+
+        // intel vmd domains do not fit in 16 bits
+        address = cpuaff::pci_device::pci_address_wrapper_type("10000:e1:1f.7");
+        REQUIRE(address.get() == "10000:e1:1f.7");
+        REQUIRE(address.domain() == 0x10000);
+
+        REQUIRE(!cpuaff::pci_device::pci_address_wrapper_type("").valid());
+        REQUIRE(!cpuaff::pci_device::pci_address_wrapper_type("eth0").valid());
+        REQUIRE(
+            !cpuaff::pci_device::pci_address_wrapper_type("0000:00:20.0")
+                 .valid());
+        REQUIRE(!manager.get_pci_device_for_address(device, "eth0"));
+        REQUIRE(manager.get_pci_device_for_address(
+            device, device.address().get()));
+
+        // every device hangs off a root complex and is reachable from its
+        // root port
+        cpuaff::pci_device_set all;
+        REQUIRE(manager.get_pci_devices(all));
+
+        for (cpuaff::pci_device_set::iterator i = all.begin(); i != all.end();
+             ++i)
+        {
+            cpuaff::pci_device port;
+            cpuaff::pci_device_set related;
+            std::vector< cpuaff::pci_device > upstream;
+
+            REQUIRE(manager.get_pci_root_port(port, *i));
+            REQUIRE(!port.has_parent());
+            REQUIRE(port.root_complex() == i->root_complex());
+            REQUIRE(manager.get_pci_devices_by_root_complex(
+                related, i->root_complex()));
+            REQUIRE(related.find(*i) != related.end());
+
+            manager.get_pci_devices_sharing_root_complex(related, *i);
+            REQUIRE(related.find(*i) == related.end());
+
+            if (i->is_virtual_function())
+            {
+                cpuaff::pci_device pf;
+                REQUIRE(manager.get_physical_function(pf, *i));
+                REQUIRE(manager.get_virtual_functions(related, pf));
+                REQUIRE(related.find(*i) != related.end());
+
+                if (pf.numa() >= 0)
+                {
+                    REQUIRE(i->numa() >= 0);
+                }
+            }
+            else
+            {
+                cpuaff::pci_device pf;
+                REQUIRE(!manager.get_physical_function(pf, *i));
+            }
+
+            if (i->has_parent())
+            {
+                cpuaff::pci_device parent;
+                REQUIRE(manager.get_pci_parent(parent, *i));
+                REQUIRE(manager.get_pci_children(related, parent));
+                REQUIRE(related.find(*i) != related.end());
+                REQUIRE(manager.get_pci_devices_below(related, port));
+                REQUIRE(related.find(*i) != related.end());
+                REQUIRE(manager.get_pci_upstream_devices(upstream, *i));
+                REQUIRE(upstream.back().address().get() ==
+                        port.address().get());
+            }
+            else
+            {
+                REQUIRE(port.address().get() == i->address().get());
+                REQUIRE(!manager.get_pci_upstream_devices(upstream, *i));
+                REQUIRE(!manager.get_pci_devices_sharing_switch(related, *i));
+            }
+        }
+
+        // marking a device as a virtual function records its physical
+        // function
+        cpuaff::pci_device vf(device.spec(), device.address(), -1);
+        REQUIRE(!vf.is_virtual_function());
+        REQUIRE(vf.virtual_function_index() == -1);
+        vf.physical_function(device.address(), 3);
+        REQUIRE(vf.is_virtual_function());
+        REQUIRE(vf.physical_function() == device.address());
+        REQUIRE(vf.virtual_function_index() == 3);
+
+        // a device only counts as degraded when both ends of the comparison
+        // are known
+        cpuaff::pci_device link_device(device.spec(), device.address(), 0);
+        REQUIRE(!link_device.is_link_degraded());
+        link_device.link(8.0, 16, 8.0, 16);
+        REQUIRE(!link_device.is_link_degraded());
+        link_device.link(2.5, 16, 8.0, 16);
+        REQUIRE(link_device.is_link_degraded());
+        link_device.link(8.0, 4, 8.0, 16);
+        REQUIRE(link_device.is_link_degraded());
+        link_device.link(8.0, 4, 0, 0);
+        REQUIRE(!link_device.is_link_degraded());
+
+        cpuaff::affinity_manager affinity_manager;
+        cpuaff::cpu_set cpus;
+
+        if (!device.local_cpus().empty() || device.numa() >= 0)
+        {
+            REQUIRE(affinity_manager.get_cpus_near_device(cpus, device));
+            WARN("Cpus near " << device.address().get() << ": " << cpus);
+        }
+
+        // the local cpu list takes precedence over the numa node
+        cpuaff::cpu first_cpu;
+        REQUIRE(affinity_manager.get_cpu_from_index(first_cpu, 0));
+
+        std::set< cpuaff::pci_device::cpu_identifier_wrapper_type > local;
+        local.insert(first_cpu.id());
+        device = cpuaff::pci_device(device.spec(), device.address(), -1);
+        device.local_cpus(local);
+
+        REQUIRE(affinity_manager.get_cpus_near_device(cpus, device));
+        REQUIRE(cpus.size() == 1);
+        REQUIRE(*cpus.begin() == first_cpu);
+
+        // interfaces and block devices resolve to the pci devices behind them
+        REQUIRE(!manager.get_pci_device_for_interface(device, "lo"));
+        REQUIRE(!manager.get_pci_device_for_interface(device, "../lo"));
+        REQUIRE(!manager.get_pci_device_for_block_device(device, ""));
+
+        const char *names[] = {"eth0", "vda", "sda", "nvme0n1", "nvme0"};
+
+        for (std::size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        {
+            if (manager.get_pci_device_for_interface(device, names[i]) ||
+                manager.get_pci_device_for_block_device(device, names[i]))
+            {
+                cpuaff::pci_device found;
+                REQUIRE(manager.get_pci_device_for_address(found,
+                                                           device.address()));
+                WARN(names[i] << " is " << device.address().get());
+            }
+        }
+    }
+}
+
+TEST_CASE("pci_name_resolver", "[pci_name_resolver]")
+{
+    std::string root = make_temp_dir();
+    REQUIRE(!root.empty());
+
+    write_file(root + "/pci.ids",
+               "# comment\n"
+               "\n"
+               "1af4  Red Hat, Inc.\n"
+               "\t1000  Virtio network device\n"
+               "\t\t1af4 0001  Virtio network device\n"
+               "\t1041  Virtio 1.0 network device\n"
+               "8086  Intel Corporation\n"
+               "\t10fb  82599ES 10-Gigabit SFI/SFP+ Network Connection\n"
+               "\t\t8086 000c  Ethernet Server Adapter X520-2\n"
+               "C 02  Network controller\n"
+               "\t00  Ethernet controller\n");
+
+    cpuaff::pci_name_resolver resolver(root + "/pci.ids");
+    cpuaff::pci_device_description des;
+
+    REQUIRE(resolver.get_description(des, cpuaff::pci_device_spec(0x8086,
+                                                                  0x10fb)));
+    REQUIRE(des.vendor_description() == "Intel Corporation");
+    REQUIRE(des.device_description() ==
+            "82599ES 10-Gigabit SFI/SFP+ Network Connection");
+    REQUIRE(des.subsystem_description().empty());
+
+    REQUIRE(resolver.get_description(des,
+                                     cpuaff::pci_device_spec(0x8086, 0x10fb),
+                                     cpuaff::pci_device_spec(0x8086, 0x000c)));
+    REQUIRE(des.subsystem_description() == "Ethernet Server Adapter X520-2");
+
+    // unknown devices fall back to the hex id
+    REQUIRE(resolver.get_description(des, cpuaff::pci_device_spec(0x1af4,
+                                                                  0x00ff)));
+    REQUIRE(des.vendor_description() == "Red Hat, Inc.");
+    REQUIRE(des.device_description() == "00ff");
+
+    // the device class section is not mistaken for devices
+    cpuaff::pci_name_resolver::name_type name;
+    REQUIRE(resolver.find_device(name, cpuaff::pci_device_spec(0x8086,
+                                                               0x10fb)));
+    REQUIRE(!resolver.find_device(name, cpuaff::pci_device_spec(0x8086, 0)));
+    REQUIRE(resolver.find_vendor(name, 0x1af4));
+    REQUIRE(std::string(name.first, name.second) == "Red Hat, Inc.");
+
+    cpuaff::pci_name_resolver missing(root + "/missing.ids");
+    REQUIRE(missing.get_description(des, cpuaff::pci_device_spec(0x8086,
+                                                                  0x10fb)));
+    REQUIRE(des.vendor_description() == "8086");
+    REQUIRE(des.device_description() == "10fb");
+
+    remove_dir(root);
+}
+
+TEST_CASE("irq_manager", "[irq_manager]")
+{
+    cpuaff::affinity_manager manager;
+
+    REQUIRE(manager.has_cpus());
+
+    cpuaff::cpu first_cpu;
+    REQUIRE(manager.get_cpu_from_index(first_cpu, 0));
+
+    std::string root = make_temp_dir();
+    REQUIRE(!root.empty());
+
+    std::ostringstream affinity;
+    affinity << first_cpu.id().get() << std::endl;
+
+    write_file(root + "/proc/interrupts",
+               "           CPU0\n"
+               "  0:         45   IO-APIC   2-edge      timer\n"
+               " 24:         10   PCI-MSI 65536-edge      virtio0-input\n"
+               " 25:          5   PCI-MSI 65537-edge      virtio0-output\n"
+               "NMI:          0   Non-maskable interrupts\n");
+    write_file(root + "/proc/irq/24/smp_affinity_list", affinity.str());
+    write_file(root + "/proc/irq/25/smp_affinity_list", affinity.str());
+    write_file(root + "/sys/bus/pci/devices/0000:00:04.0/msi_irqs/24", "msix");
+    write_file(root + "/sys/bus/pci/devices/0000:00:04.0/msi_irqs/25", "msix");
+
+    cpuaff::irq_manager irqs(manager, root + "/proc", root + "/sys");
+    REQUIRE(irqs.has_irqs());
+
+    std::set< cpuaff::irq_type > all;
+    REQUIRE(irqs.get_irqs(all));
+    REQUIRE(all.size() == 3);
+    REQUIRE(all.count(24) == 1);
+
+    std::string description;
+    uint64_t count = 0;
+    REQUIRE(irqs.get_irq_description(description, 24));
+    REQUIRE(description == "PCI-MSI 65536-edge      virtio0-input");
+    REQUIRE(irqs.get_irq_count(count, 24));
+    REQUIRE(count == 10);
+
+    cpuaff::pci_device device(cpuaff::pci_device_spec(0x1af4, 0x1000),
+                              std::string("0000:00:04.0"), first_cpu.numa());
+
+    std::set< cpuaff::irq_type > device_irqs;
+    REQUIRE(irqs.get_irqs_by_device(device_irqs, device));
+    REQUIRE(device_irqs.size() == 2);
+
+    cpuaff::cpu_set cpus;
+    REQUIRE(irqs.get_irq_affinity(cpus, 24));
+    REQUIRE(cpus.size() == 1);
+    REQUIRE(*cpus.begin() == first_cpu);
+
+    // steer onto the local cpus, leaving the first cpu to the application
+    cpuaff::cpu_set local;
+    cpuaff::cpu_set excluded;
+    excluded.insert(first_cpu);
+
+    if (!manager.get_cpus_by_numa(local, device.numa()))
+    {
+        manager.get_cpus(local);
+    }
+
+    if (local.size() > 1)
+    {
+        REQUIRE(irqs.steer_device_irqs(device, excluded));
+        REQUIRE(irqs.get_irq_affinity(cpus, 25));
+        REQUIRE(cpus.size() == local.size() - 1);
+        REQUIRE(cpus.find(first_cpu) == cpus.end());
     }
+    else
+    {
+        REQUIRE(!irqs.steer_device_irqs(device, excluded));
+    }
+
+    REQUIRE(irqs.set_irq_affinity(24, local));
+    REQUIRE(irqs.get_irq_affinity(cpus, 24));
+    REQUIRE(cpus.size() == local.size());
+
+    remove_dir(root);
 }
 #endif
 
@@ -234,6 +586,33 @@ TEST_CASE("affinity_manager", "[affinity_manager]")
 
             WARN("Affinty is: " << cpus);
         }
+
+        // We can find the cpu the current thread is running on
+        {
+            cpuaff::cpu_set cpus;
+            REQUIRE(manager.get_cpus(cpus));
+
+            cpuaff::cpu_set::iterator i = cpus.begin();
+            cpuaff::cpu_set::iterator iend = cpus.end();
+
+            for (; i != iend; ++i)
+            {
+                REQUIRE(manager.pin(*i));
+
+                cpuaff::cpu cpu;
+                int32_t index = -1;
+                int32_t expected = -1;
+
+                REQUIRE(manager.get_current_cpu(cpu));
+                REQUIRE(cpu == *i);
+                REQUIRE(manager.current_cpu() == *i);
+                REQUIRE(manager.get_current_cpu_index(index));
+                REQUIRE(manager.get_index_from_cpu(expected, *i));
+                REQUIRE(index == expected);
+            }
+
+            REQUIRE(manager.pin(first_cpu));
+        }
     }
 }
 
@@ -338,13 +717,582 @@ TEST_CASE("round_robin_allocator", "[round_robin_allocator]")
             REQUIRE(test);
         }
 
-        REQUIRE(allocator.allocate(allocated_cpus, 4));
+        // asking for more cpus than the allocator holds fails rather than
+        // returning fewer
+        REQUIRE(allocator.allocate(allocated_cpus, 4) == (cpus.size() >= 4));
 
-        bool test =
-            allocated_cpus.size() == 4 ||
-            (allocated_cpus.size() < 4 && allocated_cpus.size() == cpus.size());
+        bool test = allocated_cpus.size() == 4 || allocated_cpus.empty();
         REQUIRE(test);
+
+        REQUIRE(allocator.allocate(allocated_cpus, uint32_t(cpus.size())));
+        REQUIRE(allocated_cpus == cpus);
+        REQUIRE(!allocator.allocate(allocated_cpus,
+                                    uint32_t(cpus.size() + 1)));
+        REQUIRE(allocated_cpus.empty());
+
+        // the round-robin visits every cpu once per cycle
+        cpuaff::cpu_set seen;
+
+        for (std::size_t i = 0; i < cpus.size(); ++i)
+        {
+            REQUIRE(allocator.allocate(cpu));
+            seen.insert(cpu);
+        }
+
+        REQUIRE(seen == cpus);
+
+        cpuaff::round_robin_allocator empty((cpuaff::cpu_set()));
+        REQUIRE(empty.size() == 0);
+        REQUIRE(!empty.allocate(cpu));
+        REQUIRE(!empty.allocate(allocated_cpus, 1));
+    }
+}
+
+TEST_CASE("placement_engine", "[placement_engine]")
+{
+    SECTION("placement_engine on this machine")
+    {
+        cpuaff::affinity_manager manager;
+
+        REQUIRE(manager.has_cpus());
+
+        cpuaff::cpu_set cpus;
+        REQUIRE(manager.get_cpus(cpus));
+
+        cpuaff::placement_engine engine(cpus);
+        REQUIRE(engine.size() == cpus.size());
+
+        std::vector< cpuaff::cpu > placed;
+        REQUIRE(engine.place(placed, cpuaff::placement_policy::scatter(),
+                             cpus.size()));
+        cpuaff::cpu_set placed_set;
+        placed_set.insert(placed.begin(), placed.end());
+        REQUIRE(placed_set == cpus);
+        REQUIRE(!engine.place(placed, cpuaff::placement_policy::compact(),
+                              cpus.size() + 1));
+        REQUIRE(placed.empty());
+
+        std::vector< cpuaff::cpu_set > places;
+        REQUIRE(engine.place(places, cpuaff::placement_policy::compact(), 1,
+                             cpuaff::placement_level::socket));
+        REQUIRE(places.size() == 1);
+    }
+
+    SECTION("placement_engine policies")
+    {
+        // two sockets, one numa node each, two cores with two hyperthreads
+        cpuaff::affinity_manager manager;
+        cpuaff::cpu native;
+        REQUIRE(manager.get_cpu_from_index(native, 0));
+
+        cpuaff::cpu_set cpus;
+
+        for (int32_t socket = 0; socket < 2; ++socket)
+        {
+            for (int32_t core = 0; core < 2; ++core)
+            {
+                for (int32_t pu = 0; pu < 2; ++pu)
+                {
+                    cpus.insert(cpuaff::cpu(cpuaff::cpu_spec(socket, core, pu),
+                                            native.id(), socket));
+                }
+            }
+        }
+
+        cpuaff::placement_engine engine(cpus);
+        std::vector< cpuaff::cpu > placed;
+
+        REQUIRE(engine.place(placed, cpuaff::placement_policy::compact(), 4));
+        REQUIRE(placed[0].spec() == cpuaff::cpu_spec(0, 0, 0));
+        REQUIRE(placed[1].spec() == cpuaff::cpu_spec(0, 0, 1));
+        REQUIRE(placed[2].spec() == cpuaff::cpu_spec(0, 1, 0));
+        REQUIRE(placed[3].spec() == cpuaff::cpu_spec(0, 1, 1));
+
+        REQUIRE(engine.place(placed, cpuaff::placement_policy::scatter(), 8));
+        REQUIRE(placed[0].spec() == cpuaff::cpu_spec(0, 0, 0));
+        REQUIRE(placed[1].spec() == cpuaff::cpu_spec(1, 0, 0));
+        REQUIRE(placed[2].spec() == cpuaff::cpu_spec(0, 1, 0));
+        REQUIRE(placed[3].spec() == cpuaff::cpu_spec(1, 1, 0));
+        REQUIRE(placed[4].spec() == cpuaff::cpu_spec(0, 0, 1));
+        REQUIRE(placed[7].spec() == cpuaff::cpu_spec(1, 1, 1));
+
+        REQUIRE(engine.place(placed,
+                             cpuaff::placement_policy::numa_balanced(), 4));
+        REQUIRE(placed[0].numa() == 0);
+        REQUIRE(placed[1].numa() == 1);
+        REQUIRE(placed[2].spec() == cpuaff::cpu_spec(0, 1, 0));
+
+        cpuaff::placement_level::type socket = cpuaff::placement_level::socket;
+        cpuaff::placement_policy by_socket =
+            cpuaff::placement_policy::spread_by(socket);
+
+        REQUIRE(engine.place(placed, by_socket, 4));
+        REQUIRE(placed[0].spec() == cpuaff::cpu_spec(0, 0, 0));
+        REQUIRE(placed[1].spec() == cpuaff::cpu_spec(1, 0, 0));
+        REQUIRE(placed[2].spec() == cpuaff::cpu_spec(0, 0, 1));
+        REQUIRE(placed[3].spec() == cpuaff::cpu_spec(1, 0, 1));
+
+        // placing the same policy twice gives the same answer
+        std::vector< cpuaff::cpu > again;
+        REQUIRE(engine.place(again, by_socket, 4));
+        REQUIRE(again == placed);
+
+        std::vector< cpuaff::cpu_set > places;
+        REQUIRE(engine.place(places, cpuaff::placement_policy::scatter(), 4));
+        REQUIRE(places.size() == 4);
+        REQUIRE(places[0].size() == 2);
+        REQUIRE(places[1].begin()->socket() == 1);
+        REQUIRE(!engine.place(places, cpuaff::placement_policy::scatter(), 5));
+
+        REQUIRE(engine.place(places, cpuaff::placement_policy::compact(), 2,
+                             cpuaff::placement_level::numa));
+        REQUIRE(places[0].size() == 4);
+        REQUIRE(places[1].size() == 4);
+    }
+}
+
+TEST_CASE("lease_manager", "[lease_manager]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu native;
+    REQUIRE(manager.get_cpu_from_index(native, 0));
+
+    // one socket with four single threaded cores
+    cpuaff::cpu_set cpus;
+
+    for (int32_t core = 0; core < 4; ++core)
+    {
+        cpus.insert(
+            cpuaff::cpu(cpuaff::cpu_spec(0, core, 0), native.id(), 0));
+    }
+
+    cpuaff::lease_manager leases(cpus);
+    cpuaff::cpu_set found;
+    std::string owner;
+
+    REQUIRE(leases.get_shared_cpus(found));
+    REQUIRE(found == cpus);
+    REQUIRE(!leases.get_leased_cpus(found));
+
+    {
+        cpuaff::cpu_lease rx;
+        REQUIRE(!rx.valid());
+        REQUIRE(leases.acquire(rx, 3, "rx"));
+        REQUIRE(rx.valid());
+        REQUIRE(rx.cpus().size() == 3);
+        REQUIRE(rx.owner() == "rx");
+
+        REQUIRE(leases.get_owner(owner, *rx.cpus().begin()));
+        REQUIRE(owner == "rx");
+        REQUIRE(leases.get_cpus_by_owner(found, "rx"));
+        REQUIRE(found == rx.cpus());
+        REQUIRE(leases.get_shared_cpus(found));
+        REQUIRE(found.size() == 1);
+
+        // leased cpus are never handed out twice
+        cpuaff::cpu_lease tx;
+        REQUIRE(!leases.acquire(tx, 2, "tx"));
+        REQUIRE(!tx.valid());
+        REQUIRE(leases.acquire(tx, 1, "tx"));
+        REQUIRE(rx.cpus().find(*tx.cpus().begin()) == rx.cpus().end());
+        REQUIRE(!leases.get_shared_cpus(found));
+
+        // only cpus in the allowed set are considered
+        cpuaff::cpu_lease other;
+        REQUIRE(!leases.acquire(other, 1, "other", rx.cpus()));
+
+        tx.release();
+        REQUIRE(!tx.valid());
+        REQUIRE(!leases.get_cpus_by_owner(found, "tx"));
+
+        cpuaff::cpu_lease moved;
+        moved.swap(rx);
+        REQUIRE(!rx.valid());
+        REQUIRE(moved.cpus().size() == 3);
+        REQUIRE(leases.get_leased_cpus(found));
+        REQUIRE(found.size() == 3);
+    }
+
+    // leases release their cpus when destroyed
+    REQUIRE(!leases.get_leased_cpus(found));
+    REQUIRE(leases.get_shared_cpus(found));
+    REQUIRE(found == cpus);
+    REQUIRE(!leases.get_owner(owner, *cpus.begin()));
+}
+
+TEST_CASE("cpu_set_parser", "[cpu_set_parser]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu native;
+    REQUIRE(manager.get_cpu_from_index(native, 0));
+
+    SECTION("cpu_set_parser selectors and operators")
+    {
+        // two sockets with one numa node each and sparse core ids, each core
+        // with two hyperthreads
+        cpuaff::cpu_set cpus;
+        const int32_t core_ids[] = {0, 4, 8};
+
+        for (int32_t socket = 0; socket < 2; ++socket)
+        {
+            for (int32_t core = 0; core < 3; ++core)
+            {
+                for (int32_t pu = 0; pu < 2; ++pu)
+                {
+                    cpus.insert(cpuaff::cpu(
+                        cpuaff::cpu_spec(socket, core_ids[core], pu),
+                        native.id(), socket));
+                }
+            }
+        }
+
+        cpuaff::cpu_set_parser parser(manager, cpus);
+        cpuaff::cpu_set result;
+        cpuaff::parse_error error;
+
+        REQUIRE(parser.parse(result, "*"));
+        REQUIRE(result == cpus);
+
+        REQUIRE(parser.parse(result, "numa:1/core:1-2/pu:0"));
+        REQUIRE(result.size() == 2);
+        REQUIRE(result.begin()->spec() == cpuaff::cpu_spec(1, 4, 0));
+        REQUIRE(result.rbegin()->spec() == cpuaff::cpu_spec(1, 8, 0));
+
+        REQUIRE(parser.parse(result, "socket:*/pu:0"));
+        REQUIRE(result.size() == 6);
+        REQUIRE(parser.parse(result, "socket:0,1/core:0/pu:*"));
+        REQUIRE(result.size() == 4);
+
+        REQUIRE(parser.parse(result, "socket:0 | socket:1/core:0"));
+        REQUIRE(result.size() == 8);
+        REQUIRE(parser.parse(result, "socket:0 - core:0"));
+        REQUIRE(result.size() == 4);
+        REQUIRE(parser.parse(result, "socket:0 - core:0 & pu:1"));
+        REQUIRE(result.size() == 5);
+        REQUIRE(parser.parse(result, "(socket:0 - core:0) & pu:1"));
+        REQUIRE(result.size() == 2);
+
+        // selectors that do not match this machine select nothing
+        REQUIRE(parser.parse(result, "numa:7"));
+        REQUIRE(result.empty());
+
+        REQUIRE(!parser.parse(result, "numa:0/cores:1", error));
+        REQUIRE(error.column() == 8);
+        REQUIRE(!parser.parse(result, "numa0", error));
+        REQUIRE(error.column() == 5);
+        REQUIRE(!parser.parse(result, "core:7-2", error));
+        REQUIRE(error.column() == 8);
+        REQUIRE(!parser.parse(result, "(socket:0", error));
+        REQUIRE(error.column() == 10);
+        REQUIRE(error.what() == "column 10: expected ')'");
+        REQUIRE(!parser.parse(result, "socket:0 |", error));
+        REQUIRE(error.column() == 11);
+        REQUIRE(!parser.parse(result, "socket:0 socket:1", error));
+        REQUIRE(error.column() == 10);
+        REQUIRE(!parser.parse(result, "", error));
+        REQUIRE(error.column() == 1);
+
+        std::vector< cpuaff::cpu_set > places;
+        REQUIRE(parser.parse_places(places, "cores"));
+        REQUIRE(places.size() == 6);
+        REQUIRE(places[0].size() == 2);
+        REQUIRE(parser.parse_places(places, "sockets(1)"));
+        REQUIRE(places.size() == 1);
+        REQUIRE(places[0].size() == 6);
+        REQUIRE(parser.parse_places(places, "threads"));
+        REQUIRE(places.size() == 12);
+        REQUIRE(!parser.parse_places(places, "ll_caches", error));
+        REQUIRE(error.column() == 1);
+    }
+
+    SECTION("cpu_set_parser native lists and intervals")
+    {
+        cpuaff::cpu_set_parser parser(manager);
+        cpuaff::cpu_set result;
+        cpuaff::cpu_set expected;
+        cpuaff::parse_error error;
+        expected.insert(native);
+
+        std::ostringstream id;
+        id << native.id().get();
+
+        REQUIRE(parser.parse(result, id.str()));
+        REQUIRE(result == expected);
+        REQUIRE(parser.parse(result, id.str() + "-" + id.str() + ",100000"));
+        REQUIRE(result == expected);
+        REQUIRE(parser.parse(result, "cpu:" + id.str()));
+        REQUIRE(result == expected);
+        REQUIRE(parser.parse(result, "{" + id.str() + ":1}"));
+        REQUIRE(result == expected);
+        REQUIRE(parser.parse(result, "* - " + id.str()));
+        REQUIRE(result.find(native) == result.end());
+
+        cpuaff::cpu_set all;
+        REQUIRE(manager.get_cpus(all));
+
+        std::ostringstream count;
+        count << all.size();
+
+        // places past the last cpu are left out
+        std::vector< cpuaff::cpu_set > places;
+        REQUIRE(parser.parse_places(places, "{" + id.str() + ":1}:" +
+                                                count.str() + ":100000, {" +
+                                                id.str() + "}"));
+        REQUIRE(places.size() == 2);
+        REQUIRE(places[0] == expected);
+        REQUIRE(places[1] == expected);
+
+        REQUIRE(!parser.parse(result, "{0:0}", error));
+        REQUIRE(error.column() == 4);
+        REQUIRE(!parser.parse_places(places, "{0:1", error));
+        REQUIRE(error.column() == 5);
+        REQUIRE(!parser.parse_places(places, "{0},", error));
+        REQUIRE(error.column() == 5);
+        REQUIRE(!parser.parse(result, "99999999999", error));
+        REQUIRE(error.column() == 1);
+
+        // ranges stop at the largest cpu number instead of counting to the
+        // end of the range
+        REQUIRE(parser.parse(result, id.str() + "-2147483647"));
+        REQUIRE(result.find(native) != result.end());
+
+        // lengths and counts beyond the number of cpus are mistakes
+        std::ostringstream too_many;
+        too_many << all.size() + 1;
+
+        REQUIRE(!parser.parse(result, "{0:" + too_many.str() + "}", error));
+        REQUIRE(error.column() == 4);
+        REQUIRE(!parser.parse(result, "{0:2147483647}", error));
+        REQUIRE(error.column() == 4);
+        REQUIRE(!parser.parse_places(places, "{0}:" + too_many.str(), error));
+        REQUIRE(error.column() == 5);
+        REQUIRE(!parser.parse_places(places, "{0}:2147483647:1", error));
+        REQUIRE(error.column() == 5);
+    }
+
+    SECTION("cpu_spec parsing")
+    {
+        cpuaff::cpu_spec spec;
+        REQUIRE(cpuaff::cpu_spec::parse(spec, "1,2,3"));
+        REQUIRE(spec == cpuaff::cpu_spec(1, 2, 3));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "1,2"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "1,2,3x"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "a,2,3"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, " 1,2,3"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "1, 2,3"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "1,+2,3"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "1,2,-"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "4294967296,0,0"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "2147483648,0,0"));
+        REQUIRE(!cpuaff::cpu_spec::parse(spec, "99999999999999999999,0,0"));
+        REQUIRE(cpuaff::cpu_spec::parse(spec, "-1,2147483647,0"));
+        REQUIRE(spec == cpuaff::cpu_spec(-1, 2147483647, 0));
+        REQUIRE(cpuaff::cpu_spec::parse("1,2,3") == cpuaff::cpu_spec(1, 2, 3));
+    }
+}
+
+TEST_CASE("role_manager", "[role_manager]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu native;
+    REQUIRE(manager.get_cpu_from_index(native, 0));
+
+    // one socket with four cores, each core with two hyperthreads
+    cpuaff::cpu_set cpus;
+
+    for (int32_t core = 0; core < 4; ++core)
+    {
+        for (int32_t pu = 0; pu < 2; ++pu)
+        {
+            cpus.insert(cpuaff::cpu(cpuaff::cpu_spec(0, core, pu), native.id(),
+                                    0));
+        }
     }
+
+    SECTION("role_manager declarations")
+    {
+        cpuaff::role_manager roles(manager, cpus);
+        cpuaff::parse_error error;
+        cpuaff::role role;
+        cpuaff::cpu_set result;
+
+        REQUIRE(roles.load_string(
+            "md_feed.cpus = core:0-1; md_feed.exclusive = true;"
+            "md_feed.smt = one; md_feed.memory = local;"
+            "workers.cpus = *",
+            error));
+
+        REQUIRE(roles.has_role("md_feed"));
+        REQUIRE(!roles.has_role("logger"));
+        REQUIRE(roles.get_role(role, "md_feed"));
+        REQUIRE(role.name() == "md_feed");
+        REQUIRE(role.expression() == "core:0-1");
+        REQUIRE(role.exclusive());
+        REQUIRE(role.smt() == cpuaff::smt_policy::one);
+        REQUIRE(role.memory() == cpuaff::memory_policy::local);
+        REQUIRE(role.cpus().size() == 2);
+        REQUIRE(role.cpus().begin()->spec() == cpuaff::cpu_spec(0, 0, 0));
+        REQUIRE(role.cpus().rbegin()->spec() == cpuaff::cpu_spec(0, 1, 0));
+
+        // the exclusive role's cpus are taken from every other role
+        REQUIRE(roles.get_role_cpus(result, "workers"));
+        REQUIRE(result.size() == 6);
+        REQUIRE(result.find(*role.cpus().begin()) == result.end());
+
+        std::vector< std::string > names;
+        REQUIRE(roles.get_role_names(names));
+        REQUIRE(names.size() == 2);
+
+        // later declarations override earlier ones
+        REQUIRE(roles.load_string("md_feed.exclusive = false", error));
+        REQUIRE(roles.get_role_cpus(result, "workers"));
+        REQUIRE(result.size() == 8);
+
+        // a failed load leaves the roles untouched
+        REQUIRE(!roles.load_string("md_feed.cpus = core:0;md_feed.smt = two",
+                                   error));
+        REQUIRE(error.what() ==
+                "column 15: entry 2: invalid value 'two' for smt");
+        REQUIRE(roles.get_role_cpus(result, "md_feed"));
+        REQUIRE(result.size() == 2);
+
+        REQUIRE(!roles.load_string("md_feed.cpus = core:0/cores:1", error));
+        REQUIRE(error.column() == 23);
+        REQUIRE(!roles.load_string("md_feed.pus = *", error));
+        REQUIRE(error.column() == 9);
+        REQUIRE(!roles.load_string("md_feed", error));
+        REQUIRE(error.column() == 8);
+        REQUIRE(!roles.load_string("logger.smt = one", error));
+        REQUIRE(error.message() == "role 'logger' has no cpus");
+        REQUIRE(!roles.load_string("a.cpus = core:0;a.exclusive = true;"
+                                   "b.cpus = core:0-1;b.exclusive = true",
+                                   error));
+        REQUIRE(!roles.load_string("a.cpus = core:0;a.exclusive = true;"
+                                   "b.cpus = core:0",
+                                   error));
+        REQUIRE(error.message() == "role 'b' has no cpus left");
+    }
+
+    SECTION("role_manager files and environment")
+    {
+        cpuaff::role_manager roles(manager, cpus);
+        cpuaff::parse_error error;
+        cpuaff::cpu_set result;
+        std::string root = make_temp_dir();
+        REQUIRE(!root.empty());
+
+        write_file(root + "/placement.conf",
+                   "# trading threads\n"
+                   "md_feed.cpus = core:0-1  # feed handlers\n"
+                   "\n"
+                   "md_feed.smt = one\n");
+
+        REQUIRE(roles.load_file(root + "/placement.conf", error));
+        REQUIRE(roles.get_role_cpus(result, "md_feed"));
+        REQUIRE(result.size() == 2);
+
+        write_file(root + "/broken.conf", "\n\nmd_feed.memory = remote\n");
+        REQUIRE(!roles.load_file(root + "/broken.conf", error));
+        REQUIRE(error.what() ==
+                "column 18: line 3: invalid value 'remote' for memory");
+        REQUIRE(!roles.load_file(root + "/missing.conf", error));
+
+        setenv("CPUAFF_TEST_PLACEMENT", "md_feed.smt = all", 1);
+        REQUIRE(roles.load_environment(error, "CPUAFF_TEST_PLACEMENT"));
+        REQUIRE(roles.get_role_cpus(result, "md_feed"));
+        REQUIRE(result.size() == 4);
+        unsetenv("CPUAFF_TEST_PLACEMENT");
+        REQUIRE(roles.load_environment(error, "CPUAFF_TEST_PLACEMENT"));
+
+        remove_dir(root);
+    }
+
+    SECTION("role_manager pin_role")
+    {
+        cpuaff::role_manager roles(manager);
+        cpuaff::parse_error error;
+        cpuaff::cpu_set original;
+        cpuaff::cpu_set current;
+        REQUIRE(manager.get_affinity(original));
+
+        std::ostringstream declaration;
+        declaration << "md_feed.cpus = " << native.id().get()
+                    << "; md_feed.memory = local";
+        REQUIRE(roles.load_string(declaration.str(), error));
+
+        REQUIRE(!roles.pin_role("logger"));
+        REQUIRE(roles.pin_role("md_feed"));
+        REQUIRE(manager.get_affinity(current));
+        REQUIRE(current.size() == 1);
+        REQUIRE(*current.begin() == native);
+
+        REQUIRE(roles.load_string("md_feed.memory = default", error));
+        REQUIRE(roles.pin_role("md_feed"));
+        REQUIRE(manager.set_affinity(original));
+    }
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+    SECTION("role_manager pin_role keeps an inherited memory policy")
+    {
+        namespace page_mover = cpuaff::impl::linux_impl::page_mover;
+
+        cpuaff::role_manager roles(manager);
+        cpuaff::parse_error error;
+        cpuaff::cpu_set original;
+        REQUIRE(manager.get_affinity(original));
+
+        std::ostringstream declaration;
+        declaration << "md_feed.cpus = " << native.id().get()
+                    << "; md_feed.memory = default";
+        REQUIRE(roles.load_string(declaration.str(), error));
+
+        // as if started under numactl --membind
+        REQUIRE(page_mover::set_policy(
+            page_mover::mpol_bind,
+            std::vector< cpuaff::numa_type >(1, native.numa())));
+
+        bool policy_applied = false;
+        REQUIRE(roles.pin_role(policy_applied, "md_feed"));
+        REQUIRE(policy_applied);
+
+        int mode = -1;
+        unsigned long nodes[16] = {0};
+        REQUIRE(syscall(SYS_get_mempolicy, &mode, nodes,
+                        sizeof(nodes) * 8, NULL, 0) == 0);
+        REQUIRE(mode == page_mover::mpol_bind);
+
+        REQUIRE(page_mover::set_policy(page_mover::mpol_default,
+                                       std::vector< cpuaff::numa_type >()));
+        REQUIRE(manager.set_affinity(original));
+    }
+
+    SECTION("role_manager pin_role pins when the memory policy fails")
+    {
+        // a cpu that is really this machine's but claims a numa node that
+        // does not exist, so the interleave policy cannot be applied
+        cpuaff::cpu_set cpus;
+        cpus.insert(cpuaff::cpu(native.spec(), native.id(), 63));
+
+        cpuaff::role_manager roles(manager, cpus);
+        cpuaff::parse_error error;
+        cpuaff::cpu_set original;
+        cpuaff::cpu_set current;
+        REQUIRE(manager.get_affinity(original));
+        REQUIRE(roles.load_string("md_feed.cpus = *; md_feed.memory = "
+                                  "interleave",
+                                  error));
+
+        bool policy_applied = true;
+        REQUIRE(roles.pin_role(policy_applied, "md_feed"));
+        REQUIRE(!policy_applied);
+        REQUIRE(manager.get_affinity(current));
+        REQUIRE(current.size() == 1);
+        REQUIRE(*current.begin() == native);
+
+        REQUIRE(roles.pin_role("md_feed"));
+        REQUIRE(manager.set_affinity(original));
+    }
+#endif
 }
 
 TEST_CASE("native_cpu_mapper", "[native_cpu_mapper]")
@@ -375,3 +1323,1043 @@ TEST_CASE("native_cpu_mapper", "[native_cpu_mapper]")
         }
     }
 }
+
+struct per_cpu_max
+{
+    inline uint64_t operator()(const uint64_t &a, const uint64_t &b) const
+    {
+        return (a < b) ? b : a;
+    }
+};
+
+#include <stdexcept>
+
+struct per_cpu_throwing
+{
+    static int live;
+    static int copies_before_throw;
+
+    per_cpu_throwing() { ++live; }
+
+    per_cpu_throwing(const per_cpu_throwing &)
+    {
+        if (copies_before_throw-- == 0)
+        {
+            throw std::runtime_error("per_cpu_throwing");
+        }
+
+        ++live;
+    }
+
+    ~per_cpu_throwing() { --live; }
+};
+
+int per_cpu_throwing::live = 0;
+int per_cpu_throwing::copies_before_throw = 0;
+
+static void make_per_cpu_throwing(const cpuaff::affinity_manager &manager,
+                                  const per_cpu_throwing &initial)
+{
+    cpuaff::per_cpu< per_cpu_throwing > values(manager, initial);
+}
+
+TEST_CASE("per_cpu", "[per_cpu]")
+{
+    cpuaff::affinity_manager manager;
+    REQUIRE(manager.has_cpus());
+
+    cpuaff::cpu_set cpus;
+    REQUIRE(manager.get_cpus(cpus));
+
+    SECTION("per_cpu values are padded to cache lines")
+    {
+        cpuaff::per_cpu< uint64_t > counters(manager, 7);
+        REQUIRE(counters.size() == cpus.size());
+
+        for (int32_t i = 0; i < int32_t(counters.size()); ++i)
+        {
+            REQUIRE(counters[i] == 7);
+            REQUIRE(uintptr_t(&counters[i]) % CPUAFF_CACHE_LINE_SIZE == 0);
+
+            for (int32_t j = 0; j < i; ++j)
+            {
+                intptr_t distance =
+                    intptr_t(&counters[i]) - intptr_t(&counters[j]);
+                REQUIRE((distance >= CPUAFF_CACHE_LINE_SIZE ||
+                         distance <= -CPUAFF_CACHE_LINE_SIZE));
+            }
+        }
+    }
+
+    SECTION("per_cpu local value follows the current cpu")
+    {
+        cpuaff::affinity_stack stack(manager);
+        REQUIRE(stack.push_affinity());
+
+        cpuaff::per_cpu< uint64_t > counters(manager);
+
+        cpuaff::cpu_set::iterator i = cpus.begin();
+        cpuaff::cpu_set::iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            REQUIRE(manager.pin(*i));
+            ++counters.local();
+
+            uint64_t *value = NULL;
+            REQUIRE(counters.get(value, *i));
+            REQUIRE(value == &counters.local());
+            REQUIRE(*value == 1);
+        }
+
+        REQUIRE(stack.pop_affinity());
+        REQUIRE(counters.sum() == cpus.size());
+        REQUIRE(counters.reduce(per_cpu_max(), 0) == 1);
+        REQUIRE(counters.reduce(cpus, std::plus< uint64_t >(), 0) ==
+                cpus.size());
+    }
+
+    SECTION("per_cpu values can be combined by topology")
+    {
+        cpuaff::per_cpu< uint64_t > counters(manager, 1);
+
+        std::map< cpuaff::numa_type, uint64_t > by_numa;
+        std::map< cpuaff::socket_type, uint64_t > by_socket;
+        std::map< cpuaff::llc_type, uint64_t > by_llc;
+
+        counters.sum_by_numa(by_numa);
+        counters.sum_by_socket(by_socket);
+        counters.sum_by_llc(by_llc);
+
+        std::map< cpuaff::numa_type, uint64_t > numa_counts;
+        std::map< cpuaff::socket_type, uint64_t > socket_counts;
+        std::map< cpuaff::llc_type, uint64_t > llc_counts;
+
+        cpuaff::cpu_set::iterator i = cpus.begin();
+        cpuaff::cpu_set::iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            ++numa_counts[i->numa()];
+            ++socket_counts[i->socket()];
+
+            if (i->llc() >= 0)
+            {
+                ++llc_counts[i->llc()];
+            }
+        }
+
+        REQUIRE(by_numa == numa_counts);
+        REQUIRE(by_socket == socket_counts);
+        REQUIRE(by_llc == llc_counts);
+
+        std::map< cpuaff::numa_type, uint64_t > max_by_numa;
+        counters.reduce_by_numa(max_by_numa, per_cpu_max(), 0);
+        REQUIRE(max_by_numa.size() == numa_counts.size());
+        REQUIRE(max_by_numa.begin()->second == 1);
+    }
+
+    SECTION("per_cpu destroys its values when construction throws")
+    {
+        per_cpu_throwing initial;
+        REQUIRE(per_cpu_throwing::live == 1);
+
+        // throw on the copy for the last cpu, after the others are built
+        per_cpu_throwing::copies_before_throw = int(cpus.size()) - 1;
+        REQUIRE_THROWS_AS(make_per_cpu_throwing(manager, initial),
+                          const std::runtime_error &);
+        REQUIRE(per_cpu_throwing::live == 1);
+    }
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+    SECTION("per_cpu values are allocated on their numa node")
+    {
+        cpuaff::per_cpu< uint64_t > counters(manager);
+        cpuaff::page_placement_manager placement;
+
+        cpuaff::cpu_set::iterator i = cpus.begin();
+        cpuaff::cpu_set::iterator iend = cpus.end();
+
+        for (int32_t index = 0; i != iend; ++i, ++index)
+        {
+            std::size_t misplaced = 1;
+            REQUIRE(placement.get_misplaced_pages(
+                misplaced, &counters[index], sizeof(uint64_t), i->numa()));
+            REQUIRE(misplaced == 0);
+        }
+    }
+#endif
+}
+
+#include <pthread.h>
+
+struct per_cpu_entry : public cpuaff::per_cpu_freelist_node
+{
+    int32_t id;
+};
+
+struct per_cpu_worker
+{
+    cpuaff::per_cpu_counter *counter;
+    cpuaff::per_cpu_freelist< per_cpu_entry > *freelist;
+    int32_t iterations;
+};
+
+static void *per_cpu_work(void *arg)
+{
+    per_cpu_worker *worker = static_cast< per_cpu_worker * >(arg);
+
+    for (int32_t i = 0; i < worker->iterations; ++i)
+    {
+        worker->counter->increment();
+
+        per_cpu_entry *entry = worker->freelist->pop();
+
+        if (entry)
+        {
+            worker->freelist->push(entry);
+        }
+    }
+
+    return NULL;
+}
+
+TEST_CASE("per_cpu_ops", "[per_cpu_ops]")
+{
+    cpuaff::affinity_manager manager;
+    REQUIRE(manager.has_cpus());
+
+    cpuaff::cpu_set cpus;
+    REQUIRE(manager.get_cpus(cpus));
+
+    WARN("Restartable sequences: "
+         << (cpuaff::per_cpu_counter(manager).uses_rseq() ? "yes" : "no"));
+
+    SECTION("per_cpu_counter adds to the current cpu")
+    {
+        cpuaff::affinity_stack stack(manager);
+        REQUIRE(stack.push_affinity());
+
+        cpuaff::per_cpu_counter counter(manager);
+        REQUIRE(counter.size() == cpus.size());
+
+        cpuaff::cpu_set::iterator i = cpus.begin();
+        cpuaff::cpu_set::iterator iend = cpus.end();
+
+        for (int32_t index = 0; i != iend; ++i, ++index)
+        {
+            REQUIRE(manager.pin(*i));
+
+            counter.add(index + 2);
+            counter.increment();
+            REQUIRE(counter.local() == index + 3);
+            REQUIRE(counter.get(index) == index + 3);
+
+            REQUIRE(!counter.compare_and_store(index, 100));
+            REQUIRE(counter.compare_and_store(index + 3, index + 4));
+            REQUIRE(counter.get(index) == index + 4);
+        }
+
+        REQUIRE(stack.pop_affinity());
+
+        cpuaff::per_cpu_counter::value_type expected = 0;
+
+        for (int32_t index = 0; index < int32_t(cpus.size()); ++index)
+        {
+            expected += index + 4;
+        }
+
+        REQUIRE(counter.sum() == expected);
+    }
+
+    SECTION("per_cpu_freelist is a stack per cpu")
+    {
+        cpuaff::affinity_stack stack(manager);
+        REQUIRE(stack.push_affinity());
+        REQUIRE(manager.pin(*cpus.begin()));
+
+        cpuaff::per_cpu_freelist< per_cpu_entry > freelist(manager);
+        per_cpu_entry entries[3];
+
+        REQUIRE(freelist.empty(0));
+        REQUIRE(freelist.pop() == NULL);
+
+        for (int32_t i = 0; i < 3; ++i)
+        {
+            entries[i].id = i;
+            freelist.push(&entries[i]);
+        }
+
+        REQUIRE(!freelist.empty(0));
+
+        for (int32_t i = 2; i >= 0; --i)
+        {
+            per_cpu_entry *entry = freelist.pop();
+            REQUIRE(entry == &entries[i]);
+        }
+
+        REQUIRE(freelist.pop() == NULL);
+        REQUIRE(stack.pop_affinity());
+    }
+
+    SECTION("per_cpu ops are consistent under concurrency")
+    {
+        const int32_t thread_count = 4;
+        const int32_t iterations = 100000;
+        const int32_t entry_count = 64;
+
+        cpuaff::per_cpu_counter counter(manager);
+        cpuaff::per_cpu_freelist< per_cpu_entry > freelist(manager);
+        per_cpu_entry entries[entry_count];
+
+        for (int32_t i = 0; i < entry_count; ++i)
+        {
+            entries[i].id = i;
+            freelist.push(&entries[i]);
+        }
+
+        per_cpu_worker workers[thread_count];
+        pthread_t handles[thread_count];
+
+        for (int32_t i = 0; i < thread_count; ++i)
+        {
+            workers[i].counter = &counter;
+            workers[i].freelist = &freelist;
+            workers[i].iterations = iterations;
+            REQUIRE(pthread_create(&handles[i], NULL, per_cpu_work,
+                                   &workers[i]) == 0);
+        }
+
+        for (int32_t i = 0; i < thread_count; ++i)
+        {
+            REQUIRE(pthread_join(handles[i], NULL) == 0);
+        }
+
+        REQUIRE(counter.sum() == thread_count * iterations);
+
+        // every entry is on exactly one stack
+        cpuaff::affinity_stack stack(manager);
+        REQUIRE(stack.push_affinity());
+
+        std::set< int32_t > seen;
+        int32_t popped = 0;
+
+        cpuaff::cpu_set::iterator i = cpus.begin();
+        cpuaff::cpu_set::iterator iend = cpus.end();
+
+        for (; i != iend; ++i)
+        {
+            REQUIRE(manager.pin(*i));
+
+            for (per_cpu_entry *entry = freelist.pop(); entry;
+                 entry = freelist.pop())
+            {
+                seen.insert(entry->id);
+                ++popped;
+            }
+        }
+
+        REQUIRE(stack.pop_affinity());
+        REQUIRE(popped == entry_count);
+        REQUIRE(seen.size() == std::size_t(entry_count));
+    }
+}
+
+#if defined(CPUAFF_CPU_REGISTRY_SUPPORTED)
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+TEST_CASE("cpu_registry", "[cpu_registry]")
+{
+    cpuaff::affinity_manager manager;
+
+    REQUIRE(manager.has_cpus());
+
+    std::ostringstream name;
+    name << "/cpuaff.test." << getpid();
+
+    cpuaff::cpu_registry registry(manager, name.str());
+    REQUIRE(registry.is_open());
+
+    // the registry is private to this user unless asked otherwise
+    struct stat st;
+    REQUIRE(stat(("/dev/shm" + name.str()).c_str(), &st) == 0);
+    REQUIRE((st.st_mode & 0777) == 0600);
+
+    cpuaff::cpu cpu;
+    cpuaff::cpu_set cpus;
+    cpuaff::process_id_type pid;
+    int32_t index;
+
+    REQUIRE(manager.get_cpu_from_index(cpu, 0));
+    REQUIRE(manager.get_index_from_cpu(index, cpu));
+    REQUIRE(index == 0);
+    REQUIRE(!registry.get_owner(pid, cpu));
+
+    REQUIRE(registry.claim(cpu));
+    REQUIRE(registry.claim(cpu));
+    REQUIRE(registry.get_owner(pid, cpu));
+    REQUIRE(pid == getpid());
+    REQUIRE(registry.get_cpus_by_owner(cpus, getpid()));
+    REQUIRE(cpus.size() == 1);
+
+    // a second registry on the same name sees the claim
+    {
+        cpuaff::cpu_registry other(manager, name.str());
+        REQUIRE(other.get_owner(pid, cpu));
+        REQUIRE(pid == getpid());
+    }
+
+    REQUIRE(registry.release(cpu));
+    REQUIRE(!registry.release(cpu));
+    REQUIRE(!registry.get_owner(pid, cpu));
+
+    // claims of a process that has exited are taken over
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        cpuaff::cpu_registry child_registry(manager, name.str());
+        _exit(child_registry.claim(cpu) ? 0 : 1);
+    }
+
+    int status = 0;
+    REQUIRE(waitpid(child, &status, 0) == child);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+
+    REQUIRE(registry.get_owner(pid, cpu));
+    REQUIRE(pid == child);
+    REQUIRE(registry.get_unclaimed_cpus(cpus));
+    REQUIRE(cpus.find(cpu) != cpus.end());
+    REQUIRE(registry.reclaim() == 1);
+    REQUIRE(!registry.get_owner(pid, cpu));
+
+    REQUIRE(registry.get_unclaimed_cpus(cpus));
+    REQUIRE(registry.claim(cpus));
+    REQUIRE(!registry.get_unclaimed_cpus(cpus));
+    registry.release_all();
+    REQUIRE(registry.get_unclaimed_cpus(cpus));
+
+    REQUIRE(cpuaff::cpu_registry::remove(name.str()));
+}
+#endif
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+TEST_CASE("cpu_load_sampler", "[cpu_load_sampler]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu cpu;
+    REQUIRE(manager.get_cpu_from_index(cpu, 0));
+
+    SECTION("cpu_load_sampler fake procfs")
+    {
+        std::string root = make_temp_dir();
+        REQUIRE(!root.empty());
+
+        // a long interrupt line makes the reader grow its buffer
+        std::ostringstream stat;
+        std::string intr(20000, '1');
+        stat << "cpu  1 2 3 4 5 6 7 8 9 10\n"
+             << "cpu" << cpu.id().get() << " 100 0 50 800 10 5 5 0 0 0\n"
+             << "intr " << intr << "\n"
+             << "ctxt 12345\n";
+        write_file(root + "/stat", stat.str());
+
+        cpuaff::cpu_load_sampler sampler(manager, root);
+        cpuaff::cpu_times times;
+        cpuaff::cpu least;
+
+        // the first sample is a baseline
+        REQUIRE(sampler.sample());
+        REQUIRE(!sampler.get_delta(times, cpu));
+        REQUIRE(!sampler.get_least_loaded_cpu_by_numa(least, cpu.numa()));
+
+        stat.str("");
+        stat << "cpu  1 2 3 4 5 6 7 8 9 10\n"
+             << "cpu" << cpu.id().get() << " 130 10 60 840 5 8 9 3 0 0\n"
+             << "intr " << intr << "\n";
+        write_file(root + "/stat", stat.str());
+
+        REQUIRE(sampler.sample());
+        REQUIRE(sampler.get_delta(times, cpu));
+        REQUIRE(times.user == 30);
+        REQUIRE(times.nice == 10);
+        REQUIRE(times.system == 10);
+        REQUIRE(times.idle == 40);
+        REQUIRE(times.iowait == 0);
+        REQUIRE(times.irq == 3);
+        REQUIRE(times.softirq == 4);
+        REQUIRE(times.steal == 3);
+        REQUIRE(times.busy() == 60);
+        REQUIRE(times.total() == 100);
+        REQUIRE(times.utilization() == Approx(0.6));
+
+        std::map< cpuaff::cpu, cpuaff::cpu_times > by_cpu;
+        REQUIRE(sampler.get_deltas(by_cpu));
+        REQUIRE(by_cpu.size() == 1);
+
+        std::map< cpuaff::numa_type, cpuaff::cpu_times > by_numa;
+        REQUIRE(sampler.get_deltas_by_numa(by_numa));
+        REQUIRE(by_numa[cpu.numa()].busy() == 60);
+
+        std::map< cpuaff::socket_type, cpuaff::cpu_times > by_socket;
+        REQUIRE(sampler.get_deltas_by_socket(by_socket));
+        REQUIRE(by_socket[cpu.socket()].busy() == 60);
+
+        std::map< std::pair< cpuaff::socket_type, cpuaff::core_type >,
+                  cpuaff::cpu_times >
+            by_core;
+        REQUIRE(sampler.get_deltas_by_core(by_core));
+        REQUIRE(by_core[std::make_pair(cpu.socket(), cpu.core())].busy() ==
+                60);
+
+        REQUIRE(sampler.get_least_loaded_cpu_by_numa(least, cpu.numa()));
+        REQUIRE(least == cpu);
+
+        remove_dir(root);
+
+        cpuaff::cpu_load_sampler missing(manager, root);
+        REQUIRE(!missing.sample());
+    }
+
+    SECTION("cpu_load_sampler procfs")
+    {
+        cpuaff::cpu_load_sampler sampler(manager);
+        cpuaff::cpu_set cpus;
+        cpuaff::cpu least;
+        REQUIRE(manager.get_cpus(cpus));
+
+        REQUIRE(sampler.sample());
+        usleep(20000);
+        REQUIRE(sampler.sample());
+        REQUIRE(sampler.get_least_loaded_cpu(least, cpus));
+        REQUIRE(cpus.find(least) != cpus.end());
+    }
+}
+#endif
+
+#if defined(CPUAFF_THREAD_REGISTRY_SUPPORTED)
+#include <pthread.h>
+
+namespace
+{
+struct registered_thread
+{
+    cpuaff::thread_registry *registry;
+    cpuaff::cpu_set cpus;
+    cpuaff::thread_id_type tid;
+    bool registered;
+};
+
+void *register_and_exit(void *arg)
+{
+    registered_thread *thread = static_cast< registered_thread * >(arg);
+    thread->registered =
+        thread->registry->register_thread("worker", thread->cpus);
+    thread->tid = cpuaff::thread_id_type(syscall(SYS_gettid));
+    return NULL;
+}
+}  // namespace
+
+TEST_CASE("thread_registry", "[thread_registry]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu_set original;
+    cpuaff::cpu cpu;
+    REQUIRE(manager.get_affinity(original));
+    REQUIRE(manager.get_cpu_from_index(cpu, 0));
+
+    cpuaff::cpu_set cpus;
+    cpus.insert(cpu);
+
+    std::string original_name;
+    std::ifstream original_comm("/proc/thread-self/comm");
+    std::getline(original_comm, original_name);
+
+    cpuaff::thread_registry registry(manager);
+    cpuaff::thread_placement placement;
+    cpuaff::thread_id_type self = cpuaff::thread_id_type(syscall(SYS_gettid));
+
+    REQUIRE(registry.register_thread("cpuaff_test_main_thread", cpus));
+    REQUIRE(registry.size() == 1);
+    REQUIRE(registry.get_placement(placement, self));
+    REQUIRE(placement.thread() == self);
+    REQUIRE(placement.name() == "cpuaff_test_main_thread");
+    REQUIRE(placement.alive());
+    REQUIRE(placement.intended() == cpus);
+    REQUIRE(placement.actual() == cpus);
+    REQUIRE(placement.has_last_cpu());
+    REQUIRE(placement.last_cpu() == cpu);
+    REQUIRE(!placement.misplaced());
+
+    // the kernel keeps the first 15 characters of the name
+    std::ifstream comm("/proc/thread-self/comm");
+    std::string name;
+    std::getline(comm, name);
+    REQUIRE(name == "cpuaff_test_mai");
+
+    // a thread that exits is reported and can be pruned
+    registered_thread thread;
+    thread.registry = &registry;
+    thread.cpus = cpus;
+    thread.registered = false;
+    pthread_t handle;
+    REQUIRE(pthread_create(&handle, NULL, register_and_exit, &thread) == 0);
+    REQUIRE(pthread_join(handle, NULL) == 0);
+    REQUIRE(thread.registered);
+    REQUIRE(registry.size() == 2);
+    REQUIRE(registry.get_placement(placement, thread.tid));
+    REQUIRE(!placement.alive());
+    REQUIRE(!placement.misplaced());
+
+    std::vector< cpuaff::thread_placement > placements;
+    REQUIRE(registry.get_placements(placements));
+    REQUIRE(placements.size() == 2);
+
+    std::ostringstream expected;
+    expected << "tid: " << self << ", name: cpuaff_test_main_thread"
+             << ", intended: " << cpu.id().get()
+             << ", actual: " << cpu.id().get()
+             << ", last_cpu: " << cpu.id().get() << "\n";
+
+    std::ostringstream dump;
+    registry.dump_placement(dump);
+    REQUIRE(dump.str().find(expected.str()) != std::string::npos);
+    std::ostringstream exited;
+    exited << "name: worker, intended: " << cpu.id().get() << ", EXITED";
+    REQUIRE(dump.str().find(exited.str()) != std::string::npos);
+
+    REQUIRE(registry.prune() == 1);
+    REQUIRE(registry.size() == 1);
+
+    REQUIRE(registry.unregister_thread());
+    REQUIRE(!registry.unregister_thread());
+    REQUIRE(registry.size() == 0);
+    REQUIRE(!registry.get_placements(placements));
+    REQUIRE(manager.set_affinity(original));
+    pthread_setname_np(pthread_self(), original_name.c_str());
+}
+
+namespace
+{
+struct counting_listener : public cpuaff::drift_listener
+{
+    counting_listener() : mask_changed_calls(0), restored_calls(0) {}
+
+    virtual void mask_changed(const cpuaff::thread_id_type &tid,
+                              const std::string &name)
+    {
+        ++mask_changed_calls;
+        last_name = name;
+    }
+
+    virtual void restored(const cpuaff::thread_id_type &tid,
+                          const std::string &name)
+    {
+        ++restored_calls;
+    }
+
+    int mask_changed_calls;
+    int restored_calls;
+    std::string last_name;
+};
+}  // namespace
+
+TEST_CASE("drift_auditor", "[drift_auditor]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu_set original;
+    cpuaff::cpu cpu;
+    REQUIRE(manager.get_affinity(original));
+    REQUIRE(manager.get_cpu_from_index(cpu, 0));
+
+    cpuaff::thread_registry registry(manager);
+    cpuaff::drift_auditor auditor(manager, registry);
+    counting_listener listener;
+    auditor.set_listener(&listener);
+
+    cpuaff::cpu_set cpus;
+    cpus.insert(cpu);
+    REQUIRE(registry.register_thread("audited", cpus));
+
+    auditor.scan();
+    REQUIRE(auditor.scans() == 1);
+    REQUIRE(auditor.mask_changes() == 0);
+    REQUIRE(auditor.foreign_cpu_runs() == 0);
+    REQUIRE(auditor.drifting() == 0);
+
+    // the kernel drops cpus that do not exist from a thread's mask, so a
+    // registration that includes one never matches the actual mask
+    cpus.insert(cpuaff::cpu(cpuaff::cpu_spec(99, 0, 0), CPU_SETSIZE - 1, 0));
+    REQUIRE(registry.register_thread("audited", cpus));
+
+    auditor.scan();
+    auditor.scan();
+    REQUIRE(auditor.mask_changes() == 1);
+    REQUIRE(auditor.drifting() == 1);
+    REQUIRE(listener.mask_changed_calls == 1);
+    REQUIRE(listener.last_name == "audited");
+
+    if (original.size() > 1)
+    {
+        // change the mask from outside of cpuaff and back again
+        cpuaff::cpu other;
+        REQUIRE(manager.get_cpu_from_index(other, 1));
+        cpus.clear();
+        cpus.insert(cpu);
+        REQUIRE(registry.register_thread("audited", cpus));
+        auditor.scan();
+        REQUIRE(auditor.drifting() == 0);
+
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(other.id().get(), &mask);
+        REQUIRE(sched_setaffinity(0, sizeof(mask), &mask) == 0);
+        auditor.scan();
+        REQUIRE(auditor.mask_changes() == 2);
+        REQUIRE(listener.mask_changed_calls == 2);
+
+        REQUIRE(manager.set_affinity(cpus));
+        sched_yield();
+        auditor.scan();
+
+        if (auditor.drifting() == 0)
+        {
+            REQUIRE(listener.restored_calls == 1);
+        }
+    }
+
+    // the background thread scans at the requested interval
+    uint64_t scans = auditor.scans();
+    REQUIRE(auditor.start(10));
+    REQUIRE(auditor.running());
+    REQUIRE(!auditor.start(10));
+
+    for (int i = 0; i < 200 && auditor.scans() < scans + 2; ++i)
+    {
+        usleep(10000);
+    }
+
+    auditor.stop();
+    REQUIRE(!auditor.running());
+    REQUIRE(auditor.scans() >= scans + 2);
+
+    auditor.set_listener(NULL);
+    REQUIRE(registry.unregister_thread());
+    auditor.scan();
+    REQUIRE(auditor.drifting() == 0);
+    REQUIRE(manager.set_affinity(original));
+}
+
+TEST_CASE("sched_sampler", "[sched_sampler]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu_set original;
+    cpuaff::cpu cpu;
+    REQUIRE(manager.get_affinity(original));
+    REQUIRE(manager.get_cpu_from_index(cpu, 0));
+
+    SECTION("sched_stats arithmetic")
+    {
+        cpuaff::sched_stats earlier;
+        cpuaff::sched_stats later;
+        earlier.run_time = 10;
+        earlier.voluntary_switches = 5;
+        later.run_time = 25;
+        later.voluntary_switches = 3;
+
+        cpuaff::sched_stats delta = later - earlier;
+        REQUIRE(delta.run_time == 15);
+        REQUIRE(delta.voluntary_switches == 0);
+
+        delta += later;
+        REQUIRE(delta.run_time == 40);
+        REQUIRE(delta.voluntary_switches == 3);
+    }
+
+    SECTION("sched_sampler deltas")
+    {
+        cpuaff::thread_registry registry(manager);
+        cpuaff::sched_sampler sampler(manager, registry);
+        cpuaff::cpu_set cpus;
+        cpuaff::sched_stats stats;
+        cpuaff::thread_id_type self =
+            cpuaff::thread_id_type(syscall(SYS_gettid));
+
+        REQUIRE(!sampler.sample());
+        cpus.insert(cpu);
+        REQUIRE(registry.register_thread("sampled", cpus));
+
+        // the first sample is a baseline
+        REQUIRE(sampler.sample());
+        REQUIRE(sampler.get_delta(stats, self));
+        REQUIRE(stats.run_time == 0);
+        REQUIRE(sampler.get_totals(stats, self));
+
+        // run for a while and then sleep so the thread switches voluntarily
+        volatile uint64_t spin = 0;
+
+        for (int i = 0; i < 20000000; ++i)
+        {
+            spin = spin + uint64_t(i);
+        }
+
+        usleep(1000);
+        REQUIRE(sampler.sample());
+        REQUIRE(sampler.get_delta(stats, self));
+        REQUIRE(stats.run_time > 0);
+        REQUIRE(stats.voluntary_switches >= 1);
+        cpuaff::sched_stats totals;
+        REQUIRE(sampler.get_totals(totals, self));
+        REQUIRE(totals.run_time >= stats.run_time);
+
+        std::map< std::string, cpuaff::sched_stats > by_role;
+        REQUIRE(sampler.get_deltas_by_role(by_role));
+        REQUIRE(by_role.size() == 1);
+        REQUIRE(by_role["sampled"].run_time == stats.run_time);
+
+        std::map< cpuaff::cpu, cpuaff::sched_stats > by_cpu;
+        REQUIRE(sampler.get_deltas_by_cpu(by_cpu));
+        REQUIRE(by_cpu.size() == 1);
+        REQUIRE(by_cpu.begin()->first == cpu);
+        REQUIRE(by_cpu.begin()->second.run_time == stats.run_time);
+
+        REQUIRE(registry.unregister_thread());
+        REQUIRE(!sampler.sample());
+        REQUIRE(!sampler.get_delta(stats, self));
+        REQUIRE(manager.set_affinity(original));
+    }
+}
+
+#if defined(CPUAFF_CPU_LOAD_SUPPORTED)
+namespace
+{
+struct balanced_thread
+{
+    cpuaff::thread_registry *registry;
+    pthread_barrier_t *barrier;
+    cpuaff::thread_id_type tid;
+};
+
+// registers, waits for the test to run a round, then exits
+void *register_and_wait(void *arg)
+{
+    balanced_thread *thread = static_cast< balanced_thread * >(arg);
+    thread->tid = cpuaff::thread_id_type(syscall(SYS_gettid));
+    thread->registry->register_thread("floating");
+    pthread_barrier_wait(thread->barrier);
+    pthread_barrier_wait(thread->barrier);
+    return NULL;
+}
+}  // namespace
+
+TEST_CASE("rebalancer", "[rebalancer]")
+{
+    cpuaff::affinity_manager manager;
+    cpuaff::cpu_set original;
+    cpuaff::cpu_set cpus;
+    REQUIRE(manager.get_affinity(original));
+    REQUIRE(manager.get_cpus(cpus));
+
+    SECTION("rebalancer llc topology")
+    {
+        cpuaff::cpu_set::const_iterator i = cpus.begin();
+
+        for (; i != cpus.end(); ++i)
+        {
+            if (i->llc() >= 0)
+            {
+                cpuaff::cpu_set sharing;
+                REQUIRE(manager.get_cpus_by_llc(sharing, i->llc()));
+                REQUIRE(sharing.find(*i) != sharing.end());
+            }
+        }
+
+        cpuaff::cpu_set none;
+        REQUIRE(!manager.get_cpus_by_llc(none, -1));
+    }
+
+    SECTION("rebalancer rounds")
+    {
+        // act on every round so that the bookkeeping can be observed on a
+        // machine of any size
+        cpuaff::rebalance_policy policy;
+        policy.wait_threshold = -1.0;
+        policy.patience = 2;
+        policy.cooldown = 1;
+
+        cpuaff::thread_registry registry(manager);
+        cpuaff::rebalancer rebalancer(manager, registry, policy);
+        cpuaff::thread_id_type self =
+            cpuaff::thread_id_type(syscall(SYS_gettid));
+        cpuaff::cpu_set mask;
+
+        REQUIRE(registry.register_thread("floating", original));
+        REQUIRE(rebalancer.rebalance());
+        REQUIRE(!rebalancer.get_mask(mask, self));
+
+        rebalancer.add_group("floating");
+        REQUIRE(rebalancer.rebalance());
+        REQUIRE(rebalancer.get_mask(mask, self));
+        REQUIRE(mask == original);
+
+        for (int round = 0; round < 4; ++round)
+        {
+            volatile uint64_t spin = 0;
+
+            for (int i = 0; i < 5000000; ++i)
+            {
+                spin = spin + uint64_t(i);
+            }
+
+            // sleeping makes the kernel account the run time
+            usleep(1000);
+            REQUIRE(rebalancer.rebalance());
+        }
+
+        REQUIRE(rebalancer.rounds() == 6);
+        REQUIRE(rebalancer.contentions() >= 1);
+        REQUIRE(rebalancer.get_mask(mask, self));
+        REQUIRE(!mask.empty());
+
+        // whatever the rebalancer did, the thread is on the cpus it was
+        // given, and a thread that was moved or narrowed stayed within one
+        // numa node
+        cpuaff::cpu_set actual;
+        REQUIRE(manager.get_affinity(actual));
+        REQUIRE(actual == mask);
+
+        if (rebalancer.moves() + rebalancer.narrows() != 0)
+        {
+            REQUIRE(mask.begin()->numa() == mask.rbegin()->numa());
+        }
+
+        REQUIRE(rebalancer.remove_group("floating"));
+        REQUIRE(!rebalancer.remove_group("floating"));
+        REQUIRE(rebalancer.rebalance());
+        REQUIRE(!rebalancer.get_mask(mask, self));
+
+        REQUIRE(rebalancer.start(10));
+        REQUIRE(rebalancer.running());
+        rebalancer.stop();
+        REQUIRE(!rebalancer.running());
+        REQUIRE(manager.set_affinity(original));
+    }
+
+    SECTION("rebalancer restores and keeps masks")
+    {
+        cpuaff::rebalance_policy policy;
+        policy.wait_threshold = -1.0;
+        policy.patience = 1;
+
+        cpuaff::thread_registry registry(manager);
+        cpuaff::rebalancer rebalancer(manager, registry, policy);
+        cpuaff::thread_id_type self =
+            cpuaff::thread_id_type(syscall(SYS_gettid));
+        cpuaff::cpu_set mask;
+        cpuaff::cpu_set actual;
+
+        REQUIRE(registry.register_thread("floating", original));
+        rebalancer.add_group("floating");
+
+        for (int round = 0; round < 4; ++round)
+        {
+            usleep(1000);
+            REQUIRE(rebalancer.rebalance());
+        }
+
+        // a removed group gets back the cpus it registered with, whatever
+        // the rebalancer narrowed it to
+        REQUIRE(rebalancer.remove_group("floating"));
+        REQUIRE(!rebalancer.get_mask(mask, self));
+        REQUIRE(manager.get_affinity(actual));
+        REQUIRE(actual == original);
+        REQUIRE(registry.unregister_thread());
+
+        // a thread whose stats cannot be read keeps its state
+        pthread_barrier_t barrier;
+        pthread_barrier_init(&barrier, NULL, 2);
+
+        balanced_thread thread;
+        thread.registry = &registry;
+        thread.barrier = &barrier;
+
+        pthread_t handle;
+        rebalancer.add_group("floating");
+        REQUIRE(pthread_create(&handle, NULL, register_and_wait, &thread) ==
+                0);
+        pthread_barrier_wait(&barrier);
+        REQUIRE(rebalancer.rebalance());
+        REQUIRE(rebalancer.get_mask(mask, thread.tid));
+        pthread_barrier_wait(&barrier);
+        pthread_join(handle, NULL);
+        pthread_barrier_destroy(&barrier);
+
+        REQUIRE(rebalancer.rebalance());
+        REQUIRE(rebalancer.get_mask(mask, thread.tid));
+
+        REQUIRE(manager.set_affinity(original));
+    }
+}
+#endif
+#endif
+
+#if defined(CPUAFF_PAGE_PLACEMENT_SUPPORTED)
+TEST_CASE("page_placement_manager", "[page_placement_manager]")
+{
+    SECTION("page_placement_manager member functions")
+    {
+        cpuaff::affinity_manager manager;
+        cpuaff::page_placement_manager placement;
+
+        REQUIRE(manager.has_cpus());
+
+        std::vector< char > buffer(1024 * 1024, 1);
+        std::map< cpuaff::numa_type, std::size_t > pages;
+
+        if (placement.get_page_placement(pages, &buffer[0], buffer.size()))
+        {
+            std::size_t total = 0;
+
+            std::map< cpuaff::numa_type, std::size_t >::iterator i =
+                pages.begin();
+            std::map< cpuaff::numa_type, std::size_t >::iterator iend =
+                pages.end();
+
+            for (; i != iend; ++i)
+            {
+                WARN("numa " << i->first << ": " << i->second << " pages");
+                total += i->second;
+            }
+
+            REQUIRE(total > 0);
+
+            cpuaff::cpu cpu;
+            REQUIRE(manager.get_cpu_from_index(cpu, 0));
+
+            if (cpu.numa() >= 0)
+            {
+                std::size_t misplaced = 0;
+
+                REQUIRE(placement.move_to_numa(&buffer[0], buffer.size(),
+                                               cpu.numa()));
+                REQUIRE(placement.get_misplaced_pages(
+                    misplaced, &buffer[0], buffer.size(), cpu.numa()));
+                REQUIRE(misplaced == 0);
+
+                std::set< cpuaff::numa_type > numas;
+                numas.insert(cpu.numa());
+
+                REQUIRE(placement.spread_over_numa(&buffer[0], buffer.size(),
+                                                   numas));
+            }
+        }
+        else
+        {
+            WARN("Unable to determine page placement.");
+        }
+    }
+}
+#endif